@@ -0,0 +1,409 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program estimates the number of transmissions of the
+// kodo-wired-broadcast and kodo-recoders examples without running an ns-3
+// simulation (see kodo-analytic.h for the models).
+//
+// For the broadcast topology, the distribution of the transmissions follows
+// from a Markov chain of the rank of every receiver, which takes a few
+// milliseconds even for thousands of receivers. The receivers either share
+// the same erasure rate (errorRate) or have individual rates (errorRates).
+// For the recoders topology, the protocol is simulated on coding vectors
+// only (samples runs).
+//
+// The parameters have the same names as in the examples. With the validate
+// option, the program reads the results of a kodo-sweep run and compares the
+// simulated mean of every grid point with the model:
+//
+// python waf --run kodo-analytic --command-template="%s
+// --topology=broadcast --validate=kodo-sweep.csv"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <ns3/core-module.h>
+
+#include "kodo-analytic.h"
+#include <kodo/finite_field.hpp>
+
+using namespace ns3;
+
+// The parameters of both topologies
+struct Parameters
+{
+    std::string topology = "broadcast";
+    std::string field = "binary";
+    uint32_t generationSize = 0; // The default of the topology if 0
+    // Broadcast
+    double errorRate = 0.3;
+    uint32_t users = 2;
+    std::string errorRates = "";
+    // Recoders
+    double errorRateEncoderRecoder = 0.4;
+    double errorRateRecoderDecoder = 0.2;
+    bool recodingFlag = true;
+    uint32_t recoders = 2;
+    double transmitProbability = 0.5;
+    uint32_t samples = 10000;
+    uint32_t seed = 1;
+};
+
+static std::vector<std::string> Split(const std::string& text, char separator)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+
+    while (std::getline(stream, part, separator))
+    {
+        if (!part.empty())
+        {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+static kodo::finite_field Field(const std::string& field)
+{
+    std::map<std::string, kodo::finite_field> fieldMap;
+    fieldMap["binary"] = kodo::finite_field::binary;
+    fieldMap["binary4"] = kodo::finite_field::binary4;
+    fieldMap["binary8"] = kodo::finite_field::binary8;
+    fieldMap["binary16"] = kodo::finite_field::binary16;
+
+    // Use the binary field in case of errors
+    auto it = fieldMap.find(field);
+    return it == fieldMap.end() ? kodo::finite_field::binary : it->second;
+}
+
+// Returns the erasure rates of the broadcast receivers, or an empty vector
+// if a rate is not in [0, 1)
+static std::vector<double> Erasures(const Parameters& p)
+{
+    std::vector<double> erasures(p.users, p.errorRate);
+    if (!p.errorRates.empty())
+    {
+        erasures.clear();
+        for (const auto& e : Split(p.errorRates, ','))
+        {
+            char* end = nullptr;
+            double erasure = std::strtod(e.c_str(), &end);
+            if (end != e.c_str() + e.size())
+            {
+                erasure = -1.0;
+            }
+            erasures.push_back(erasure);
+        }
+    }
+
+    if (erasures.empty())
+    {
+        std::cerr << "The broadcast topology needs a receiver" << std::endl;
+    }
+    for (auto e : erasures)
+    {
+        if (!(e >= 0.0 && e < 1.0))
+        {
+            std::cerr << "The erasure rates must be in [0, 1)" << std::endl;
+            return {};
+        }
+    }
+    return erasures;
+}
+
+// Returns the distribution of the transmissions as P(T = t), or an empty
+// distribution if the parameters are invalid
+static std::vector<double> Distribution(const Parameters& p)
+{
+    std::vector<double> pmf;
+
+    if (p.topology == "recoders")
+    {
+        RecodersModel model(Field(p.field), p.generationSize, p.recoders,
+                            p.errorRateEncoderRecoder,
+                            p.errorRateRecoderDecoder, p.transmitProbability,
+                            p.recodingFlag);
+
+        for (auto t : model.Sample(p.samples, p.seed))
+        {
+            if (t >= pmf.size())
+            {
+                pmf.resize(t + 1, 0.0);
+            }
+            pmf[t] += 1.0 / p.samples;
+        }
+        return pmf;
+    }
+
+    auto erasures = Erasures(p);
+    if (erasures.empty())
+    {
+        return pmf;
+    }
+
+    BroadcastModel model(Field(p.field), p.generationSize);
+    auto cdf = model.Cdf(erasures);
+    pmf.resize(cdf.size());
+    for (uint32_t t = 0; t < cdf.size(); t++)
+    {
+        pmf[t] = cdf[t] - (t == 0 ? 0.0 : cdf[t - 1]);
+    }
+    return pmf;
+}
+
+static double Mean(const std::vector<double>& pmf)
+{
+    double mean = 0.0;
+    for (uint32_t t = 0; t < pmf.size(); t++)
+    {
+        mean += t * pmf[t];
+    }
+    return mean;
+}
+
+// Returns false if the field is not a finite number
+static bool ParseNumber(const std::string& field, double& value)
+{
+    char* end = nullptr;
+    value = std::strtod(field.c_str(), &end);
+    return !field.empty() && end == field.c_str() + field.size() &&
+           std::isfinite(value);
+}
+
+// Returns false if the field is not a non-negative integer
+static bool ParseCount(const std::string& field, uint32_t& value)
+{
+    double number;
+    if (!ParseNumber(field, number) || number < 0 ||
+        number != std::floor(number) || number > UINT32_MAX)
+    {
+        return false;
+    }
+    value = uint32_t(number);
+    return true;
+}
+
+// Overrides a parameter given as "name=value" by a sweep grid point.
+// Returns false if the value cannot be modelled, e.g. "auto".
+static bool Apply(Parameters& p, const std::string& parameter)
+{
+    auto separator = parameter.find('=');
+    std::string name = parameter.substr(0, separator);
+    std::string value = parameter.substr(separator + 1);
+
+    if (name == "field")
+    {
+        p.field = value;
+    }
+    else if (name == "generationSize")
+    {
+        return ParseCount(value, p.generationSize);
+    }
+    else if (name == "errorRate")
+    {
+        return ParseNumber(value, p.errorRate);
+    }
+    else if (name == "users")
+    {
+        return ParseCount(value, p.users);
+    }
+    else if (name == "errorRateEncoderRecoder")
+    {
+        return ParseNumber(value, p.errorRateEncoderRecoder);
+    }
+    else if (name == "errorRateRecoderDecoder")
+    {
+        return ParseNumber(value, p.errorRateRecoderDecoder);
+    }
+    else if (name == "recodingFlag")
+    {
+        p.recodingFlag = value == "true" || value == "1";
+    }
+    else if (name == "recoders")
+    {
+        return ParseCount(value, p.recoders);
+    }
+    else if (name == "transmitProbability")
+    {
+        return ParseNumber(value, p.transmitProbability);
+    }
+    return true;
+}
+
+// Compares the model with the results of a kodo-sweep run
+static int Validate(const Parameters& defaults, const std::string& file)
+{
+    std::ifstream results(file);
+    if (!results)
+    {
+        std::cerr << "Cannot read " << file << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, std::vector<double>> points;
+    std::string line;
+    std::getline(results, line); // Header
+
+    while (std::getline(results, line))
+    {
+        auto fields = Split(line, ',');
+        double transmissions = 0.0;
+        if (fields.size() < 4 || !ParseNumber(fields[3], transmissions))
+        {
+            std::cerr << "Skipping malformed line: " << line << std::endl;
+            continue;
+        }
+        points[fields[0]].push_back(transmissions);
+    }
+
+    uint32_t failed = 0;
+    for (const auto& point : points)
+    {
+        const auto& samples = point.second;
+        double mean = 0.0;
+        double variance = 0.0;
+        for (auto x : samples)
+        {
+            mean += x / samples.size();
+        }
+        for (auto x : samples)
+        {
+            variance += (x - mean) * (x - mean) /
+                        std::max<double>(samples.size() - 1, 1);
+        }
+        double ci95 = 1.96 * std::sqrt(variance / samples.size());
+
+        Parameters p = defaults;
+        bool valid = true;
+        for (const auto& parameter : Split(point.first, ' '))
+        {
+            if (!Apply(p, parameter))
+            {
+                std::cerr << "Invalid parameter " << parameter << std::endl;
+                valid = false;
+            }
+        }
+        auto pmf = valid ? Distribution(p) : std::vector<double>();
+        if (pmf.empty())
+        {
+            std::cerr << "Skipping " << point.first << std::endl;
+            failed++;
+            continue;
+        }
+        double model = Mean(pmf);
+
+        // The model passes if it is inside the confidence interval of the
+        // simulation, with a small margin for the broadcast approximation
+        bool ok = std::abs(model - mean) <= ci95 + 0.05 * mean;
+        failed += ok ? 0 : 1;
+
+        std::cout << point.first << ": simulation " << mean << " +/- " << ci95
+                  << " (" << samples.size() << " runs), model " << model
+                  << (ok ? " [ok]" : " [MISMATCH]") << std::endl;
+    }
+
+    std::cout << points.size() - failed << " of " << points.size()
+              << " points match the model" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    Parameters p;
+    bool distribution = false; // Print the full distribution
+    std::string validate = ""; // Results of kodo-sweep to validate against
+
+    CommandLine cmd;
+
+    cmd.AddValue("topology", "Topology to model (broadcast or recoders)",
+                 p.topology);
+    cmd.AddValue("field", "Finite field used", p.field);
+    cmd.AddValue("generationSize",
+                 "Set the generation size to use (0 for the topology default)",
+                 p.generationSize);
+    cmd.AddValue("errorRate", "Packet erasure rate for the links", p.errorRate);
+    cmd.AddValue("users", "Number of receivers", p.users);
+    cmd.AddValue("errorRates", "Comma-separated erasure rate per receiver",
+                 p.errorRates);
+    cmd.AddValue("errorRateEncoderRecoder",
+                 "Packet erasure rate for the encoder-recoder link",
+                 p.errorRateEncoderRecoder);
+    cmd.AddValue("errorRateRecoderDecoder",
+                 "Packet erasure rate for the recoder-decoder link",
+                 p.errorRateRecoderDecoder);
+    cmd.AddValue("recodingFlag", "Enable packet recoding", p.recodingFlag);
+    cmd.AddValue("recoders", "Amount of recoders", p.recoders);
+    cmd.AddValue("transmitProbability", "Transmit probability from recoder",
+                 p.transmitProbability);
+    cmd.AddValue("samples", "Simulated runs of the recoders model", p.samples);
+    cmd.AddValue("seed", "Seed of the recoders model", p.seed);
+    cmd.AddValue("distribution", "Print the full distribution", distribution);
+    cmd.AddValue("validate", "kodo-sweep results to validate against",
+                 validate);
+
+    cmd.Parse(argc, argv);
+
+    // Use the generation size of the example of the topology by default
+    if (p.generationSize == 0)
+    {
+        p.generationSize = p.topology == "recoders" ? 3 : 5;
+    }
+
+    if (!validate.empty())
+    {
+        return Validate(p, validate);
+    }
+
+    auto pmf = Distribution(p);
+    if (pmf.empty())
+    {
+        return 1;
+    }
+    double mean = Mean(pmf);
+    double variance = 0.0;
+    for (uint32_t t = 0; t < pmf.size(); t++)
+    {
+        variance += (t - mean) * (t - mean) * pmf[t];
+    }
+
+    std::cout << "Expected transmissions: " << mean << std::endl;
+    std::cout << "Standard deviation: " << std::sqrt(variance) << std::endl;
+
+    if (distribution)
+    {
+        std::cout << "transmissions,probability" << std::endl;
+        for (uint32_t t = 0; t < pmf.size(); t++)
+        {
+            if (pmf[t] > 1e-12)
+            {
+                std::cout << t << "," << pmf[t] << std::endl;
+            }
+        }
+    }
+
+    return 0;
+}
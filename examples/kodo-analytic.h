@@ -0,0 +1,267 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Models of the number of transmissions needed by the example topologies.
+//
+// BroadcastModel describes the rank of every receiver as a Markov chain:
+// with rank r out of g, a transmission increases the rank with probability
+// (1 - e) * (1 - q^(r - g)), where e is the erasure rate of the receiver
+// and q the field size. The distribution of the transmissions needed by one
+// receiver follows exactly from this chain. For N receivers the
+// distributions are combined as if the receivers were independent, which
+// ignores that they all see the same coding vectors (the error of this
+// approximation is only visible for GF(2) and small generations). A
+// receiver with an erasure rate of 1 never decodes, so the erasure rates are
+// limited to maxErasure.
+//
+// RecodersModel simulates the encoder - recoders - decoder protocol of the
+// Recoders helper on coding vectors only (see CoefficientSpace), which is
+// orders of magnitude faster than an ns-3 run.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <kodo/finite_field.hpp>
+
+#include "kodo-coefficient-space.h"
+
+class BroadcastModel
+{
+public:
+    // The highest erasure rate of a receiver in the model
+    static constexpr double maxErasure = 0.995;
+
+    BroadcastModel(const kodo::finite_field field,
+                   const uint32_t generationSize) :
+        m_fieldSize(FiniteField(field).Size()),
+        m_generationSize(generationSize)
+    {
+    }
+
+    // Returns P(T <= t) for t = 0, 1, ..., maxTransmissions, where T is the
+    // number of transmissions needed by a receiver with the given erasure
+    // rate
+    std::vector<double> ReceiverCdf(double erasure,
+                                    uint32_t maxTransmissions) const
+    {
+        const uint32_t g = m_generationSize;
+        std::vector<double> rank(g + 1, 0.0);
+        std::vector<double> cdf(maxTransmissions + 1, 0.0);
+        rank[0] = 1.0;
+
+        for (uint32_t t = 1; t <= maxTransmissions; t++)
+        {
+            // Update from the highest rank, so that rank[r - 1] still holds
+            // the probability of the previous transmission
+            for (uint32_t r = g; r > 0; r--)
+            {
+                double stay = r == g ? 1.0 : 1.0 - Step(erasure, r);
+                rank[r] = rank[r] * stay + rank[r - 1] * Step(erasure, r - 1);
+            }
+            rank[0] *= 1.0 - Step(erasure, 0);
+            cdf[t] = rank[g];
+        }
+        return cdf;
+    }
+
+    // Returns P(T <= t), where T is the number of transmissions needed until
+    // all receivers have decoded. The distribution is computed until
+    // P(T > t) < epsilon.
+    std::vector<double> Cdf(const std::vector<double>& erasures,
+                            double epsilon = 1e-9) const
+    {
+        // Receivers with the same erasure rate share their distribution
+        std::map<double, uint32_t> groups;
+        for (auto e : erasures)
+        {
+            groups[std::min(std::max(e, 0.0), double(maxErasure))]++;
+        }
+
+        uint32_t maxTransmissions = 4 * m_generationSize;
+        while (true)
+        {
+            std::vector<double> cdf(maxTransmissions + 1, 1.0);
+            for (const auto& group : groups)
+            {
+                auto receiver = ReceiverCdf(group.first, maxTransmissions);
+                for (uint32_t t = 0; t <= maxTransmissions; t++)
+                {
+                    cdf[t] *= std::pow(receiver[t], group.second);
+                }
+            }
+
+            if (1.0 - cdf.back() < epsilon || maxTransmissions > (1U << 24))
+            {
+                return cdf;
+            }
+            maxTransmissions *= 2;
+        }
+    }
+
+    static double Mean(const std::vector<double>& cdf)
+    {
+        double mean = 0.0;
+        for (auto p : cdf)
+        {
+            mean += 1.0 - p;
+        }
+        return mean;
+    }
+
+    // Returns the smallest t with P(T <= t) >= probability
+    static uint32_t Quantile(const std::vector<double>& cdf, double probability)
+    {
+        auto it = std::lower_bound(cdf.begin(), cdf.end(), probability);
+        return std::min<uint32_t>(it - cdf.begin(), cdf.size() - 1);
+    }
+
+private:
+    // Probability that a transmission increases the rank r of a receiver
+    double Step(double erasure, uint32_t r) const
+    {
+        double missing = double(m_generationSize) - r;
+        return (1.0 - erasure) * (1.0 - std::pow(m_fieldSize, -missing));
+    }
+
+private:
+    const double m_fieldSize;
+    const uint32_t m_generationSize;
+};
+
+class RecodersModel
+{
+public:
+    RecodersModel(const kodo::finite_field field, const uint32_t generationSize,
+                  const uint32_t recoders, const double errorRateEncoderRecoder,
+                  const double errorRateRecoderDecoder,
+                  const double transmitProbability, const bool recodingFlag) :
+        m_field(field),
+        m_generationSize(generationSize), m_recoders(recoders),
+        m_errorRateEncoderRecoder(errorRateEncoderRecoder),
+        m_errorRateRecoderDecoder(errorRateRecoderDecoder),
+        m_transmitProbability(transmitProbability),
+        m_recodingFlag(recodingFlag)
+    {
+    }
+
+    // Returns the total (encoder and recoders) transmissions of the given
+    // number of simulated runs
+    std::vector<uint32_t> Sample(uint32_t runs, uint32_t seed) const
+    {
+        std::mt19937 random(seed);
+        std::vector<uint32_t> samples;
+
+        for (uint32_t run = 0; run < runs; run++)
+        {
+            samples.push_back(Run(random));
+        }
+        return samples;
+    }
+
+private:
+    // One run follows the Recoders helper: in every slot the encoder sends
+    // (while a recoder is incomplete), then every recoder with a non-zero
+    // rank sends with the transmit probability (while the decoder is
+    // incomplete).
+    uint32_t Run(std::mt19937& random) const
+    {
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        const uint32_t g = m_generationSize;
+
+        std::vector<CoefficientSpace> recoders(
+            m_recoders, CoefficientSpace(m_field, g));
+        std::vector<std::vector<std::vector<uint32_t>>> received(m_recoders);
+        CoefficientSpace decoder(m_field, g);
+        uint32_t transmissions = 0;
+
+        // The limit only stops runs that can never complete, e.g. with
+        // an erasure rate of 1
+        for (uint32_t slot = 0; !decoder.IsComplete() && slot < (1U << 24);
+             slot++)
+        {
+            bool recodersComplete = true;
+            for (const auto& recoder : recoders)
+            {
+                recodersComplete &= recoder.IsComplete();
+            }
+
+            if (!recodersComplete)
+            {
+                std::vector<uint32_t> vector(g);
+                for (auto& v : vector)
+                {
+                    v = random() % m_field.Size();
+                }
+                transmissions++;
+
+                for (uint32_t n = 0; n < m_recoders; n++)
+                {
+                    if (uniform(random) >= m_errorRateEncoderRecoder)
+                    {
+                        recoders[n].Insert(vector);
+                        if (!m_recodingFlag)
+                        {
+                            received[n].push_back(vector);
+                        }
+                    }
+                }
+            }
+
+            for (uint32_t n = 0; n < m_recoders && !decoder.IsComplete(); n++)
+            {
+                bool transmit = uniform(random) <= m_transmitProbability;
+                if (recoders[n].Rank() == 0 || !transmit)
+                {
+                    continue;
+                }
+
+                transmissions++;
+                if (uniform(random) < m_errorRateRecoderDecoder)
+                {
+                    continue;
+                }
+
+                if (m_recodingFlag)
+                {
+                    decoder.Insert(recoders[n].Recode(random));
+                }
+                else
+                {
+                    decoder.Insert(
+                        received[n][random() % received[n].size()]);
+                }
+            }
+        }
+        return transmissions;
+    }
+
+private:
+    const FiniteField m_field;
+    const uint32_t m_generationSize;
+    const uint32_t m_recoders;
+    const double m_errorRateEncoderRecoder;
+    const double m_errorRateRecoderDecoder;
+    const double m_transmitProbability;
+    const bool m_recodingFlag;
+};
@@ -0,0 +1,153 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program measures the encoding throughput of the BatchEncoder (see
+// kodo-batch-encoder.h) for batch sizes from 1 to 64 without running an
+// ns-3 simulation.
+//
+// Between two dequeued packets, the program touches a buffer of pollute
+// bytes to emulate the work of the simulator between two send events,
+// which evicts the source block from the cache when the batch size is 1.
+// For every batch size, the throughput of the coded symbols and the
+// speedup over a batch size of 1 are printed:
+//
+// python waf --run kodo-batch-benchmark --command-template="%s
+// --field=binary8 --generationSize=64 --pollute=4194304"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <ns3/core-module.h>
+
+#include "kodo-batch-encoder.h"
+#include <kodo/block/encoder.hpp>
+#include <kodo/block/generator/random_uniform.hpp>
+#include <kodo/finite_field.hpp>
+
+using namespace ns3;
+
+int main(int argc, char* argv[])
+{
+    std::string field = "binary8";  // Finite field used
+    uint32_t generationSize = 32;   // Symbols per generation
+    uint32_t packetSize = 1000;     // Bytes per coded packet
+    uint32_t packets = 20000;       // Packets dequeued per batch size
+    uint32_t maxBatchSize = 64;     // Largest batch size
+    uint32_t pollute = 1024 * 1024; // Bytes touched between two packets
+    std::string header = "seed";    // Packet header (seed or coefficients)
+
+    // Create a map for the field values
+    std::map<std::string, kodo::finite_field> fieldMap;
+    fieldMap["binary"] = kodo::finite_field::binary;
+    fieldMap["binary4"] = kodo::finite_field::binary4;
+    fieldMap["binary8"] = kodo::finite_field::binary8;
+    fieldMap["binary16"] = kodo::finite_field::binary16;
+
+    CommandLine cmd;
+
+    cmd.AddValue("field", "Finite field used", field);
+    cmd.AddValue("generationSize", "Set the generation size to use",
+                 generationSize);
+    cmd.AddValue("packetSize", "Size of the coded packets", packetSize);
+    cmd.AddValue("packets", "Packets dequeued per batch size", packets);
+    cmd.AddValue("maxBatchSize", "Largest batch size", maxBatchSize);
+    cmd.AddValue("pollute", "Bytes touched between two packets", pollute);
+    cmd.AddValue("header", "Packet header (seed or coefficients)", header);
+
+    cmd.Parse(argc, argv);
+
+    // Use the binary8 field in case of errors
+    if (fieldMap.find(field) == fieldMap.end())
+    {
+        field = "binary8";
+    }
+
+    kodo::block::generator::random_uniform generator(fieldMap[field]);
+    generator.configure(generationSize);
+
+    auto headerType = header == "coefficients"
+                          ? BatchEncoder::Header::coefficients
+                          : BatchEncoder::Header::seed;
+    uint32_t headerSize = headerType == BatchEncoder::Header::seed
+                              ? sizeof(uint32_t)
+                              : generator.max_coefficients_bytes();
+
+    kodo::block::encoder encoder(fieldMap[field]);
+    encoder.configure(generationSize, packetSize - headerSize);
+    std::vector<uint8_t> data(encoder.block_bytes());
+    for (uint32_t i = 0; i < data.size(); i++)
+    {
+        data[i] = uint8_t(i * 7 + 3);
+    }
+    encoder.set_symbols_storage(data.data());
+
+    Profiler profiler("BatchEncoder");
+    BatchEncoder batchEncoder(encoder, fieldMap[field], headerType,
+                              packetSize, profiler);
+    uint32_t seed = 0;
+    batchEncoder.SetSeedSource([&seed]() { return seed++; });
+
+    std::vector<uint8_t> scratch(pollute);
+    uint64_t checksum = 0;
+
+    std::cout << "Encoding " << packets << " packets of " << packetSize
+              << " bytes, field " << field << ", generation size "
+              << generationSize << ", " << pollute
+              << " bytes touched between two packets" << std::endl;
+    std::cout << "batch_size,throughput_mb_s,speedup" << std::endl;
+
+    double baseline = 0.0;
+    for (uint32_t batchSize = 1; batchSize <= maxBatchSize; batchSize *= 2)
+    {
+        batchEncoder.SetBatchSize(batchSize);
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < packets; i++)
+        {
+            const uint8_t* packet = batchEncoder.Next();
+            checksum += packet[packetSize - 1];
+
+            // Emulate the scheduler work by walking a cache line at a time
+            for (uint32_t j = 0; j < scratch.size(); j += 64)
+            {
+                scratch[j]++;
+            }
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        double throughput =
+            double(packets) * (packetSize - headerSize) / elapsed.count() / 1e6;
+        if (batchSize == 1)
+        {
+            baseline = throughput;
+        }
+
+        std::cout << batchSize << "," << throughput << ","
+                  << throughput / baseline << std::endl;
+    }
+
+    // Keep the results alive so the loops are not optimized away
+    std::cout << "Checksum: " << checksum + scratch[0] << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,210 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class encodes a batch of coded packets ahead of the send events.
+//
+// The packets are written to a ring that is allocated once. When the ring
+// is empty, the coefficients of the whole batch are generated and the
+// symbols are encoded in one loop, so the source block stays in the cache
+// across the symbols of the batch instead of being evicted by the simulator
+// work between two send events. A send event only takes the next packet.
+//
+// The packets start with a header that is either the coefficient seed
+// (seed) or the coefficients themselves (coefficients), followed by the
+// coded symbol. A prefix of a given size can be reserved in front of the
+// header for the caller, e.g. for a generation index.
+//
+// The coefficients are drawn with a generator of the batch encoder, so no
+// other code shifts them between two batches. The packets that were
+// encoded ahead but not sent when the encoder moves to another generation
+// keep their seeds or coefficients and are only encoded again (Rewind), so
+// the sent packets are the same as without batching. Clear drops them, at
+// the end of a trial where the seeds or the generator start over.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <endian/big_endian.hpp>
+#include <kodo/block/encoder.hpp>
+#include <kodo/block/generator/random_uniform.hpp>
+#include <kodo/finite_field.hpp>
+
+#include "kodo-profiler.h"
+
+class BatchEncoder
+{
+public:
+    enum class Header
+    {
+        seed,
+        coefficients
+    };
+
+    // Returns the seed of the next packet (seed header only)
+    using SeedSource = std::function<uint32_t()>;
+
+    BatchEncoder(kodo::block::encoder& encoder,
+                 const kodo::finite_field field, const Header header,
+                 const uint32_t packetSize, Profiler& profiler) :
+        m_encoder(encoder),
+        m_generator(field), m_header(header), m_packetSize(packetSize),
+        m_profiler(profiler), m_prefixSize(0), m_headerSize(0),
+        m_coefficientsSize(0), m_batchSize(0), m_next(0), m_size(0),
+        m_stale(false)
+    {
+    }
+
+    void SetSeedSource(const SeedSource& seedSource)
+    {
+        m_seedSource = seedSource;
+    }
+
+    // Reserves bytes in front of the header of every packet, which the
+    // caller fills in after Next()
+    void SetPrefixSize(uint32_t prefixSize)
+    {
+        m_prefixSize = prefixSize;
+        Clear();
+    }
+
+    // Seeds the generator of the coefficients (coefficients header only) and
+    // drops the packets that were encoded ahead
+    void SetSeed(uint32_t seed)
+    {
+        Clear();
+        m_generator.set_seed(seed);
+    }
+
+    // Allocates the ring. The encoder must be configured.
+    void SetBatchSize(uint32_t batchSize)
+    {
+        m_batchSize = std::max(batchSize, 1U);
+        m_generator.configure(m_encoder.symbols());
+        m_coefficientsSize = m_generator.max_coefficients_bytes();
+        m_headerSize =
+            m_header == Header::seed ? sizeof(uint32_t) : m_coefficientsSize;
+
+        m_ring.resize(m_batchSize * m_packetSize);
+        m_coefficients.resize(m_batchSize * m_coefficientsSize);
+        Clear();
+    }
+
+    uint32_t GetBatchSize() const
+    {
+        return m_batchSize;
+    }
+
+    // Drops the packets that were encoded ahead, e.g. at the end of a trial
+    void Clear()
+    {
+        m_next = 0;
+        m_size = 0;
+        m_stale = false;
+    }
+
+    // Encodes the packets that were encoded ahead again from the current
+    // source block with the same headers, e.g. for the next generation
+    void Rewind()
+    {
+        m_stale = m_next < m_size;
+    }
+
+    // Returns the next coded packet of packetSize bytes. The packet is valid
+    // until the next call.
+    uint8_t* Next()
+    {
+        if (m_next == m_size)
+        {
+            Encode();
+        }
+        else if (m_stale)
+        {
+            EncodeSymbols(m_next);
+        }
+        return m_ring.data() + m_packetSize * m_next++;
+    }
+
+private:
+    void Encode()
+    {
+        {
+            KODO_NS3_PROFILE(m_profiler, coefficients);
+            for (uint32_t k = 0; k < m_batchSize; k++)
+            {
+                uint8_t* packet =
+                    m_ring.data() + m_packetSize * k + m_prefixSize;
+                uint8_t* coefficients =
+                    m_coefficients.data() + m_coefficientsSize * k;
+
+                if (m_header == Header::seed)
+                {
+                    uint32_t seed = m_seedSource();
+                    endian::big_endian::put(seed, packet);
+                    m_generator.set_seed(seed);
+                }
+                m_generator.generate(coefficients);
+
+                if (m_header == Header::coefficients)
+                {
+                    std::copy(coefficients, coefficients + m_coefficientsSize,
+                              packet);
+                }
+            }
+        }
+
+        m_next = 0;
+        m_size = m_batchSize;
+        EncodeSymbols(0);
+    }
+
+    // All symbols of the batch are encoded from the same source block
+    void EncodeSymbols(uint32_t first)
+    {
+        KODO_NS3_PROFILE(m_profiler, encode);
+        for (uint32_t k = first; k < m_size; k++)
+        {
+            m_encoder.encode_symbol(
+                m_ring.data() + m_packetSize * k + m_prefixSize + m_headerSize,
+                m_coefficients.data() + m_coefficientsSize * k);
+        }
+        m_stale = false;
+    }
+
+private:
+    kodo::block::encoder& m_encoder;
+    kodo::block::generator::random_uniform m_generator;
+    const Header m_header;
+    const uint32_t m_packetSize;
+    Profiler& m_profiler;
+
+    uint32_t m_prefixSize;
+    uint32_t m_headerSize;
+    uint32_t m_coefficientsSize;
+    uint32_t m_batchSize;
+    std::vector<uint8_t> m_ring;
+    std::vector<uint8_t> m_coefficients;
+    SeedSource m_seedSource;
+
+    uint32_t m_next;
+    uint32_t m_size;
+    bool m_stale;
+};
@@ -0,0 +1,519 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program is a performance regression suite for the
+// kodo-wired-broadcast, kodo-wifi-broadcast and kodo-recoders examples.
+//
+// Every scenario runs an example with fixed parameters as a separate
+// process, from small topologies to 1k and 10k receivers on the fast
+// channel of kodo-wired-broadcast. For every scenario, the suite records
+// the wall time (best of the repetitions), the simulator events per second
+// (from the "Simulator events" line of the example), the peak resident set
+// of the process and the encoding and decoding cost per symbol of the
+// scenario's field and generation size measured with the kodo library.
+// The recoders-redundant scenarios run many recoders with and without the
+// rejection of non-innovative packets (see kodo-innovation-filter.h), and
+// the filter-check scenario fails when the spaces of the filter do not
+// mirror the kodo decoder in every field (kodo-innovation-filter-check).
+// The wired-packed-burst scenario ends every burst of the open-loop source
+// with a packed frame of a single symbol, and fails when a receiver decodes
+// a block that does not match its digest.
+//
+// With --mpiRanks, kodo-recoders-mpi also runs with mpirun on each of the
+// given numbers of ranks, and the speedup over the first one is printed.
+//
+// Every run is appended as one JSON line to the history file. With
+// --saveBaseline, the run is also stored as the baseline, and otherwise
+// every scenario is compared with the baseline: a scenario regresses when
+// a metric is worse than the baseline by more than the tolerance, in which
+// case the program exits with an error. A scenario fails when its example
+// exits with an error, e.g. when a decoded block does not match its digest;
+// the errors of the examples are passed to the standard error of the suite.
+// A run with failed scenarios is not stored as the baseline. Everything
+// runs offline on the local machine.
+//
+// Example (from the ns-3 folder):
+//
+// python waf --run kodo-benchmark --command-template="%s
+// --prefix=build/examples/kodo/ns3.30- --suffix=-debug --label=kodo-8"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ns3/core-module.h>
+
+#include "kodo-tuner.h"
+#include <kodo/block/generator/random_uniform.hpp>
+#include <kodo/finite_field.hpp>
+
+using namespace ns3;
+
+// A fixed benchmark scenario
+struct Scenario
+{
+    std::string name;
+    std::string program;
+    std::string arguments;
+    std::string launcher; // Command in front of the program, e.g. mpirun
+    std::string field;
+    uint32_t generationSize;
+};
+
+struct Result
+{
+    double wallSeconds = 0.0;
+    uint64_t events = 0;
+    double eventsPerSecond = 0.0;
+    double peakRssMb = 0.0;
+    double encodeNs = 0.0; // Per symbol
+    double decodeNs = 0.0; // Per symbol
+    bool ok = false;
+};
+
+static std::vector<Scenario> Scenarios(const std::vector<std::string>& ranks)
+{
+    // The fast channel with 10 ms between the packets of the source, which
+    // is also the bin width of the latency histogram. Baselines saved
+    // before kodo-wired-broadcast parsed --interval ran these scenarios
+    // with 1 s between the packets.
+    const std::string fast = " --channel=fast --interval=0.01";
+
+    // Many recoders that all transmit over good links, so most packets
+    // that reach the decoder are not innovative
+    const std::string redundant =
+        "--recoders=64 --generationSize=32 --field=binary8 --packetSize=1400"
+        " --transmitProbability=1 --errorRateEncoderRecoder=0.05"
+        " --errorRateRecoderDecoder=0.05";
+    std::vector<Scenario> scenarios = {
+        {"wired-small", "kodo-wired-broadcast",
+         "--users=2 --generationSize=5", "", "binary", 5},
+        {"wired-medium", "kodo-wired-broadcast",
+         "--users=20 --generationSize=32 --field=binary8 --trials=10", "",
+         "binary8", 32},
+        {"wired-1k", "kodo-wired-broadcast",
+         "--users=1000 --generationSize=32 --field=binary8" + fast, "",
+         "binary8", 32},
+        {"wired-10k", "kodo-wired-broadcast",
+         "--users=10000 --generationSize=32 --field=binary8" + fast, "",
+         "binary8", 32},
+        {"wifi-small", "kodo-wifi-broadcast", "--users=2 --generationSize=5",
+         "", "binary", 5},
+        {"wifi-medium", "kodo-wifi-broadcast",
+         "--users=10 --generationSize=16 --field=binary8", "", "binary8", 16},
+        {"recoders-small", "kodo-recoders", "--recoders=2 --generationSize=3",
+         "", "binary", 3},
+        {"recoders-medium", "kodo-recoders",
+         "--recoders=8 --generationSize=16 --field=binary8", "", "binary8",
+         16},
+        {"recoders-redundant", "kodo-recoders", redundant, "", "binary8", 32},
+        {"recoders-redundant-unfiltered", "kodo-recoders",
+         redundant + " --innovationFilter=0", "", "binary8", 32},
+        {"filter-check", "kodo-innovation-filter-check", "", "", "binary8",
+         16},
+        {"wired-packed-burst", "kodo-wired-broadcast",
+         "--users=2 --generationSize=5 --field=binary16 --symbolsPerFrame=4"
+         " --targetProbability=0.99 --errorRate=0 --priorLoss=0"
+         " --channel=fast --trials=10",
+         "", "binary16", 5},
+    };
+
+    // The same distributed topology on every number of ranks
+    for (const auto& n : ranks)
+    {
+        scenarios.push_back({"recoders-mpi-" + n, "kodo-recoders-mpi",
+                             "--recoders=2000 --generationSize=16",
+                             "mpirun -np " + n + " ", "binary8", 16});
+    }
+    return scenarios;
+}
+
+static std::vector<std::string> Split(const std::string& text, char separator)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+
+    while (std::getline(stream, part, separator))
+    {
+        if (!part.empty())
+        {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+// Runs the command in a child process and measures its wall time and peak
+// resident set. Returns false if the command failed.
+static bool RunProcess(const std::string& command, Result& result)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    close(fds[1]);
+
+    // The examples end with "Simulator events: N"
+    const std::string marker = "Simulator events: ";
+    FILE* output = fdopen(fds[0], "r");
+    char line[512];
+    while (fgets(line, sizeof(line), output) != nullptr)
+    {
+        std::string text(line);
+        if (text.compare(0, marker.size(), marker) == 0)
+        {
+            result.events = std::stoull(text.substr(marker.size()));
+        }
+    }
+    fclose(output);
+
+    // wait4 reports the resources of this child only
+    int status = 0;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    result.wallSeconds = elapsed.count();
+    result.peakRssMb = usage.ru_maxrss / 1024.0;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static Result RunScenario(const Scenario& scenario, const std::string& prefix,
+                          const std::string& suffix, uint32_t repetitions)
+{
+    std::string command = scenario.launcher + prefix + scenario.program +
+                          suffix + " " + scenario.arguments;
+
+    Result best;
+    double peakRssMb = 0.0;
+    for (uint32_t r = 0; r < repetitions; r++)
+    {
+        Result result;
+        if (!RunProcess(command, result))
+        {
+            return Result();
+        }
+        peakRssMb = std::max(peakRssMb, result.peakRssMb);
+        if (!best.ok || result.wallSeconds < best.wallSeconds)
+        {
+            best = result;
+            best.ok = true;
+        }
+    }
+    best.peakRssMb = peakRssMb;
+    best.eventsPerSecond = best.events / best.wallSeconds;
+
+    // The coding cost of the scenario without the simulator. The Broadcast
+    // header is the generation index and the seed, the Recoders header the
+    // coefficients.
+    auto field = Tuner::Field(scenario.field);
+    kodo::block::generator::random_uniform generator(field);
+    generator.configure(scenario.generationSize);
+    uint32_t headerSize = scenario.program == "kodo-recoders"
+                              ? generator.max_coefficients_bytes()
+                              : 2 * sizeof(uint32_t);
+    if (scenario.program == "kodo-recoders-mpi")
+    {
+        headerSize = 1 + generator.max_coefficients_bytes();
+    }
+
+    double encodeUs = 0.0;
+    double decodeUs = 0.0;
+    Tuner::Calibrate(field, scenario.generationSize, 1000 - headerSize,
+                     encodeUs, decodeUs);
+    best.encodeNs = encodeUs * 1e3;
+    best.decodeNs = decodeUs * 1e3 / scenario.generationSize;
+    return best;
+}
+
+// Returns the text as the body of a JSON string: quotes and backslashes are
+// escaped, and so are the control characters
+static std::string JsonEscape(const std::string& text)
+{
+    std::stringstream escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped << '\\' << c;
+        }
+        else if (uint8_t(c) < 0x20)
+        {
+            escaped << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                    << int(c) << std::dec;
+        }
+        else
+        {
+            escaped << c;
+        }
+    }
+    return escaped.str();
+}
+
+static std::string ToJson(const std::string& name, const Result& r)
+{
+    std::stringstream json;
+    json << "{\"scenario\": \"" << JsonEscape(name)
+         << "\", \"ok\": " << (r.ok ? "true" : "false")
+         << ", \"wall_s\": " << r.wallSeconds << ", \"events\": " << r.events
+         << ", \"events_per_s\": " << r.eventsPerSecond
+         << ", \"peak_rss_mb\": " << r.peakRssMb
+         << ", \"encode_ns_per_symbol\": " << r.encodeNs
+         << ", \"decode_ns_per_symbol\": " << r.decodeNs << "}";
+    return json.str();
+}
+
+// Returns the number after "key": in a JSON line written by ToJson
+static double JsonNumber(const std::string& line, const std::string& key)
+{
+    auto position = line.find("\"" + key + "\": ");
+    if (position == std::string::npos)
+    {
+        return 0.0;
+    }
+    return std::stod(line.substr(position + key.size() + 4));
+}
+
+static std::string JsonString(const std::string& line, const std::string& key)
+{
+    auto position = line.find("\"" + key + "\": \"");
+    if (position == std::string::npos)
+    {
+        return "";
+    }
+    position += key.size() + 5;
+    return line.substr(position, line.find('"', position) - position);
+}
+
+// Returns the metrics that are worse than the baseline by more than the
+// tolerance, or an empty string
+static std::string Compare(const Result& r, const std::string& baseline,
+                           double tolerance)
+{
+    std::stringstream regressions;
+
+    // Higher is worse for the costs, lower is worse for the event rate
+    std::map<std::string, double> costs = {
+        {"wall_s", r.wallSeconds},
+        {"peak_rss_mb", r.peakRssMb},
+        {"encode_ns_per_symbol", r.encodeNs},
+        {"decode_ns_per_symbol", r.decodeNs}};
+    for (const auto& cost : costs)
+    {
+        double reference = JsonNumber(baseline, cost.first);
+        if (reference > 0.0 && cost.second > reference * (1.0 + tolerance))
+        {
+            regressions << " " << cost.first << " +"
+                        << std::lround(100.0 * (cost.second / reference - 1))
+                        << "%";
+        }
+    }
+
+    double reference = JsonNumber(baseline, "events_per_s");
+    if (reference > 0.0 && r.eventsPerSecond < reference * (1.0 - tolerance))
+    {
+        regressions << " events_per_s -"
+                    << std::lround(100.0 * (1 - r.eventsPerSecond / reference))
+                    << "%";
+    }
+    return regressions.str();
+}
+
+int main(int argc, char* argv[])
+{
+    std::string prefix = "";    // Path of the examples before their name
+    std::string suffix = "";    // Path of the examples after their name
+    std::string scenarios = ""; // Comma-separated scenarios (all if empty)
+    uint32_t repetitions = 3;   // Runs per scenario, the fastest is kept
+    std::string label = "";     // Label of the run, e.g. the kodo version
+    bool saveBaseline = false;  // Store the run as the new baseline
+    double tolerance = 0.1;     // Relative tolerance of the comparison
+    std::string mpiRanks = "";  // Comma-separated ranks of the MPI runs
+
+    // JSON lines files of all runs and of the baseline
+    std::string history = "kodo-benchmark-history.json";
+    std::string baseline = "kodo-benchmark-baseline.json";
+
+    CommandLine cmd;
+
+    cmd.AddValue("prefix", "Path of the examples before their name", prefix);
+    cmd.AddValue("suffix", "Path of the examples after their name", suffix);
+    cmd.AddValue("scenarios", "Comma-separated scenarios (all if empty)",
+                 scenarios);
+    cmd.AddValue("repetitions", "Runs per scenario", repetitions);
+    cmd.AddValue("label", "Label of the run in the history", label);
+    cmd.AddValue("history", "JSON lines file with the run history", history);
+    cmd.AddValue("baseline", "JSON lines file with the baseline", baseline);
+    cmd.AddValue("saveBaseline", "Store this run as the baseline",
+                 saveBaseline);
+    cmd.AddValue("tolerance", "Relative tolerance of the comparison",
+                 tolerance);
+    cmd.AddValue("mpiRanks", "Comma-separated ranks of kodo-recoders-mpi",
+                 mpiRanks);
+
+    cmd.Parse(argc, argv);
+
+    auto selected = Split(scenarios, ',');
+
+    // Read the baseline, one scenario per line
+    std::map<std::string, std::string> baselines;
+    {
+        std::ifstream stream(baseline);
+        std::string line;
+        while (!saveBaseline && std::getline(stream, line))
+        {
+            baselines[JsonString(line, "scenario")] = line;
+        }
+    }
+
+    if (!saveBaseline && baselines.empty())
+    {
+        std::cout << "No baseline in " << baseline
+                  << ", run with --saveBaseline to store one" << std::endl;
+    }
+
+    std::vector<std::string> lines;
+    uint32_t regressed = 0;
+    uint32_t failed = 0;
+
+    // Wall times of the MPI runs for the speedup
+    std::vector<std::pair<std::string, double>> mpiWallSeconds;
+
+    std::cout << std::left << std::setw(30) << "scenario" << std::right
+              << std::setw(10) << "wall [s]" << std::setw(14) << "events/s"
+              << std::setw(10) << "rss [MB]" << std::setw(10) << "enc [ns]"
+              << std::setw(10) << "dec [ns]"
+              << "  status" << std::endl;
+
+    for (const auto& scenario : Scenarios(Split(mpiRanks, ',')))
+    {
+        if (!selected.empty() &&
+            std::find(selected.begin(), selected.end(), scenario.name) ==
+                selected.end())
+        {
+            continue;
+        }
+
+        Result r = RunScenario(scenario, prefix, suffix, repetitions);
+        lines.push_back(ToJson(scenario.name, r));
+
+        std::string status = r.ok ? "ok" : "FAILED";
+        auto reference = baselines.find(scenario.name);
+        if (r.ok && reference != baselines.end())
+        {
+            std::string regressions =
+                Compare(r, reference->second, tolerance);
+            if (!regressions.empty())
+            {
+                status = "REGRESSION" + regressions;
+            }
+        }
+        regressed += status == "ok" ? 0 : 1;
+        failed += r.ok ? 0 : 1;
+        if (r.ok && scenario.program == "kodo-recoders-mpi")
+        {
+            mpiWallSeconds.emplace_back(scenario.name, r.wallSeconds);
+        }
+
+        std::cout << std::left << std::setw(30) << scenario.name
+                  << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << r.wallSeconds << std::setw(14)
+                  << std::setprecision(0) << r.eventsPerSecond
+                  << std::setw(10) << std::setprecision(1) << r.peakRssMb
+                  << std::setw(10) << r.encodeNs << std::setw(10)
+                  << r.decodeNs << "  " << status << std::endl;
+    }
+
+    for (const auto& run : mpiWallSeconds)
+    {
+        std::cout << "Speedup of " << run.first << ": "
+                  << mpiWallSeconds[0].second / run.second << std::endl;
+    }
+
+    // Append the run to the history as one JSON line
+    std::ofstream historyStream(history, std::ios::app);
+    historyStream << "{\"time\": " << std::time(nullptr) << ", \"label\": \""
+                  << JsonEscape(label) << "\", \"results\": [";
+    for (uint32_t i = 0; i < lines.size(); i++)
+    {
+        historyStream << (i > 0 ? ", " : "") << lines[i];
+    }
+    historyStream << "]}" << std::endl;
+
+    if (failed > 0)
+    {
+        std::cout << failed << " of " << lines.size() << " scenarios failed"
+                  << std::endl;
+    }
+
+    if (saveBaseline)
+    {
+        if (failed > 0)
+        {
+            std::cout << "Not saving a baseline with failed scenarios"
+                      << std::endl;
+            return 1;
+        }
+        std::ofstream baselineStream(baseline);
+        for (const auto& line : lines)
+        {
+            baselineStream << line << std::endl;
+        }
+        std::cout << "Saved the baseline to " << baseline << std::endl;
+        return 0;
+    }
+
+    std::cout << lines.size() - regressed << " of " << lines.size()
+              << " scenarios within " << tolerance * 100 << "% of the baseline"
+              << std::endl;
+    return regressed == 0 ? 0 : 1;
+}
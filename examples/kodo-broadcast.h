@@ -18,22 +18,86 @@
 
 // This class implements RLNC (random linear network coding) in
 // the application layer for a broadcast topology.
+//
+// The source object is split into generations that are sent one after
+// the other: the source moves to the next generation when all receivers
+// have decoded the current one. Every packet starts with the index of its
+// generation and the seed of its coefficients. By default, the object is
+// a single generation. An object set with SetObject (e.g. a MappedFile) is
+// encoded and decoded in place (see kodo-object-generations.h).
+//
+// The default object is filled with pseudo-random data from the RngRun
+// value, and every decoded block is verified against the digest of its
+// generation (see kodo-verifier.h).
+//
+// The receivers reject the non-innovative packets before decoding their
+// payload (see kodo-innovation-filter.h). Binary generations of up to 64
+// symbols are decoded by the fixed-size SmallDecoder (see
+// kodo-small-decoder.h).
+//
+// With a RedundancyController, the source is open-loop: it sends a burst
+// of the size given by the controller for every generation and moves on
+// without waiting for the receivers (see kodo-open-loop.h). The reports
+// of the receivers reach the controller instantly and are never lost. A
+// receiver that misses a generation does not decode the object, and the
+// number of such receivers is printed at the end of the object.
+//
+// With more than one symbol per frame, the source packs several coded
+// symbols of the current generation into one packet (see
+// kodo-frame-packer.h). The coded packets are still counted per symbol in
+// the transmission count and the metrics, so a lost frame counts as count
+// lost packets.
+//
+// The symbol latencies and the completion times are measured from the
+// first transmission of the object, and the rank of a receiver in the
+// metrics counts the symbols decoded over all generations. The generation
+// latencies are measured from the first transmission of their generation.
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <string>
 #include <vector>
 
-#include <endian/big_endian.hpp>
 #include <kodo/block/decoder.hpp>
 #include <kodo/block/encoder.hpp>
 #include <kodo/block/generator/random_uniform.hpp>
 #include <kodo/finite_field.hpp>
 
+#include "kodo-batch-encoder.h"
+#include "kodo-coding-metrics.h"
+#include "kodo-decoder-pool.h"
+#include "kodo-frame-packer.h"
+#include "kodo-latency-histogram.h"
+#include "kodo-object-generations.h"
+#include "kodo-open-loop.h"
+#include "kodo-profiler.h"
+#include "kodo-verifier.h"
+
 class Broadcast
 {
 public:
+    // Called for every symbol as soon as it and all symbols before it
+    // have been decoded at a receiver, with the time since the first
+    // transmission of the object. The symbol is only valid during the call.
+    using DeliveryCallback =
+        std::function<void(uint32_t decoder, uint32_t index,
+                           const uint8_t* symbol, ns3::Time latency)>;
+
+    // Called with the decoded block when a receiver completes, before its
+    // decoder returns to the pool
+    using CompletionCallback = std::function<void(
+        uint32_t decoder, const uint8_t* block, uint32_t size)>;
+
+    // Replaces the source socket, e.g. to send on an ErasureChannel
+    using SendCallback = std::function<void(ns3::Ptr<ns3::Packet> packet)>;
+
+    using GenerationCallback = ObjectGenerations::GenerationCallback;
+
     Broadcast(const kodo::finite_field field, const uint32_t users,
               const uint32_t generationSize, const uint32_t packetSize,
               const ns3::Ptr<ns3::Socket>& source,
@@ -41,44 +105,261 @@ public:
         m_field(field),
         m_users(users), m_generationSize(generationSize),
         m_packetSize(packetSize), m_source(source), m_sinks(sinks),
-        m_encoder(field), m_generator(field)
+        m_encoder(field),
+        m_object(uint64_t(generationSize) * (packetSize - 2 * sizeof(uint32_t)),
+                 users),
+        m_decoderPool(field, generationSize,
+                      packetSize - 2 * sizeof(uint32_t)),
+        m_openLoop(users), m_generator(field), m_metrics(generationSize),
+        m_profiler("Broadcast"),
+        m_packer(packetSize - 2 * sizeof(uint32_t), m_profiler),
+        m_batchEncoder(m_encoder, field, BatchEncoder::Header::seed,
+                       packetSize, m_profiler),
+        m_filter(field, generationSize)
     {
-        auto seed_size = sizeof(uint32_t);
-        auto symbol_bytes = m_packetSize - seed_size;
+        // The header holds the generation index and the coefficient seed
+        auto header_size = 2 * sizeof(uint32_t);
+        auto symbol_bytes = m_packetSize - header_size;
         m_encoder.configure(m_generationSize, symbol_bytes);
         m_generator.configure(m_generationSize);
 
         // Initialize the encoder data buffer
         m_encoderBuffer.resize(m_encoder.block_bytes());
-        m_encoder.set_symbols_storage(m_encoderBuffer.data());
-        m_payload.resize(m_packetSize);
         m_coefficients.resize(m_generator.max_coefficients_bytes());
 
-        // Create decoders
-        m_decoderBuffers.resize(m_users);
+        // The decoders are acquired from the pool on the first packet of
+        // each receiver and released when the receiver has decoded
+        m_decoders.resize(m_users);
+        m_completed.resize(m_users, false);
+        m_decoderPool.SetInnovationFilter(&m_filter);
+        m_objectRank.resize(m_users, 0);
+
+        // Initialize the in-order delivery state and latency statistics
+        m_nextSymbol.resize(m_users, 0);
+        m_symbolLatency.resize(m_users);
+        m_generationLatency.resize(m_users);
 
+        // The default object is the pseudo-random encoder buffer
+        FillPseudoRandom(m_encoderBuffer.data(), m_encoderBuffer.size(),
+                         ns3::RngSeedManager::GetRun());
+        SetObject(m_encoderBuffer.data(), m_encoderBuffer.size());
+
+        // Register the decoders and their links with the metrics
         for (uint32_t n = 0; n < m_users; n++)
         {
-            m_decoders.emplace_back(m_field);
-            auto& decoder = m_decoders.back();
-            decoder.configure(m_generationSize, symbol_bytes);
-
-            // Create data buffer for the decoder
-            m_decoderBuffers[n].resize(decoder.block_bytes());
-            decoder.set_symbols_storage(m_decoderBuffers[n].data());
+            std::string decoder = "decoder-" + std::to_string(n + 1);
+            m_metrics.AddReceiver(decoder);
+            m_metrics.AddLink("source-" + decoder, true);
         }
 
         // Initialize transmission count
         m_transmissionCount = 0;
+
+        // The coefficient seeds are drawn from an ns-3 random stream, so a
+        // run is reproducible from the RngSeed and RngRun values
+        m_seedVariable = ns3::CreateObject<ns3::UniformRandomVariable>();
+        m_batchEncoder.SetSeedSource([this]() {
+            return m_seedVariable->GetInteger(
+                0, std::numeric_limits<int32_t>::max());
+        });
+        m_batchEncoder.SetPrefixSize(sizeof(uint32_t));
+        m_batchEncoder.SetBatchSize(1);
     }
 
-    void SendPacket(ns3::Ptr<ns3::Socket> socket, ns3::Time pktInterval)
+    // Assigns a fixed stream to the random variable of this helper and
+    // returns the number of streams used
+    int64_t AssignStreams(int64_t stream)
     {
-        bool allDecoded = true;
+        m_seedVariable->SetStream(stream);
+        return 1;
+    }
+
+    // Sets the object to send. The data must stay valid while sending.
+    void SetObject(const uint8_t* data, uint64_t size)
+    {
+        m_object.SetObject(data, size);
+        m_metrics.SetSymbols(m_object.GetGenerationCount() * m_generationSize);
+        StartGeneration(0);
+    }
+
+    // Sets the memory of the object size that decoder n decodes into
+    void SetOutput(uint32_t n, uint8_t* data)
+    {
+        m_object.SetOutput(n, data);
+    }
+
+    void SetGenerationCallback(const GenerationCallback& callback)
+    {
+        m_object.SetGenerationCallback(callback);
+    }
+
+    uint32_t GetGenerationCount() const
+    {
+        return m_object.GetGenerationCount();
+    }
+
+    uint64_t GetObjectSize() const
+    {
+        return m_object.GetObjectSize();
+    }
+
+    // Sets the number of packets encoded ahead of the send events
+    void SetBatchSize(uint32_t batchSize)
+    {
+        m_batchEncoder.SetBatchSize(batchSize);
+    }
+
+    // Sets the number of coded symbols packed into every frame
+    void SetSymbolsPerFrame(uint32_t symbols)
+    {
+        m_packer.SetSymbolsPerFrame(symbols);
+    }
+
+    uint32_t GetSymbolsPerFrame() const
+    {
+        return m_packer.GetSymbolsPerFrame();
+    }
+
+    // Returns the payload bytes of a frame with the given number of symbols
+    uint32_t GetFrameSize(uint32_t symbols) const
+    {
+        return m_packer.GetFrameSize(symbols);
+    }
+
+    // Enables or disables the small decoder for small binary generations.
+    // Must be called before the first packet is received.
+    void SetSmallDecoders(bool enabled)
+    {
+        m_decoderPool.SetSmallDecoders(enabled);
+    }
 
+    // Enables or disables the rejection of non-innovative packets before
+    // decoding
+    void SetInnovationFilter(bool enabled)
+    {
+        m_filter.SetEnabled(enabled);
+    }
+
+    const InnovationFilter& GetInnovationFilter() const
+    {
+        return m_filter;
+    }
+
+    // Makes the source open-loop with the burst sizes of the controller
+    void SetRedundancyController(RedundancyController* controller)
+    {
+        m_openLoop.SetController(controller);
+    }
+
+    void SetDeliveryCallback(const DeliveryCallback& callback)
+    {
+        m_deliveryCallback = callback;
+    }
+
+    void SetCompletionCallback(const CompletionCallback& callback)
+    {
+        m_completionCallback = callback;
+    }
+
+    void SetSendCallback(const SendCallback& callback)
+    {
+        m_sendCallback = callback;
+    }
+
+    void SetLatencyBinWidth(ns3::Time binWidth)
+    {
         for (uint32_t n = 0; n < m_users; n++)
         {
-            allDecoded = allDecoded && m_decoders[n].is_complete();
+            m_symbolLatency[n].SetBinWidth(binWidth);
+            m_generationLatency[n].SetBinWidth(binWidth);
+        }
+    }
+
+    const Verifier& GetVerifier() const
+    {
+        return m_verifier;
+    }
+
+    const DecoderPool& GetDecoderPool() const
+    {
+        return m_decoderPool;
+    }
+
+    const CodingMetrics& GetMetrics() const
+    {
+        return m_metrics;
+    }
+
+    Profiler& GetProfiler()
+    {
+        return m_profiler;
+    }
+
+    uint32_t GetTransmissionCount() const
+    {
+        return m_transmissionCount;
+    }
+
+    uint32_t GetFrameCount() const
+    {
+        return m_packer.GetFrameCount();
+    }
+
+    // Time from the first transmission until the last receiver decoded its
+    // last generation, or zero if no receiver decoded in this trial
+    ns3::Time GetCompletionTime() const
+    {
+        if (m_lastCompletion < m_objectStart)
+        {
+            return ns3::Seconds(0);
+        }
+        return m_lastCompletion - m_objectStart;
+    }
+
+    // Resets the coding state to run another trial on the same topology.
+    // The metrics, the latency histograms, the verifier and the filter
+    // statistics keep accumulating over all trials.
+    void Reset()
+    {
+        StartGeneration(0);
+        m_batchEncoder.Clear();
+        m_metrics.StartTrial();
+        m_packer.Reset();
+        m_transmissionCount = 0;
+        m_objectStart = ns3::Seconds(0);
+        m_lastCompletion = ns3::Seconds(0);
+    }
+
+    // Prints the statistics that are collected over all trials, once after
+    // the last trial
+    void PrintSummary(std::ostream& out) const
+    {
+        out << "Peak active decoders: " << m_decoderPool.GetPeakActive()
+            << " of " << m_users << " (" << m_decoderPool.GetStorageBytes()
+            << " bytes of decoder storage)" << std::endl;
+        m_verifier.Print(out);
+        m_filter.Print(out);
+        m_openLoop.Print(out);
+        for (uint32_t n = 0; n < m_users; n++)
+        {
+            std::string decoder = "Decoder " + std::to_string(n + 1);
+            m_symbolLatency[n].Print(out, decoder + " symbol latency");
+            m_generationLatency[n].Print(out,
+                                         decoder + " generation latency");
+        }
+    }
+
+    void SendPacket(ns3::Ptr<ns3::Socket> socket, ns3::Time pktInterval)
+    {
+        bool allDecoded = IsGenerationDone();
+
+        if (allDecoded &&
+            m_object.GetGeneration() + 1 < m_object.GetGenerationCount())
+        {
+            EndGeneration();
+            StartGeneration(m_object.GetGeneration() + 1);
+            m_generationStart = ns3::Simulator::Now();
+            allDecoded = false;
         }
 
         if (!allDecoded)
@@ -87,25 +368,60 @@ public:
             std::cout << "Sending coded packet: " << m_transmissionCount
                       << std::endl;
             std::cout << "------------------------" << std::endl;
-            uint32_t seed = rand();
-            m_generator.set_seed(seed);
-            m_generator.generate(m_coefficients.data());
-            endian::big_endian::put(m_transmissionCount, m_payload.data());
-            m_encoder.encode_symbol(m_payload.data() + sizeof(uint32_t),
-                                    m_coefficients.data());
-            auto packet =
-                ns3::Create<ns3::Packet>(m_payload.data(), m_payload.size());
-            socket->Send(packet);
-            m_transmissionCount++;
+            if (m_transmissionCount == 0)
+            {
+                m_objectStart = ns3::Simulator::Now();
+                m_generationStart = m_objectStart;
+            }
+
+            uint32_t count =
+                m_openLoop.GetFrameSymbols(m_packer.GetSymbolsPerFrame());
+            auto packet = m_packer.Pack(m_object.GetGeneration(), count,
+                                        [this]() {
+                                            return m_batchEncoder.Next();
+                                        });
+            m_transmissionCount += count;
+            m_openLoop.Transmit(count);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                m_metrics.Transmit();
+            }
+            {
+                KODO_NS3_PROFILE(m_profiler, packet);
+                if (m_sendCallback)
+                {
+                    m_sendCallback(packet);
+                }
+                else
+                {
+                    socket->Send(packet);
+                }
+            }
 
             ns3::Simulator::Schedule(pktInterval, &Broadcast::SendPacket, this,
                                      socket, pktInterval);
         }
         else
         {
-            std::cout << "Decoding completed! Total transmissions: "
-                      << m_transmissionCount << std::endl;
-            socket->Close();
+            EndGeneration();
+
+            // Only the open-loop source ends before all receivers decoded
+            uint32_t symbols = m_object.GetGenerationCount() * m_generationSize;
+            uint32_t failed = std::count_if(
+                m_objectRank.begin(), m_objectRank.end(),
+                [symbols](uint32_t rank) { return rank < symbols; });
+            if (failed == 0)
+            {
+                std::cout << "Decoding completed! Total transmissions: "
+                          << m_transmissionCount << std::endl;
+            }
+            else
+            {
+                std::cout << "Decoding failed at " << failed << " of "
+                          << m_users << " receivers! Total transmissions: "
+                          << m_transmissionCount << std::endl;
+            }
+            m_packer.Print(std::cout);
         }
     }
 
@@ -115,20 +431,172 @@ public:
         auto it = std::find(m_sinks.begin(), m_sinks.end(), socket);
         auto n = std::distance(m_sinks.begin(), it);
 
+        Receive(n, socket->Recv());
+    }
+
+    // Passes a packet received by decoder n to the decoder. This is also the
+    // entry point for channels without sockets.
+    void Receive(uint32_t n, ns3::Ptr<ns3::Packet> packet)
+    {
         std::cout << "Received a packet at Decoder " << n + 1 << std::endl;
 
-        // Pass the packet payload to the appropriate decoder
-        auto packet = socket->Recv();
-        std::vector<uint8_t> payload(packet->GetSize());
-        packet->CopyData(m_payload.data(), m_payload.size());
-        uint32_t seed = endian::big_endian::get<uint32_t>(m_payload.data());
-        m_generator.set_seed(seed);
-        m_generator.generate(m_coefficients.data());
-        m_decoders[n].decode_symbol(m_payload.data() + sizeof(uint32_t),
-                                    m_coefficients.data());
+        m_packer.Unpack(packet, [this, n](uint32_t generation, uint32_t seed,
+                                          uint8_t* symbol) {
+            ReceiveSymbol(n, generation, seed, symbol);
+        });
     }
 
 private:
+    // Passes one coded symbol received by decoder n to the decoder
+    void ReceiveSymbol(uint32_t n, uint32_t generation, uint32_t seed,
+                       uint8_t* symbol)
+    {
+        m_metrics.Deliver(n);
+
+        // Symbols that arrive after completion or belong to a previous
+        // generation are not innovative
+        bool current = generation == m_object.GetGeneration();
+        if (current)
+        {
+            m_openLoop.Receive(n);
+        }
+        if (m_completed[n] || !current)
+        {
+            m_metrics.Receive(n, m_objectRank[n], m_objectRank[n]);
+            return;
+        }
+        if (!m_decoders[n])
+        {
+            m_decoders[n] = m_decoderPool.Acquire();
+            uint8_t* output = m_object.GetOutput(n);
+            if (output != nullptr)
+            {
+                m_decoders[n]->decoder.set_symbols_storage(output);
+            }
+        }
+
+        auto& decoder = m_decoders[n]->decoder;
+        {
+            KODO_NS3_PROFILE(m_profiler, coefficients);
+            m_generator.set_seed(seed);
+            m_generator.generate(m_coefficients.data());
+        }
+        uint32_t rank = decoder.rank();
+        bool innovative;
+        {
+            KODO_NS3_PROFILE(m_profiler, filter);
+            innovative = m_filter.Check(*m_decoders[n]->space,
+                                        m_coefficients.data(),
+                                        decoder.symbol_bytes());
+        }
+        if (innovative)
+        {
+            KODO_NS3_PROFILE(m_profiler, decode);
+            decoder.decode_symbol(symbol,
+                                  m_coefficients.data());
+            m_filter.Confirm(*m_decoders[n]->space, decoder.rank());
+        }
+        uint32_t objectRank = m_objectRank[n];
+        m_objectRank[n] += decoder.rank() - rank;
+        m_metrics.Receive(n, objectRank, m_objectRank[n]);
+
+        DeliverSymbols(n);
+
+        if (decoder.is_complete())
+        {
+            m_completed[n] = true;
+            m_lastCompletion = ns3::Simulator::Now();
+
+            m_object.Complete(n, m_decoders[n]->storage.data());
+            if (!m_verifier.Verify(Block(n), m_object.GetSize(), m_digest))
+            {
+                std::cerr << "Decoder " << n + 1 << " decoded generation "
+                          << m_object.GetGeneration() << " with wrong data"
+                          << std::endl;
+            }
+            if (m_completionCallback)
+            {
+                m_completionCallback(n, Block(n), m_object.GetSize());
+            }
+            m_decoderPool.Release(std::move(m_decoders[n]));
+        }
+    }
+
+    // The open-loop source ends a generation after its burst, the
+    // closed-loop source when all receivers have decoded it
+    bool IsGenerationDone() const
+    {
+        if (m_openLoop.IsEnabled())
+        {
+            return m_openLoop.IsBurstDone();
+        }
+        return std::all_of(m_completed.begin(), m_completed.end(),
+                           [](bool completed) { return completed; });
+    }
+
+    // Returns the block that decoder n decodes into
+    const uint8_t* Block(uint32_t n) const
+    {
+        return m_object.GetBlock(n, m_decoders[n]->storage.data());
+    }
+
+    // Points the encoder to a generation of the object and resets the
+    // receivers
+    void StartGeneration(uint32_t generation)
+    {
+        m_encoder.set_symbols_storage(m_object.Start(generation));
+        m_digest = m_verifier.Digest(m_object.GetData(), m_object.GetSize());
+        m_batchEncoder.Rewind();
+
+        for (uint32_t n = 0; n < m_users; n++)
+        {
+            if (m_decoders[n])
+            {
+                m_decoderPool.Release(std::move(m_decoders[n]));
+            }
+            m_completed[n] = false;
+            m_nextSymbol[n] = 0;
+            if (generation == 0)
+            {
+                m_objectRank[n] = 0;
+            }
+        }
+        m_openLoop.StartGeneration();
+    }
+
+    void EndGeneration()
+    {
+        m_openLoop.EndGeneration(m_completed);
+        m_object.End();
+    }
+
+    void DeliverSymbols(uint32_t n)
+    {
+        auto& decoder = m_decoders[n]->decoder;
+        auto latency = ns3::Simulator::Now() - m_objectStart;
+
+        // Deliver the longest decoded prefix of the generation
+        while (m_nextSymbol[n] < m_generationSize &&
+               decoder.is_symbol_decoded(m_nextSymbol[n]))
+        {
+            uint32_t index = m_nextSymbol[n]++;
+            m_symbolLatency[n].Add(latency);
+
+            if (m_deliveryCallback)
+            {
+                m_deliveryCallback(
+                    n, index, Block(n) + index * decoder.symbol_bytes(),
+                    latency);
+            }
+
+            if (m_nextSymbol[n] == m_generationSize)
+            {
+                m_generationLatency[n].Add(ns3::Simulator::Now() -
+                                           m_generationStart);
+            }
+        }
+    }
+
     const kodo::finite_field m_field;
     const uint32_t m_users;
     const uint32_t m_generationSize;
@@ -138,13 +606,39 @@ private:
     std::vector<ns3::Ptr<ns3::Socket>> m_sinks;
     kodo::block::encoder m_encoder;
     std::vector<uint8_t> m_encoderBuffer;
-    std::vector<kodo::block::decoder> m_decoders;
-    std::vector<std::vector<uint8_t>> m_decoderBuffers;
 
-    std::vector<uint8_t> m_payload;
+    // The object and the generation being sent
+    ObjectGenerations m_object;
+    uint64_t m_digest;
+    Verifier m_verifier;
+
+    DecoderPool m_decoderPool;
+    std::vector<std::unique_ptr<DecoderPool::Decoder>> m_decoders;
+    std::vector<bool> m_completed;
+    OpenLoopSource m_openLoop;
+
+    // Symbols decoded by every receiver over all generations
+    std::vector<uint32_t> m_objectRank;
 
     kodo::block::generator::random_uniform m_generator;
     std::vector<uint8_t> m_coefficients;
 
     uint32_t m_transmissionCount;
+    ns3::Ptr<ns3::UniformRandomVariable> m_seedVariable;
+    ns3::Time m_generationStart;
+    ns3::Time m_objectStart;
+    ns3::Time m_lastCompletion;
+
+    std::vector<uint32_t> m_nextSymbol;
+    std::vector<LatencyHistogram> m_symbolLatency;
+    std::vector<LatencyHistogram> m_generationLatency;
+    DeliveryCallback m_deliveryCallback;
+    CompletionCallback m_completionCallback;
+    SendCallback m_sendCallback;
+
+    CodingMetrics m_metrics;
+    Profiler m_profiler;
+    FramePacker m_packer;
+    BatchEncoder m_batchEncoder;
+    InnovationFilter m_filter;
 };
@@ -0,0 +1,306 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class collects network and coding metrics for the coding helpers.
+// Events only update plain counters; everything derived from them (loss
+// rates, overhead, ...) is computed when the metrics are written at the end
+// of the run. The results can be written as CSV files or exported through
+// the ns-3 stats framework (DataCollector and DataOutputInterface).
+//
+// When several trials run on the same topology, the counters accumulate
+// over all trials, the rank samples are tagged with their trial and the
+// completion time of a receiver is the mean over the trials in which it
+// decoded. The times are relative to the start of their trial.
+//
+// A receiver completes when its rank reaches the number of source symbols,
+// which is the generation size unless the helper sends an object of
+// several generations and passes the rank over the whole object.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <ns3/stats-module.h>
+
+class CodingMetrics
+{
+public:
+    CodingMetrics(const uint32_t generationSize) :
+        m_generationSize(generationSize), m_symbols(generationSize),
+        m_transmissions(0), m_trials(1)
+    {
+    }
+
+    // Sets the number of source symbols that a receiver decodes in a trial
+    void SetSymbols(uint32_t symbols)
+    {
+        m_symbols = symbols;
+    }
+
+    uint32_t AddReceiver(const std::string& name)
+    {
+        m_receivers.emplace_back();
+        m_receivers.back().name = name;
+        return m_receivers.size() - 1;
+    }
+
+    // Broadcast links are offered every transmission counted by Transmit(),
+    // all other links must be offered their packets explicitly
+    uint32_t AddLink(const std::string& name, const bool broadcast)
+    {
+        m_links.emplace_back();
+        m_links.back().name = name;
+        m_links.back().broadcast = broadcast;
+        return m_links.size() - 1;
+    }
+
+    void Transmit()
+    {
+        m_transmissions++;
+    }
+
+    void Offer(uint32_t link)
+    {
+        m_links[link].offered++;
+    }
+
+    void Deliver(uint32_t link)
+    {
+        m_links[link].delivered++;
+    }
+
+    void Receive(uint32_t receiver, uint32_t rankBefore, uint32_t rankAfter)
+    {
+        auto& r = m_receivers[receiver];
+        r.received++;
+
+        if (rankAfter > rankBefore)
+        {
+            ns3::Time now = ns3::Simulator::Now() - m_trialStart;
+            r.innovative++;
+            r.rank.push_back({m_trials, now, rankAfter});
+
+            if (rankAfter == m_symbols)
+            {
+                r.completion = now;
+                r.completed = true;
+            }
+        }
+    }
+
+    // Starts another trial on the same topology. The counters keep
+    // accumulating, the completion of the previous trial is added to the
+    // mean completion time.
+    void StartTrial()
+    {
+        for (auto& r : m_receivers)
+        {
+            EndTrial(r);
+        }
+        m_trials++;
+        m_trialStart = ns3::Simulator::Now();
+    }
+
+    // Writes <prefix>-receivers.csv, <prefix>-links.csv and <prefix>-rank.csv
+    void WriteCsv(const std::string& prefix) const
+    {
+        std::ofstream receivers(prefix + "-receivers.csv");
+        receivers << "receiver,received,innovative,non_innovative,"
+                     "redundancy_overhead,completed_trials,completion_time"
+                  << std::endl;
+        for (const auto& r : m_receivers)
+        {
+            receivers << r.name << "," << r.received << "," << r.innovative
+                      << "," << r.received - r.innovative << ","
+                      << Overhead(r) << "," << CompletedTrials(r) << ","
+                      << CompletionTime(r) << std::endl;
+        }
+
+        std::ofstream links(prefix + "-links.csv");
+        links << "link,offered,delivered,observed_loss" << std::endl;
+        for (const auto& l : m_links)
+        {
+            links << l.name << "," << Offered(l) << "," << l.delivered << ","
+                  << ObservedLoss(l) << std::endl;
+        }
+
+        std::ofstream rank(prefix + "-rank.csv");
+        rank << "receiver,trial,time,rank" << std::endl;
+        for (const auto& r : m_receivers)
+        {
+            for (const auto& sample : r.rank)
+            {
+                rank << r.name << "," << sample.trial << ","
+                     << sample.time.GetSeconds() << "," << sample.rank
+                     << std::endl;
+            }
+        }
+    }
+
+    // Adds one calculator per metric and receiver/link to the collector.
+    // Calculators use the receiver or link name as their context.
+    void Export(ns3::DataCollector& collector) const
+    {
+        collector.AddMetadata("transmissions", m_transmissions);
+        collector.AddMetadata("generationSize", m_generationSize);
+        collector.AddMetadata("symbols", m_symbols);
+        collector.AddMetadata("trials", m_trials);
+
+        for (const auto& r : m_receivers)
+        {
+            Add(collector, r.name, "received", r.received);
+            Add(collector, r.name, "innovative", r.innovative);
+            Add(collector, r.name, "non-innovative",
+                r.received - r.innovative);
+            Add(collector, r.name, "redundancy-overhead", Overhead(r));
+            Add(collector, r.name, "completed-trials", CompletedTrials(r));
+            Add(collector, r.name, "completion-time", CompletionTime(r));
+        }
+
+        for (const auto& l : m_links)
+        {
+            Add(collector, l.name, "offered", Offered(l));
+            Add(collector, l.name, "delivered", l.delivered);
+            Add(collector, l.name, "observed-loss", ObservedLoss(l));
+        }
+    }
+
+    // Writes the metrics with the given format ("csv" or "omnet")
+    void Write(const std::string& prefix, const std::string& format,
+               const std::string& experiment) const
+    {
+        if (format == "omnet")
+        {
+            ns3::DataCollector collector;
+            collector.DescribeRun(experiment, "rlnc", "", prefix);
+            Export(collector);
+
+            ns3::Ptr<ns3::DataOutputInterface> output =
+                ns3::CreateObject<ns3::OmnetDataOutput>();
+            output->SetFilePrefix(prefix);
+            output->Output(collector);
+        }
+        else
+        {
+            WriteCsv(prefix);
+        }
+    }
+
+private:
+    struct RankSample
+    {
+        uint32_t trial;
+        ns3::Time time;
+        uint32_t rank;
+    };
+
+    struct Receiver
+    {
+        std::string name;
+        uint32_t received = 0;
+        uint32_t innovative = 0;
+        std::vector<RankSample> rank;
+
+        // The completion of the current trial and the sum over the
+        // completed earlier trials
+        ns3::Time completion;
+        bool completed = false;
+        uint32_t completedTrials = 0;
+        double completionSum = 0.0;
+    };
+
+    struct Link
+    {
+        std::string name;
+        bool broadcast = false;
+        uint32_t offered = 0;
+        uint32_t delivered = 0;
+    };
+
+    uint32_t Offered(const Link& l) const
+    {
+        return l.broadcast ? m_transmissions : l.offered;
+    }
+
+    double ObservedLoss(const Link& l) const
+    {
+        uint32_t offered = Offered(l);
+        return offered == 0 ? 0.0 : 1.0 - double(l.delivered) / offered;
+    }
+
+    static void EndTrial(Receiver& r)
+    {
+        if (r.completed)
+        {
+            r.completedTrials++;
+            r.completionSum += r.completion.GetSeconds();
+            r.completed = false;
+        }
+    }
+
+    // Relative to the innovative packets, which span several generations
+    // when an object is sent
+    double Overhead(const Receiver& r) const
+    {
+        return double(r.received) /
+                   std::max<uint32_t>(r.innovative, m_symbols * m_trials) -
+               1.0;
+    }
+
+    uint32_t CompletedTrials(const Receiver& r) const
+    {
+        return r.completedTrials + (r.completed ? 1 : 0);
+    }
+
+    // Mean over the trials in which the receiver decoded, -1 if it never did
+    double CompletionTime(const Receiver& r) const
+    {
+        uint32_t trials = CompletedTrials(r);
+        if (trials == 0)
+        {
+            return -1.0;
+        }
+        double sum = r.completionSum +
+                     (r.completed ? r.completion.GetSeconds() : 0.0);
+        return sum / trials;
+    }
+
+    static void Add(ns3::DataCollector& collector, const std::string& context,
+                    const std::string& key, double value)
+    {
+        auto calculator =
+            ns3::CreateObject<ns3::MinMaxAvgTotalCalculator<double>>();
+        calculator->SetContext(context);
+        calculator->SetKey(key);
+        calculator->Update(value);
+        collector.AddDataCalculator(calculator);
+    }
+
+    const uint32_t m_generationSize;
+    uint32_t m_symbols;
+    uint32_t m_transmissions;
+    uint32_t m_trials;
+    ns3::Time m_trialStart;
+    std::vector<Receiver> m_receivers;
+    std::vector<Link> m_links;
+};
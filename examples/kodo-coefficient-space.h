@@ -0,0 +1,231 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Coefficient-only linear algebra over the finite fields used by kodo.
+//
+// FiniteField implements GF(2^m) for m = 1, 4, 8 and 16 with log/exp tables
+// using the same primitive polynomials as kodo. CoefficientSpace keeps the
+// span of the coding vectors that a node has received in reduced row
+// echelon form, without any payload, so it can tell whether a coding vector
+// is innovative and draw random vectors from the span (recoding).
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include <kodo/finite_field.hpp>
+
+class FiniteField
+{
+public:
+    FiniteField(const kodo::finite_field field)
+    {
+        switch (field)
+        {
+        case kodo::finite_field::binary:
+            Initialize(1, 0x3);
+            break;
+        case kodo::finite_field::binary4:
+            Initialize(4, 0x13);
+            break;
+        case kodo::finite_field::binary8:
+            Initialize(8, 0x11D);
+            break;
+        case kodo::finite_field::binary16:
+            Initialize(16, 0x1100B);
+            break;
+        }
+    }
+
+    uint32_t Size() const
+    {
+        return m_size;
+    }
+
+    uint32_t Multiply(uint32_t a, uint32_t b) const
+    {
+        if (a == 0 || b == 0)
+        {
+            return 0;
+        }
+        return m_exp[m_log[a] + m_log[b]];
+    }
+
+    uint32_t Invert(uint32_t a) const
+    {
+        assert(a != 0);
+        return m_exp[(m_size - 1) - m_log[a]];
+    }
+
+private:
+    void Initialize(uint32_t degree, uint32_t polynomial)
+    {
+        m_size = 1U << degree;
+        m_log.resize(m_size, 0);
+        m_exp.resize(2 * m_size, 0);
+
+        uint32_t value = 1;
+        for (uint32_t i = 0; i < m_size - 1; i++)
+        {
+            m_exp[i] = value;
+            m_log[value] = i;
+            value <<= 1;
+            if (value & m_size)
+            {
+                value ^= polynomial;
+            }
+        }
+
+        // Duplicate the table to avoid the modulo in Multiply
+        for (uint32_t i = m_size - 1; i < 2 * m_size; i++)
+        {
+            m_exp[i] = m_exp[i - (m_size - 1)];
+        }
+    }
+
+private:
+    uint32_t m_size;
+    std::vector<uint32_t> m_log;
+    std::vector<uint32_t> m_exp;
+};
+
+class CoefficientSpace
+{
+public:
+    CoefficientSpace(const FiniteField& field, const uint32_t symbols) :
+        m_field(field), m_symbols(symbols), m_rows(symbols),
+        m_pivot(symbols, false), m_rank(0), m_scratch(symbols)
+    {
+    }
+
+    uint32_t Rank() const
+    {
+        return m_rank;
+    }
+
+    bool IsComplete() const
+    {
+        return m_rank == m_symbols;
+    }
+
+    void Reset()
+    {
+        m_pivot.assign(m_symbols, false);
+        m_rank = 0;
+    }
+
+    // Returns true if the vector is not in the span of the received vectors
+    bool IsInnovative(const std::vector<uint32_t>& vector) const
+    {
+        m_scratch = vector;
+        return Reduce(m_scratch) < m_symbols;
+    }
+
+    // Adds the vector to the space and returns true if it was innovative.
+    // The vector is reduced in a scratch row, so no row is allocated per
+    // call.
+    bool Insert(const std::vector<uint32_t>& vector)
+    {
+        m_scratch = vector;
+        uint32_t pivot = Reduce(m_scratch);
+        if (pivot == m_symbols)
+        {
+            return false;
+        }
+
+        // Normalize the new row and eliminate its pivot from the others
+        uint32_t inverse = m_field.Invert(m_scratch[pivot]);
+        for (auto& v : m_scratch)
+        {
+            v = m_field.Multiply(v, inverse);
+        }
+        for (uint32_t i = 0; i < m_symbols; i++)
+        {
+            if (m_pivot[i] && m_rows[i][pivot] != 0)
+            {
+                AddScaled(m_rows[i], m_scratch, m_rows[i][pivot]);
+            }
+        }
+
+        m_rows[pivot].swap(m_scratch);
+        m_scratch.resize(m_symbols);
+        m_pivot[pivot] = true;
+        m_rank++;
+        return true;
+    }
+
+    // Combines the basis of the space with the given coefficients, which
+    // gives a uniformly distributed vector of the span for uniform input
+    template <class Random>
+    std::vector<uint32_t> Recode(Random& random) const
+    {
+        std::vector<uint32_t> vector(m_symbols, 0);
+        for (uint32_t i = 0; i < m_symbols; i++)
+        {
+            if (m_pivot[i])
+            {
+                AddScaled(vector, m_rows[i], random() % m_field.Size());
+            }
+        }
+        return vector;
+    }
+
+private:
+    // Reduces the vector against the basis and returns the index of its
+    // first non-zero coefficient (m_symbols if the vector became zero)
+    uint32_t Reduce(std::vector<uint32_t>& vector) const
+    {
+        for (uint32_t i = 0; i < m_symbols; i++)
+        {
+            if (m_pivot[i] && vector[i] != 0)
+            {
+                AddScaled(vector, m_rows[i], vector[i]);
+            }
+        }
+        for (uint32_t i = 0; i < m_symbols; i++)
+        {
+            if (vector[i] != 0)
+            {
+                return i;
+            }
+        }
+        return m_symbols;
+    }
+
+    // In GF(2^m) addition and subtraction are both XOR
+    void AddScaled(std::vector<uint32_t>& target,
+                   const std::vector<uint32_t>& row, uint32_t factor) const
+    {
+        for (uint32_t i = 0; i < m_symbols; i++)
+        {
+            target[i] ^= m_field.Multiply(row[i], factor);
+        }
+    }
+
+private:
+    const FiniteField& m_field;
+    const uint32_t m_symbols;
+    std::vector<std::vector<uint32_t>> m_rows;
+    std::vector<bool> m_pivot;
+    uint32_t m_rank;
+
+    // The vector being reduced, also by the const IsInnovative
+    mutable std::vector<uint32_t> m_scratch;
+};
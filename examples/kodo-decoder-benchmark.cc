@@ -0,0 +1,160 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program measures the decoding time per coded symbol of the small
+// decoder (see kodo-small-decoder.h) and of the kodo decoder for small
+// binary generations without running an ns-3 simulation.
+//
+// For every generation size, a pool of coded packets is encoded once, and
+// both decoders decode the same packets from the pool, one generation
+// after the other, until the given number of packets is decoded. The
+// decoding time per coded symbol of both decoders and the speedup of the
+// small decoder are printed:
+//
+// python waf --run kodo-decoder-benchmark --command-template="%s
+// --generationSizes=3,5,16,64 --packetSize=1400"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <ns3/core-module.h>
+
+#include "kodo-small-decoder.h"
+#include <kodo/block/encoder.hpp>
+#include <kodo/block/generator/random_uniform.hpp>
+#include <kodo/finite_field.hpp>
+
+using namespace ns3;
+
+int main(int argc, char* argv[])
+{
+    std::string generationSizes = "3,5,8,16,32,64"; // Comma-separated list
+    uint32_t packetSize = 1000; // Bytes per coded packet
+    uint32_t packets = 200000;  // Packets decoded per decoder
+
+    CommandLine cmd;
+
+    cmd.AddValue("generationSizes", "Comma-separated generation sizes",
+                 generationSizes);
+    cmd.AddValue("packetSize", "Size of the coded packets", packetSize);
+    cmd.AddValue("packets", "Packets decoded per decoder", packets);
+
+    cmd.Parse(argc, argv);
+
+    auto field = kodo::finite_field::binary;
+
+    std::cout << "Decoding " << packets << " packets of " << packetSize
+              << " bytes, field binary" << std::endl;
+    std::cout << "generation_size,kodo_ns_symbol,small_ns_symbol,speedup"
+              << std::endl;
+
+    std::stringstream sizes(generationSizes);
+    std::string size;
+    uint64_t checksum = 0;
+    while (std::getline(sizes, size, ','))
+    {
+        uint32_t generationSize = std::stoul(size);
+        uint32_t maxSymbols = BlockDecoder::Small::max_symbols;
+        if (generationSize == 0 || generationSize > maxSymbols)
+        {
+            std::cerr << "Skipping generation size " << generationSize
+                      << " (1 to " << maxSymbols << " symbols)" << std::endl;
+            continue;
+        }
+
+        kodo::block::generator::random_uniform generator(field);
+        generator.configure(generationSize);
+        uint32_t coefficientsBytes = generator.max_coefficients_bytes();
+        uint32_t symbolBytes = packetSize - coefficientsBytes;
+
+        kodo::block::encoder encoder(field);
+        encoder.configure(generationSize, symbolBytes);
+        std::vector<uint8_t> data(encoder.block_bytes());
+        for (uint32_t i = 0; i < data.size(); i++)
+        {
+            data[i] = uint8_t(i * 7 + 3);
+        }
+        encoder.set_symbols_storage(data.data());
+
+        // Every packet is [coefficients][symbol]
+        uint32_t poolSize = 16 * generationSize;
+        std::vector<uint8_t> pool(poolSize * packetSize);
+        for (uint32_t i = 0; i < poolSize; i++)
+        {
+            uint8_t* packet = pool.data() + i * packetSize;
+            generator.set_seed(i);
+            generator.generate(packet);
+            encoder.encode_symbol(packet + coefficientsBytes, packet);
+        }
+
+        // The kodo decoder first, then the small decoder
+        std::vector<double> nanoseconds;
+        for (bool small : {false, true})
+        {
+            BlockDecoder decoder(field);
+            decoder.set_small_enabled(small);
+            decoder.configure(generationSize, symbolBytes);
+            std::vector<uint8_t> storage(decoder.block_bytes());
+            decoder.set_symbols_storage(storage.data());
+            std::vector<uint8_t> packet(packetSize);
+            bool verified = false;
+
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < packets; i++)
+            {
+                // The decoder works in place, so the packet is copied
+                std::memcpy(packet.data(),
+                            pool.data() + (i % poolSize) * packetSize,
+                            packetSize);
+                decoder.decode_symbol(packet.data() + coefficientsBytes,
+                                      packet.data());
+
+                if (decoder.is_complete())
+                {
+                    if (!verified && storage != data)
+                    {
+                        std::cerr << (small ? "Small" : "Kodo")
+                                  << " decoder decoded wrong data"
+                                  << std::endl;
+                    }
+                    verified = true;
+                    checksum += storage[symbolBytes - 1];
+                    decoder.reset();
+                    decoder.set_symbols_storage(storage.data());
+                }
+            }
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            nanoseconds.push_back(elapsed.count() * 1e9 / packets);
+        }
+
+        std::cout << generationSize << "," << nanoseconds[0] << ","
+                  << nanoseconds[1] << "," << nanoseconds[0] / nanoseconds[1]
+                  << std::endl;
+    }
+
+    // Keep the results alive so the loops are not optimized away
+    std::cout << "Checksum: " << checksum << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class keeps a pool of configured decoders with their symbol storage.
+// A decoder is acquired when a receiver gets its first packet and released
+// when it has decoded the generation, so a released decoder and its storage
+// are reused by the next receiver (or the next trial) without any new
+// allocation. The number of allocated decoders only grows to the peak number
+// of receivers that are decoding at the same time.
+//
+// With an InnovationFilter, every decoder also keeps the CoefficientSpace
+// that the filter checks its packets against.
+//
+// Binary generations of up to 64 symbols are decoded by the fixed-size
+// SmallDecoder unless it is disabled (see kodo-small-decoder.h).
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <kodo/block/decoder.hpp>
+#include <kodo/finite_field.hpp>
+
+#include "kodo-innovation-filter.h"
+#include "kodo-small-decoder.h"
+
+class DecoderPool
+{
+public:
+    struct Decoder
+    {
+        Decoder(const kodo::finite_field field) : decoder(field)
+        {
+        }
+
+        BlockDecoder decoder;
+        std::vector<uint8_t> storage;
+        std::unique_ptr<CoefficientSpace> space;
+    };
+
+    DecoderPool(const kodo::finite_field field, const uint32_t symbols,
+                const uint32_t symbolBytes) :
+        m_field(field),
+        m_symbols(symbols), m_symbolBytes(symbolBytes), m_allocated(0),
+        m_active(0), m_peakActive(0), m_filter(nullptr), m_smallEnabled(true)
+    {
+    }
+
+    // Enables or disables the small decoder for the decoders allocated
+    // from now on. The free decoders are dropped.
+    void SetSmallDecoders(bool enabled)
+    {
+        m_smallEnabled = enabled;
+        m_allocated -= m_free.size();
+        m_free.clear();
+    }
+
+    // Gives every decoder a space of the filter, which must outlive the
+    // pool
+    void SetInnovationFilter(const InnovationFilter* filter)
+    {
+        m_filter = filter;
+    }
+
+    // Returns an empty decoder, which is either reused from the pool or
+    // newly allocated
+    std::unique_ptr<Decoder> Acquire()
+    {
+        std::unique_ptr<Decoder> decoder;
+
+        if (m_free.empty())
+        {
+            decoder.reset(new Decoder(m_field));
+            decoder->decoder.set_small_enabled(m_smallEnabled);
+            decoder->decoder.configure(m_symbols, m_symbolBytes);
+            decoder->storage.resize(decoder->decoder.block_bytes());
+            m_allocated++;
+        }
+        else
+        {
+            decoder = std::move(m_free.back());
+            m_free.pop_back();
+            decoder->decoder.reset();
+        }
+        decoder->decoder.set_symbols_storage(decoder->storage.data());
+
+        if (m_filter != nullptr && !decoder->space)
+        {
+            decoder->space.reset(new CoefficientSpace(m_filter->CreateSpace()));
+        }
+        else if (decoder->space)
+        {
+            decoder->space->Reset();
+        }
+
+        m_active++;
+        m_peakActive = std::max(m_peakActive, m_active);
+        return decoder;
+    }
+
+    void Release(std::unique_ptr<Decoder> decoder)
+    {
+        m_free.push_back(std::move(decoder));
+        m_active--;
+    }
+
+    uint32_t GetAllocated() const
+    {
+        return m_allocated;
+    }
+
+    uint32_t GetActive() const
+    {
+        return m_active;
+    }
+
+    uint32_t GetPeakActive() const
+    {
+        return m_peakActive;
+    }
+
+    // Returns the bytes of symbol storage held by the pool
+    uint64_t GetStorageBytes() const
+    {
+        return uint64_t(m_allocated) * m_symbols * m_symbolBytes;
+    }
+
+private:
+    const kodo::finite_field m_field;
+    const uint32_t m_symbols;
+    const uint32_t m_symbolBytes;
+
+    std::vector<std::unique_ptr<Decoder>> m_free;
+    uint32_t m_allocated;
+    uint32_t m_active;
+    uint32_t m_peakActive;
+    const InnovationFilter* m_filter;
+    bool m_smallEnabled;
+};
@@ -0,0 +1,531 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This object implements the encoder - N recoders - decoder protocol of the
+// Recoders helper for the distributed (MPI) simulator, where every rank
+// only simulates a part of the nodes.
+//
+// A rank only holds the coding state of its own nodes: the encoder, the
+// recoders and the decoder are added with SetEncoder, AddRecoder and
+// SetDecoder on the rank that owns them. Since a node cannot see the state
+// of the nodes on other ranks, the completion is signalled with control
+// packets on the links: a recoder that has decoded sends a complete packet
+// to the encoder, which stops when all recoders are complete, and the
+// decoder sends a stop packet to every recoder when it has decoded. Every
+// packet starts with its type:
+//
+//   coded:    [type][coefficients][symbol]
+//   complete: [type]
+//   stop:     [type]
+//
+// Every node draws from its own random streams, so the coding of a node
+// does not depend on how the nodes are partitioned over the ranks. The
+// control packets are not lost, as the error models only drop the coded
+// packets on the receive side of the links. The counters of all ranks are
+// merged at the end (see kodo-recoders-mpi.cc).
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <kodo/block/decoder.hpp>
+#include <kodo/block/encoder.hpp>
+#include <kodo/block/generator/random_uniform.hpp>
+#include <kodo/finite_field.hpp>
+
+#include "kodo-batch-encoder.h"
+#include "kodo-hash.h"
+#include "kodo-innovation-filter.h"
+#include "kodo-profiler.h"
+#include "kodo-verifier.h"
+
+class DistributedRecoders
+{
+public:
+    enum class Type : uint8_t
+    {
+        coded = 0,
+        complete,
+        stop
+    };
+
+    // Counters of the nodes of one rank, which are summed over the ranks
+    enum Counter
+    {
+        encoderTransmissions = 0,
+        recoderTransmissions,
+        recoderPackets,
+        recodersComplete,
+        decoderPackets,
+        decoderInnovative,
+        decoderComplete,
+        decoderVerified,
+        rejectedPackets,
+        savedBytes,
+        controlPackets,
+        counterCount
+    };
+
+    DistributedRecoders(const kodo::finite_field field,
+                        const uint32_t recoders, const uint32_t generationSize,
+                        const uint32_t packetSize, const bool recodingFlag,
+                        const double transmitProbability) :
+        m_field(field),
+        m_recoderCount(recoders), m_generationSize(generationSize),
+        m_packetSize(packetSize), m_recodingFlag(recodingFlag),
+        m_transmitProbability(transmitProbability), m_encoder(field),
+        m_generator(field), m_profiler("DistributedRecoders"),
+        m_batchEncoder(m_encoder, field, BatchEncoder::Header::coefficients,
+                       packetSize, m_profiler),
+        m_filter(field, generationSize)
+    {
+        m_generator.configure(m_generationSize);
+        m_coefficientsBytes = m_generator.max_coefficients_bytes();
+        m_symbolBytes = m_packetSize - 1 - m_coefficientsBytes;
+        m_payload.resize(m_packetSize);
+        m_coefficients.resize(m_coefficientsBytes);
+
+        m_recoders.resize(m_recoderCount);
+        m_counters.assign(counterCount, 0);
+        m_completedRecoders = 0;
+        m_encoderRunning = false;
+        m_encoderSeeded = false;
+        m_completionTime = ns3::Seconds(0);
+    }
+
+    // Adds the encoder, which sends the coded packets with the socket to
+    // all recoders and receives their complete packets
+    void SetEncoder(ns3::Ptr<ns3::Socket> socket, ns3::Address recoders)
+    {
+        m_encoder.configure(m_generationSize, m_symbolBytes);
+        m_encoderBuffer.resize(m_encoder.block_bytes());
+        FillPseudoRandom(m_encoderBuffer.data(), m_encoderBuffer.size(),
+                         ns3::RngSeedManager::GetRun());
+        m_encoder.set_symbols_storage(m_encoderBuffer.data());
+
+        m_batchEncoder.SetPrefixSize(1);
+        m_batchEncoder.SetBatchSize(1);
+
+        m_encoderSocket = socket;
+        m_encoderDestination = recoders;
+        m_encoderVariable = ns3::CreateObject<ns3::UniformRandomVariable>();
+        m_encoderRunning = true;
+        socket->SetRecvCallback(
+            ns3::MakeCallback(&DistributedRecoders::ReceiveEncoder, this));
+    }
+
+    // Adds recoder n, which receives from the encoder and sends to the
+    // decoder with the socket
+    void AddRecoder(uint32_t n, ns3::Ptr<ns3::Socket> socket,
+                    ns3::Address encoder, ns3::Address decoder)
+    {
+        std::unique_ptr<Recoder> recoder(new Recoder(m_field));
+        recoder->index = n;
+        recoder->socket = socket;
+        recoder->encoder = encoder;
+        recoder->decoder = decoder;
+        recoder->coder.configure(m_generationSize, m_symbolBytes);
+        recoder->storage.resize(recoder->coder.block_bytes());
+        recoder->coder.set_symbols_storage(recoder->storage.data());
+        recoder->generator.configure(m_generationSize);
+        recoder->space.reset(new CoefficientSpace(m_filter.CreateSpace()));
+        recoder->variable = ns3::CreateObject<ns3::UniformRandomVariable>();
+
+        m_recoderSockets[socket] = n;
+        m_recoders[n] = std::move(recoder);
+        socket->SetRecvCallback(
+            ns3::MakeCallback(&DistributedRecoders::ReceiveRecoder, this));
+    }
+
+    // Adds the decoder, which receives from all recoders with the socket.
+    // recoders[n] is the address of recoder n on its link to the decoder.
+    void SetDecoder(ns3::Ptr<ns3::Socket> socket,
+                    const std::vector<ns3::Address>& recoders)
+    {
+        m_decoder.reset(new kodo::block::decoder(m_field));
+        m_decoder->configure(m_generationSize, m_symbolBytes);
+        m_decoderBuffer.resize(m_decoder->block_bytes());
+        m_decoder->set_symbols_storage(m_decoderBuffer.data());
+        m_decoderSpace.reset(new CoefficientSpace(m_filter.CreateSpace()));
+
+        // The decoder knows the digest of the block as in a manifest
+        std::vector<uint8_t> block(m_decoder->block_bytes());
+        FillPseudoRandom(block.data(), block.size(),
+                         ns3::RngSeedManager::GetRun());
+        m_digest = m_verifier.Digest(block.data(), block.size());
+
+        m_decoderSocket = socket;
+        m_decoderDestinations = recoders;
+        socket->SetRecvCallback(
+            ns3::MakeCallback(&DistributedRecoders::ReceiveDecoder, this));
+    }
+
+    // Assigns fixed streams to the random variables of the local nodes.
+    // Node k (0 is the encoder, n + 1 recoder n) uses stream + k, whatever
+    // rank it is on.
+    int64_t AssignStreams(int64_t stream)
+    {
+        if (m_encoderVariable)
+        {
+            m_encoderVariable->SetStream(stream);
+        }
+        for (auto& recoder : m_recoders)
+        {
+            if (recoder)
+            {
+                recoder->variable->SetStream(stream + 1 + recoder->index);
+            }
+        }
+        return 1 + m_recoderCount;
+    }
+
+    void SetInnovationFilter(bool enabled)
+    {
+        m_filter.SetEnabled(enabled);
+    }
+
+    // Schedules the transmissions of the local nodes
+    void Start(ns3::Time encoderStart, ns3::Time recodersStart,
+               ns3::Time interval)
+    {
+        if (m_encoderSocket)
+        {
+            ns3::Simulator::ScheduleWithContext(
+                m_encoderSocket->GetNode()->GetId(), encoderStart,
+                &DistributedRecoders::SendEncoder, this, interval);
+        }
+        for (auto& recoder : m_recoders)
+        {
+            if (recoder)
+            {
+                ns3::Simulator::ScheduleWithContext(
+                    recoder->socket->GetNode()->GetId(), recodersStart,
+                    &DistributedRecoders::SendRecoder, this, recoder->index,
+                    interval);
+            }
+        }
+    }
+
+    // Returns the counters of the local nodes
+    std::vector<uint64_t> GetCounters() const
+    {
+        auto counters = m_counters;
+        counters[rejectedPackets] = m_filter.GetRejectedCount();
+        counters[savedBytes] = m_filter.GetSavedBytes();
+        return counters;
+    }
+
+    // Returns the time at which the decoder completed, if it is local
+    ns3::Time GetCompletionTime() const
+    {
+        return m_completionTime;
+    }
+
+    // Returns the bytes of coding state held by this rank
+    uint64_t GetStateBytes() const
+    {
+        uint64_t bytes = m_encoderBuffer.size() + m_decoderBuffer.size();
+        for (const auto& recoder : m_recoders)
+        {
+            bytes += recoder ? recoder->storage.size() : 0;
+        }
+        return bytes;
+    }
+
+    Profiler& GetProfiler()
+    {
+        return m_profiler;
+    }
+
+private:
+    struct Recoder
+    {
+        Recoder(const kodo::finite_field field) :
+            coder(field), generator(field), complete(false), stopped(false),
+            seeded(false)
+        {
+        }
+
+        uint32_t index;
+        ns3::Ptr<ns3::Socket> socket;
+        ns3::Address encoder;
+        ns3::Address decoder;
+        kodo::block::decoder coder;
+        std::vector<uint8_t> storage;
+        kodo::block::generator::random_uniform generator;
+        std::unique_ptr<CoefficientSpace> space;
+        std::vector<ns3::Ptr<ns3::Packet>> received;
+        ns3::Ptr<ns3::UniformRandomVariable> variable;
+        bool complete;
+        bool stopped;
+        bool seeded;
+    };
+
+    void SendEncoder(ns3::Time interval)
+    {
+        if (!m_encoderRunning)
+        {
+            return;
+        }
+
+        if (!m_encoderSeeded)
+        {
+            m_batchEncoder.SetSeed(m_encoderVariable->GetInteger(
+                0, std::numeric_limits<int32_t>::max()));
+            m_encoderSeeded = true;
+        }
+
+        uint8_t* payload = m_batchEncoder.Next();
+        payload[0] = uint8_t(Type::coded);
+        {
+            KODO_NS3_PROFILE(m_profiler, packet);
+            auto packet = ns3::Create<ns3::Packet>(payload, m_packetSize);
+            m_encoderSocket->SendTo(packet, 0, m_encoderDestination);
+        }
+        m_counters[encoderTransmissions]++;
+
+        ns3::Simulator::Schedule(interval, &DistributedRecoders::SendEncoder,
+                                 this, interval);
+    }
+
+    void ReceiveEncoder(ns3::Ptr<ns3::Socket> socket)
+    {
+        uint8_t type;
+        socket->Recv()->CopyData(&type, 1);
+        m_counters[controlPackets]++;
+
+        if (Type(type) == Type::complete &&
+            ++m_completedRecoders == m_recoderCount)
+        {
+            m_encoderRunning = false;
+        }
+    }
+
+    void SendRecoder(uint32_t n, ns3::Time interval)
+    {
+        Recoder& recoder = *m_recoders[n];
+        if (recoder.stopped)
+        {
+            return;
+        }
+
+        bool transmit =
+            recoder.variable->GetValue(0.0, 1.0) <= m_transmitProbability;
+
+        if (recoder.coder.rank() > 0 && transmit)
+        {
+            ns3::Ptr<ns3::Packet> packet;
+            if (m_recodingFlag)
+            {
+                if (!recoder.seeded)
+                {
+                    recoder.generator.set_seed(recoder.variable->GetInteger(
+                        0, std::numeric_limits<int32_t>::max()));
+                    recoder.seeded = true;
+                }
+                m_payload[0] = uint8_t(Type::coded);
+                {
+                    KODO_NS3_PROFILE(m_profiler, coefficients);
+                    recoder.generator.generate_recode(m_coefficients.data(),
+                                                      recoder.coder);
+                }
+                {
+                    KODO_NS3_PROFILE(m_profiler, recode);
+                    recoder.coder.recode_symbol(Symbol(), Coefficients(),
+                                                m_coefficients.data());
+                }
+                KODO_NS3_PROFILE(m_profiler, packet);
+                packet = ns3::Create<ns3::Packet>(m_payload.data(),
+                                                  m_packetSize);
+            }
+            else
+            {
+                // Forward a previously received packet at random
+                uint32_t last = recoder.received.size() - 1;
+                packet = recoder.received[recoder.variable->GetInteger(0, last)]
+                             ->Copy();
+                packet->RemoveAllPacketTags();
+            }
+            recoder.socket->SendTo(packet, 0, recoder.decoder);
+            m_counters[recoderTransmissions]++;
+        }
+
+        ns3::Simulator::Schedule(interval, &DistributedRecoders::SendRecoder,
+                                 this, n, interval);
+    }
+
+    void ReceiveRecoder(ns3::Ptr<ns3::Socket> socket)
+    {
+        Recoder& recoder = *m_recoders[m_recoderSockets[socket]];
+
+        auto packet = socket->Recv();
+        {
+            KODO_NS3_PROFILE(m_profiler, packet);
+            packet->CopyData(m_payload.data(), m_payload.size());
+        }
+
+        if (Type(m_payload[0]) == Type::stop)
+        {
+            recoder.stopped = true;
+            m_counters[controlPackets]++;
+            return;
+        }
+
+        m_counters[recoderPackets]++;
+        if (recoder.complete)
+        {
+            return;
+        }
+        if (!m_recodingFlag)
+        {
+            recoder.received.push_back(packet);
+        }
+
+        Decode(recoder.coder, *recoder.space);
+
+        if (recoder.coder.is_complete())
+        {
+            // Tell the encoder that it can stop sending to this recoder
+            recoder.complete = true;
+            m_counters[recodersComplete]++;
+            uint8_t type = uint8_t(Type::complete);
+            recoder.socket->SendTo(ns3::Create<ns3::Packet>(&type, 1), 0,
+                                   recoder.encoder);
+        }
+    }
+
+    void ReceiveDecoder(ns3::Ptr<ns3::Socket> socket)
+    {
+        {
+            KODO_NS3_PROFILE(m_profiler, packet);
+            socket->Recv()->CopyData(m_payload.data(), m_payload.size());
+        }
+        m_counters[decoderPackets]++;
+
+        if (m_decoder->is_complete())
+        {
+            return;
+        }
+
+        uint32_t rank = m_decoder->rank();
+        Decode(*m_decoder, *m_decoderSpace);
+        if (m_decoder->rank() == rank)
+        {
+            return;
+        }
+
+        m_counters[decoderInnovative]++;
+        if (m_decoder->is_complete())
+        {
+            m_completionTime = ns3::Simulator::Now();
+            m_counters[decoderComplete]++;
+            if (m_verifier.Verify(m_decoderBuffer.data(),
+                                  m_decoderBuffer.size(), m_digest))
+            {
+                m_counters[decoderVerified]++;
+            }
+            else
+            {
+                std::cerr << "The decoder decoded wrong data" << std::endl;
+            }
+
+            // Stop all recoders
+            uint8_t type = uint8_t(Type::stop);
+            for (const auto& recoder : m_decoderDestinations)
+            {
+                m_decoderSocket->SendTo(ns3::Create<ns3::Packet>(&type, 1), 0,
+                                        recoder);
+            }
+        }
+    }
+
+    // Decodes the coded packet in the payload, unless the filter rejects it
+    void Decode(kodo::block::decoder& decoder, CoefficientSpace& space)
+    {
+        bool innovative;
+        {
+            KODO_NS3_PROFILE(m_profiler, filter);
+            innovative =
+                m_filter.Check(space, Coefficients(), decoder.symbol_bytes());
+        }
+        if (innovative)
+        {
+            KODO_NS3_PROFILE(m_profiler, decode);
+            decoder.decode_symbol(Symbol(), Coefficients());
+            m_filter.Confirm(space, decoder.rank());
+        }
+    }
+
+    uint8_t* Coefficients()
+    {
+        return m_payload.data() + 1;
+    }
+
+    uint8_t* Symbol()
+    {
+        return m_payload.data() + 1 + m_coefficientsBytes;
+    }
+
+private:
+    const kodo::finite_field m_field;
+    const uint32_t m_recoderCount;
+    const uint32_t m_generationSize;
+    const uint32_t m_packetSize;
+    const bool m_recodingFlag;
+    const double m_transmitProbability;
+
+    uint32_t m_coefficientsBytes;
+    uint32_t m_symbolBytes;
+    std::vector<uint8_t> m_payload;
+    std::vector<uint8_t> m_coefficients;
+
+    // The encoder (if local)
+    kodo::block::encoder m_encoder;
+    std::vector<uint8_t> m_encoderBuffer;
+    kodo::block::generator::random_uniform m_generator;
+    ns3::Ptr<ns3::Socket> m_encoderSocket;
+    ns3::Address m_encoderDestination;
+    ns3::Ptr<ns3::UniformRandomVariable> m_encoderVariable;
+    uint32_t m_completedRecoders;
+    bool m_encoderRunning;
+    bool m_encoderSeeded;
+
+    // The local recoders, null for the recoders of other ranks
+    std::vector<std::unique_ptr<Recoder>> m_recoders;
+    std::map<ns3::Ptr<ns3::Socket>, uint32_t> m_recoderSockets;
+
+    // The decoder (if local)
+    std::unique_ptr<kodo::block::decoder> m_decoder;
+    std::vector<uint8_t> m_decoderBuffer;
+    std::unique_ptr<CoefficientSpace> m_decoderSpace;
+    ns3::Ptr<ns3::Socket> m_decoderSocket;
+    std::vector<ns3::Address> m_decoderDestinations;
+    uint64_t m_digest;
+    Verifier m_verifier;
+    ns3::Time m_completionTime;
+
+    std::vector<uint64_t> m_counters;
+    Profiler m_profiler;
+    BatchEncoder m_batchEncoder;
+    InnovationFilter m_filter;
+};
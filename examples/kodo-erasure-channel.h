@@ -0,0 +1,82 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class implements a broadcast erasure channel without any network
+// stack. A packet sent on the channel is offered to the error model of every
+// receiver and the packets that are not erased are delivered after a fixed
+// delay through the simulator event queue. Only the erasure pattern of the
+// point-to-point links matters for the number of transmissions, so a run on
+// this channel gives the same statistics as a run on the full IP/UDP stack
+// at a fraction of the cost.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <ns3/core-module.h>
+#include <ns3/network-module.h>
+
+class ErasureChannel
+{
+public:
+    using ReceiveCallback =
+        std::function<void(uint32_t receiver, ns3::Ptr<ns3::Packet> packet)>;
+
+    ErasureChannel(ns3::Time delay) : m_delay(delay)
+    {
+    }
+
+    // Adds a receiver with its own error model and returns its index
+    uint32_t AddReceiver(ns3::Ptr<ns3::ErrorModel> errorModel)
+    {
+        m_errorModels.push_back(errorModel);
+        return m_errorModels.size() - 1;
+    }
+
+    void SetReceiveCallback(const ReceiveCallback& callback)
+    {
+        m_receiveCallback = callback;
+    }
+
+    // The receivers only read the packet, so the same packet is delivered
+    // to all of them without a copy
+    void Send(ns3::Ptr<ns3::Packet> packet)
+    {
+        for (uint32_t n = 0; n < m_errorModels.size(); n++)
+        {
+            if (!m_errorModels[n]->IsCorrupt(packet))
+            {
+                ns3::Simulator::Schedule(m_delay, &ErasureChannel::Deliver,
+                                         this, n, packet);
+            }
+        }
+    }
+
+private:
+    void Deliver(uint32_t receiver, ns3::Ptr<ns3::Packet> packet)
+    {
+        m_receiveCallback(receiver, packet);
+    }
+
+private:
+    const ns3::Time m_delay;
+    std::vector<ns3::Ptr<ns3::ErrorModel>> m_errorModels;
+    ReceiveCallback m_receiveCallback;
+};
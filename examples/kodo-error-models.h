@@ -0,0 +1,276 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Packet error models for bursty links.
+//
+// GilbertElliottErrorModel is a two-state Markov chain: every packet first
+// moves the link between the good and the bad state and is then lost with
+// the loss rate of the new state. LossTrace memory-maps a recorded loss
+// trace, where every '1' is a lost packet and every '0' a received one
+// (other characters such as line breaks are skipped), and TraceErrorModel
+// replays it from a given offset. The trace is shared by all links, so
+// large traces are mapped once and read without any per-packet allocation.
+//
+// CreateErrorModel builds the model of one link from the command line
+// options of the examples. Parameters that the models cannot represent, an
+// unreadable trace or a trace without packet states abort the program
+// instead of running with other losses than requested.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <ns3/core-module.h>
+#include <ns3/network-module.h>
+
+#include "kodo-mapped-file.h"
+
+class GilbertElliottErrorModel : public ns3::ErrorModel
+{
+public:
+    static ns3::TypeId GetTypeId()
+    {
+        static ns3::TypeId tid =
+            ns3::TypeId("GilbertElliottErrorModel")
+                .SetParent<ns3::ErrorModel>()
+                .SetGroupName("Network")
+                .AddConstructor<GilbertElliottErrorModel>()
+                .AddAttribute(
+                    "GoodToBad", "Transition probability from good to bad",
+                    ns3::DoubleValue(0.0),
+                    ns3::MakeDoubleAccessor(
+                        &GilbertElliottErrorModel::m_goodToBad),
+                    ns3::MakeDoubleChecker<double>(0.0, 1.0))
+                .AddAttribute(
+                    "BadToGood", "Transition probability from bad to good",
+                    ns3::DoubleValue(1.0),
+                    ns3::MakeDoubleAccessor(
+                        &GilbertElliottErrorModel::m_badToGood),
+                    ns3::MakeDoubleChecker<double>(0.0, 1.0))
+                .AddAttribute(
+                    "GoodLossRate", "Loss rate in the good state",
+                    ns3::DoubleValue(0.0),
+                    ns3::MakeDoubleAccessor(
+                        &GilbertElliottErrorModel::m_goodLossRate),
+                    ns3::MakeDoubleChecker<double>(0.0, 1.0))
+                .AddAttribute(
+                    "BadLossRate", "Loss rate in the bad state",
+                    ns3::DoubleValue(1.0),
+                    ns3::MakeDoubleAccessor(
+                        &GilbertElliottErrorModel::m_badLossRate),
+                    ns3::MakeDoubleChecker<double>(0.0, 1.0));
+        return tid;
+    }
+
+    GilbertElliottErrorModel() : m_bad(false)
+    {
+        m_random = ns3::CreateObject<ns3::UniformRandomVariable>();
+    }
+
+    // Sets the transition probabilities for the given mean loss rate and
+    // mean burst length, with all packets lost in the bad state
+    void SetBursts(double lossRate, double burstLength)
+    {
+        NS_ABORT_MSG_IF(!(lossRate >= 0.0 && lossRate <= 1.0),
+                        "The loss rate must be in [0, 1]: " << lossRate);
+        NS_ABORT_MSG_IF(!(burstLength >= 1.0),
+                        "The mean burst length must be at least 1 packet: "
+                            << burstLength);
+
+        m_badToGood = 1.0 / burstLength;
+        m_goodToBad =
+            lossRate >= 1.0 ? 1.0 : m_badToGood * lossRate / (1.0 - lossRate);
+
+        // The good state lasts at least one packet, so the mean loss rate
+        // limits the shortest mean burst to lossRate / (1 - lossRate)
+        NS_ABORT_MSG_IF(m_goodToBad > 1.0,
+                        "A loss rate of " << lossRate
+                                          << " needs a mean burst length of "
+                                             "at least "
+                                          << lossRate / (1.0 - lossRate));
+        m_goodLossRate = 0.0;
+        m_badLossRate = 1.0;
+    }
+
+    int64_t AssignStreams(int64_t stream)
+    {
+        m_random->SetStream(stream);
+        return 1;
+    }
+
+private:
+    bool DoCorrupt(ns3::Ptr<ns3::Packet> packet) override
+    {
+        double transition = m_bad ? m_badToGood : m_goodToBad;
+        if (m_random->GetValue() < transition)
+        {
+            m_bad = !m_bad;
+        }
+        double lossRate = m_bad ? m_badLossRate : m_goodLossRate;
+        return m_random->GetValue() < lossRate;
+    }
+
+    void DoReset() override
+    {
+        m_bad = false;
+    }
+
+private:
+    double m_goodToBad;
+    double m_badToGood;
+    double m_goodLossRate;
+    double m_badLossRate;
+    bool m_bad;
+    ns3::Ptr<ns3::UniformRandomVariable> m_random;
+};
+
+class LossTrace
+{
+public:
+    LossTrace(const std::string& path) : m_file(path)
+    {
+        // The trace is read sequentially by every link
+        m_file.AdviseSequential();
+        m_data = reinterpret_cast<const char*>(m_file.GetData());
+        m_size = m_file.GetSize();
+
+        NS_ABORT_MSG_IF(m_size == 0, "Cannot read the loss trace " << path);
+        const char states[] = {'0', '1'};
+        NS_ABORT_MSG_IF(std::find_first_of(m_data, m_data + m_size, states,
+                                           states + 2) == m_data + m_size,
+                        "The loss trace " << path << " has no packet states");
+    }
+
+    uint64_t Size() const
+    {
+        return m_size;
+    }
+
+    // Returns the next packet state at or after the position and advances
+    // the position past it, wrapping around at the end of the trace
+    bool IsLost(uint64_t& position) const
+    {
+        for (uint64_t skipped = 0; skipped < m_size; skipped++)
+        {
+            char state = m_data[position];
+            position = position + 1 == m_size ? 0 : position + 1;
+            if (state == '0' || state == '1')
+            {
+                return state == '1';
+            }
+        }
+        return false;
+    }
+
+private:
+    MappedFile m_file;
+    const char* m_data;
+    uint64_t m_size;
+};
+
+class TraceErrorModel : public ns3::ErrorModel
+{
+public:
+    static ns3::TypeId GetTypeId()
+    {
+        static ns3::TypeId tid = ns3::TypeId("TraceErrorModel")
+                                     .SetParent<ns3::ErrorModel>()
+                                     .SetGroupName("Network")
+                                     .AddConstructor<TraceErrorModel>();
+        return tid;
+    }
+
+    TraceErrorModel() : m_offset(0), m_position(0)
+    {
+    }
+
+    // Replays the trace starting at the given byte offset
+    void SetTrace(std::shared_ptr<const LossTrace> trace, uint64_t offset)
+    {
+        m_trace = trace;
+        m_offset = trace->Size() == 0 ? 0 : offset % trace->Size();
+        m_position = m_offset;
+    }
+
+private:
+    bool DoCorrupt(ns3::Ptr<ns3::Packet> packet) override
+    {
+        return m_trace->IsLost(m_position);
+    }
+
+    void DoReset() override
+    {
+        m_position = m_offset;
+    }
+
+private:
+    std::shared_ptr<const LossTrace> m_trace;
+    uint64_t m_offset;
+    uint64_t m_position;
+};
+
+// Creates the error model of link n out of the given number of links. The
+// model is "rate" (i.i.d. losses), "gilbert" (bursts with the given mean
+// length and the same mean loss rate) or "trace" (every link replays its own
+// segment of the trace).
+inline ns3::Ptr<ns3::ErrorModel>
+CreateErrorModel(const std::string& model, double errorRate,
+                 double burstLength,
+                 const std::shared_ptr<const LossTrace>& trace, uint32_t n,
+                 uint32_t links)
+{
+    if (model == "gilbert")
+    {
+        auto gilbert = ns3::CreateObject<GilbertElliottErrorModel>();
+        gilbert->SetBursts(errorRate, burstLength);
+        return gilbert;
+    }
+    if (model == "trace")
+    {
+        NS_ABORT_MSG_IF(!trace, "The trace model needs a loss trace");
+        auto replay = ns3::CreateObject<TraceErrorModel>();
+        replay->SetTrace(trace, n * (trace->Size() / links));
+        return replay;
+    }
+    NS_ABORT_MSG_IF(model != "rate", "Unknown loss model " << model);
+
+    auto rate = ns3::CreateObject<ns3::RateErrorModel>();
+    rate->SetAttribute("ErrorUnit",
+                       ns3::EnumValue(ns3::RateErrorModel::ERROR_UNIT_PACKET));
+    rate->SetAttribute("ErrorRate", ns3::DoubleValue(errorRate));
+    return rate;
+}
+
+// Assigns a fixed stream to the random models and returns the number of
+// streams used
+inline int64_t AssignErrorModelStreams(ns3::Ptr<ns3::ErrorModel> model,
+                                       int64_t stream)
+{
+    if (auto rate = ns3::DynamicCast<ns3::RateErrorModel>(model))
+    {
+        return rate->AssignStreams(stream);
+    }
+    if (auto gilbert = ns3::DynamicCast<GilbertElliottErrorModel>(model))
+    {
+        return gilbert->AssignStreams(stream);
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class packs the coded symbols of a generation into the frames of
+// the Broadcast helper (see kodo-broadcast.h) and unpacks them at the
+// receivers.
+//
+// With one symbol per frame, a frame is a single coded packet:
+//
+//   [generation][seed][symbol]
+//
+// With more symbols per frame, several coded symbols of the same
+// generation share a frame to amortize the per-frame overhead of slow
+// links. A packed frame starts with the number of symbols (one byte), the
+// generation index and the seeds of all symbols, followed by the coded
+// symbols:
+//
+//   [count][generation][seed 1]..[seed count][symbol 1]..[symbol count]
+//
+// A packed frame keeps its header with a single symbol, e.g. at the end of
+// the burst of an open-loop source.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <endian/big_endian.hpp>
+
+#include "kodo-profiler.h"
+
+class FramePacker
+{
+public:
+    FramePacker(const uint32_t symbolBytes, Profiler& profiler) :
+        m_symbolBytes(symbolBytes), m_profiler(profiler),
+        m_symbolsPerFrame(1), m_frames(0)
+    {
+        m_payload.resize(GetFrameSize(m_symbolsPerFrame));
+    }
+
+    // Sets the number of coded symbols packed into every frame, from 1 (one
+    // coded packet per frame) to 255. A frame is at most the largest UDP
+    // payload, so fewer symbols are packed if they do not fit.
+    void SetSymbolsPerFrame(uint32_t symbols)
+    {
+        const uint32_t maxFrameSize = 65507;
+        symbols = std::min<uint32_t>(std::max<uint32_t>(symbols, 1), 255);
+        while (symbols > 1 &&
+               FrameHeaderSize(symbols) + symbols * m_symbolBytes >
+                   maxFrameSize)
+        {
+            symbols--;
+        }
+        m_symbolsPerFrame = symbols;
+        m_payload.resize(GetFrameSize(m_symbolsPerFrame));
+    }
+
+    uint32_t GetSymbolsPerFrame() const
+    {
+        return m_symbolsPerFrame;
+    }
+
+    // Returns the payload bytes of a frame with the given number of symbols.
+    // Without packing, a frame is a coded packet.
+    uint32_t GetFrameSize(uint32_t symbols) const
+    {
+        if (symbols <= 1 && m_symbolsPerFrame == 1)
+        {
+            return 2 * sizeof(uint32_t) + m_symbolBytes;
+        }
+        return FrameHeaderSize(symbols) + symbols * m_symbolBytes;
+    }
+
+    uint32_t GetFrameCount() const
+    {
+        return m_frames;
+    }
+
+    void Reset()
+    {
+        m_frames = 0;
+    }
+
+    // Returns a frame of the generation with count coded symbols (at most
+    // the symbols per frame). Every call of next() returns a coded packet
+    // [prefix][seed][symbol], where the generation is written to the
+    // prefix of an unpacked frame.
+    template <class Next>
+    ns3::Ptr<ns3::Packet> Pack(uint32_t generation, uint32_t count,
+                               Next next)
+    {
+        m_frames++;
+        if (m_symbolsPerFrame == 1)
+        {
+            uint8_t* packet = next();
+            endian::big_endian::put(generation, packet);
+            return ns3::Create<ns3::Packet>(packet, GetFrameSize(1));
+        }
+
+        // The symbols are placed after the header of a full frame, and the
+        // header of a shorter frame is written right before them
+        count = std::min(count, m_symbolsPerFrame);
+        uint8_t* symbols =
+            m_payload.data() + FrameHeaderSize(m_symbolsPerFrame);
+        m_seeds.clear();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint8_t* packet = next();
+            m_seeds.push_back(endian::big_endian::get<uint32_t>(
+                packet + sizeof(uint32_t)));
+            std::copy_n(packet + 2 * sizeof(uint32_t), m_symbolBytes,
+                        symbols + i * m_symbolBytes);
+        }
+
+        uint8_t* frame = symbols - FrameHeaderSize(count);
+        frame[0] = uint8_t(count);
+        endian::big_endian::put(generation, frame + 1);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            endian::big_endian::put(
+                m_seeds[i], frame + 1 + (i + 1) * sizeof(uint32_t));
+        }
+        return ns3::Create<ns3::Packet>(frame, GetFrameSize(count));
+    }
+
+    // Calls receive(generation, seed, symbol) for the coded symbols of a
+    // frame in order. The symbols are only valid during the calls.
+    template <class Receive>
+    void Unpack(ns3::Ptr<ns3::Packet> packet, Receive receive)
+    {
+        {
+            KODO_NS3_PROFILE(m_profiler, packet);
+            packet->CopyData(m_payload.data(), m_payload.size());
+        }
+
+        if (m_symbolsPerFrame == 1)
+        {
+            uint32_t generation =
+                endian::big_endian::get<uint32_t>(m_payload.data());
+            uint32_t seed = endian::big_endian::get<uint32_t>(
+                m_payload.data() + sizeof(uint32_t));
+            receive(generation, seed,
+                    m_payload.data() + 2 * sizeof(uint32_t));
+            return;
+        }
+
+        uint32_t count = m_payload[0];
+        uint32_t generation =
+            endian::big_endian::get<uint32_t>(m_payload.data() + 1);
+        const uint8_t* seeds = m_payload.data() + 1 + sizeof(uint32_t);
+        uint8_t* symbols = m_payload.data() + FrameHeaderSize(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t seed =
+                endian::big_endian::get<uint32_t>(seeds + i * sizeof(uint32_t));
+            receive(generation, seed, symbols + i * m_symbolBytes);
+        }
+    }
+
+    // Prints the frames sent, only when the symbols are packed
+    void Print(std::ostream& out) const
+    {
+        if (m_symbolsPerFrame > 1)
+        {
+            out << "Frames: " << m_frames << " of up to " << m_symbolsPerFrame
+                << " symbols (" << GetFrameSize(m_symbolsPerFrame)
+                << " bytes)" << std::endl;
+        }
+    }
+
+private:
+    // The count byte, the generation index and a seed per symbol
+    static uint32_t FrameHeaderSize(uint32_t symbols)
+    {
+        return 1 + (1 + symbols) * sizeof(uint32_t);
+    }
+
+private:
+    const uint32_t m_symbolBytes;
+    Profiler& m_profiler;
+    uint32_t m_symbolsPerFrame;
+    uint32_t m_frames;
+
+    // The frame being packed or unpacked and the seeds of its symbols
+    std::vector<uint8_t> m_payload;
+    std::vector<uint32_t> m_seeds;
+};
@@ -0,0 +1,153 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Fast non-cryptographic hashing and pseudo-random data for verifying the
+// decoded blocks.
+//
+// Hash64 is the 64-bit xxHash (XXH64) algorithm, which hashes several GB/s
+// per core, so the verification cost stays small next to the decoding.
+// FillPseudoRandom fills a block with the splitmix64 sequence of a seed.
+
+#pragma once
+
+#include <cstdint>
+
+namespace xxh64
+{
+const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t prime3 = 0x165667B19E3779F9ULL;
+const uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t Rotate(uint64_t x, uint32_t bits)
+{
+    return (x << bits) | (x >> (64 - bits));
+}
+
+// Little-endian loads, which compile to plain loads on x86 and ARM
+inline uint64_t Read64(const uint8_t* p)
+{
+    uint64_t x = 0;
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        x |= uint64_t(p[i]) << (8 * i);
+    }
+    return x;
+}
+
+inline uint32_t Read32(const uint8_t* p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 |
+           uint32_t(p[3]) << 24;
+}
+
+inline uint64_t Round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * prime2;
+    return Rotate(accumulator, 31) * prime1;
+}
+
+inline uint64_t Merge(uint64_t accumulator, uint64_t value)
+{
+    accumulator ^= Round(0, value);
+    return accumulator * prime1 + prime4;
+}
+}
+
+// Returns the XXH64 hash of size bytes of data
+inline uint64_t Hash64(const uint8_t* data, uint64_t size, uint64_t seed = 0)
+{
+    using namespace xxh64;
+
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    uint64_t h;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + prime1 + prime2;
+        uint64_t v2 = seed + prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - prime1;
+
+        // Four independent lanes of 8 bytes per stripe
+        for (; p + 32 <= end; p += 32)
+        {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+        }
+
+        h = Rotate(v1, 1) + Rotate(v2, 7) + Rotate(v3, 12) + Rotate(v4, 18);
+        h = Merge(h, v1);
+        h = Merge(h, v2);
+        h = Merge(h, v3);
+        h = Merge(h, v4);
+    }
+    else
+    {
+        h = seed + prime5;
+    }
+
+    h += size;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        h ^= Round(0, Read64(p));
+        h = Rotate(h, 27) * prime1 + prime4;
+    }
+    if (p + 4 <= end)
+    {
+        h ^= uint64_t(Read32(p)) * prime1;
+        h = Rotate(h, 23) * prime2 + prime3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        h ^= *p * prime5;
+        h = Rotate(h, 11) * prime1;
+    }
+
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+// Fills size bytes of data with a pseudo-random sequence given by the seed
+inline void FillPseudoRandom(uint8_t* data, uint64_t size, uint64_t seed)
+{
+    uint64_t state = seed;
+    for (uint64_t i = 0; i < size; i += 8)
+    {
+        state += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+
+        for (uint64_t j = 0; j < 8 && i + j < size; j++)
+        {
+            data[i + j] = uint8_t(z >> (8 * j));
+        }
+    }
+}
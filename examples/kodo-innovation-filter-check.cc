@@ -0,0 +1,239 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program checks that the spaces of the innovation filter (see
+// kodo-innovation-filter.h) mirror the kodo decoder in every field without
+// running an ns-3 simulation.
+//
+// For every field and generation size, a stream of coded packets from an
+// encoder, packets recoded by a decoder that holds part of the generation,
+// repeated packets and zero packets is passed both to the filter and to a
+// kodo decoder that decodes every packet. Apart from the audited packets,
+// which must not raise the rank, the filter must accept exactly the packets
+// that raise the rank of the decoder, the ranks of the space and of the
+// decoder must stay equal and the decoded block must match the source
+// block. One line is printed per field and generation size, and the
+// program exits with an error if any of them failed:
+//
+// python waf --run kodo-innovation-filter-check --command-template="%s
+// --generationSizes=1,5,16,64"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ns3/core-module.h>
+
+#include "kodo-innovation-filter.h"
+#include <kodo/block/decoder.hpp>
+#include <kodo/block/encoder.hpp>
+#include <kodo/block/generator/random_uniform.hpp>
+#include <kodo/finite_field.hpp>
+
+using namespace ns3;
+
+// The packet counts of a check
+struct Counts
+{
+    uint32_t packets = 0;
+    uint32_t accepted = 0;
+    uint32_t rejected = 0;
+    uint32_t audited = 0;
+};
+
+// Passes the packet stream to a filter and to a kodo decoder. Returns false
+// at the first packet on which they disagree.
+static bool Check(const kodo::finite_field field,
+                  const uint32_t generationSize, const uint32_t symbolBytes,
+                  const uint32_t seed, Counts& counts)
+{
+    kodo::block::generator::random_uniform generator(field);
+    generator.configure(generationSize);
+    generator.set_seed(seed);
+    uint32_t coefficientsBytes = generator.max_coefficients_bytes();
+
+    kodo::block::encoder encoder(field);
+    encoder.configure(generationSize, symbolBytes);
+    std::vector<uint8_t> data(encoder.block_bytes());
+    for (uint32_t i = 0; i < data.size(); i++)
+    {
+        data[i] = uint8_t(i * 7 + 3);
+    }
+    encoder.set_symbols_storage(data.data());
+
+    // The recoder only decodes the first half of the generation
+    kodo::block::decoder recoder(field);
+    recoder.configure(generationSize, symbolBytes);
+    std::vector<uint8_t> recoderStorage(recoder.block_bytes());
+    recoder.set_symbols_storage(recoderStorage.data());
+
+    kodo::block::decoder decoder(field);
+    decoder.configure(generationSize, symbolBytes);
+    std::vector<uint8_t> storage(decoder.block_bytes());
+    decoder.set_symbols_storage(storage.data());
+
+    InnovationFilter filter(field, generationSize);
+    filter.SetAuditInterval(4);
+    CoefficientSpace space = filter.CreateSpace();
+
+    std::vector<uint8_t> coefficients(coefficientsBytes, 0);
+    std::vector<uint8_t> symbol(symbolBytes, 0);
+    std::vector<uint8_t> recodeCoefficients(coefficientsBytes);
+
+    // The decoders work in place, so they decode copies of the packet
+    std::vector<uint8_t> coefficientsCopy(coefficientsBytes);
+    std::vector<uint8_t> symbolCopy(symbolBytes);
+
+    // Every fourth packet is from the encoder, which is enough to decode
+    // even in the binary field
+    for (uint32_t i = 0; i < 8 * generationSize + 64; i++)
+    {
+        // Encoded, recoded, repeated and zero packets in turn
+        uint32_t kind = i % 4;
+        if (kind == 1 && recoder.rank() == 0)
+        {
+            kind = 0;
+        }
+        if (kind == 0)
+        {
+            generator.generate(coefficients.data());
+            encoder.encode_symbol(symbol.data(), coefficients.data());
+
+            if (2 * recoder.rank() < generationSize)
+            {
+                coefficientsCopy = coefficients;
+                symbolCopy = symbol;
+                recoder.decode_symbol(symbolCopy.data(),
+                                      coefficientsCopy.data());
+            }
+        }
+        else if (kind == 1)
+        {
+            generator.generate_recode(recodeCoefficients.data(), recoder);
+            recoder.recode_symbol(symbol.data(), coefficients.data(),
+                                  recodeCoefficients.data());
+        }
+        else if (kind == 3)
+        {
+            std::fill(coefficients.begin(), coefficients.end(), 0);
+            std::fill(symbol.begin(), symbol.end(), 0);
+        }
+
+        uint64_t audits = filter.GetAuditedCount();
+        bool decoded = filter.Check(space, coefficients.data(), symbolBytes);
+        bool audited = filter.GetAuditedCount() > audits;
+        bool accepted = decoded && !audited;
+        uint32_t rank = decoder.rank();
+        if (!decoder.is_complete())
+        {
+            coefficientsCopy = coefficients;
+            symbolCopy = symbol;
+            decoder.decode_symbol(symbolCopy.data(), coefficientsCopy.data());
+        }
+        if (decoded)
+        {
+            filter.Confirm(space, decoder.rank());
+        }
+
+        counts.packets++;
+        counts.accepted += accepted ? 1 : 0;
+        counts.rejected += decoded ? 0 : 1;
+        counts.audited += audited ? 1 : 0;
+
+        bool raised = decoder.rank() > rank;
+        if (accepted != raised || space.Rank() != decoder.rank() ||
+            !filter.IsEnabled())
+        {
+            std::cerr << "Packet " << i << " (kind " << kind
+                      << "): the filter "
+                      << (audited    ? "audited"
+                          : accepted ? "accepted"
+                                     : "rejected")
+                      << " a packet that "
+                      << (raised ? "raised" : "did not raise")
+                      << " the decoder rank to " << decoder.rank()
+                      << ", space rank " << space.Rank() << std::endl;
+            return false;
+        }
+    }
+
+    if (!decoder.is_complete() || storage != data)
+    {
+        std::cerr << "The decoder did not decode the source block"
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string generationSizes = "1,2,5,16,64"; // Comma-separated list
+    uint32_t symbolBytes = 16; // Bytes per symbol
+    uint32_t seed = 1;         // Seed of the coefficients
+
+    CommandLine cmd;
+
+    cmd.AddValue("generationSizes", "Comma-separated generation sizes",
+                 generationSizes);
+    cmd.AddValue("symbolBytes", "Bytes per symbol", symbolBytes);
+    cmd.AddValue("seed", "Seed of the coefficients", seed);
+
+    cmd.Parse(argc, argv);
+
+    std::vector<std::pair<std::string, kodo::finite_field>> fields = {
+        {"binary", kodo::finite_field::binary},
+        {"binary4", kodo::finite_field::binary4},
+        {"binary8", kodo::finite_field::binary8},
+        {"binary16", kodo::finite_field::binary16}};
+
+    std::cout << "field,generation_size,packets,accepted,rejected,audited,"
+              << "result" << std::endl;
+
+    uint32_t failed = 0;
+    for (const auto& field : fields)
+    {
+        std::stringstream sizes(generationSizes);
+        std::string size;
+        while (std::getline(sizes, size, ','))
+        {
+            uint32_t generationSize = std::stoul(size);
+            if (generationSize == 0)
+            {
+                std::cerr << "Skipping generation size 0" << std::endl;
+                continue;
+            }
+
+            Counts counts;
+            bool ok = Check(field.second, generationSize, symbolBytes, seed,
+                            counts);
+            failed += ok ? 0 : 1;
+            std::cout << field.first << "," << generationSize << ","
+                      << counts.packets << "," << counts.accepted << ","
+                      << counts.rejected << "," << counts.audited << ","
+                      << (ok ? "ok" : "FAILED")
+                      << std::endl;
+        }
+    }
+
+    return failed == 0 ? 0 : 1;
+}
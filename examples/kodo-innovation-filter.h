@@ -0,0 +1,234 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class rejects non-innovative packets before their payload is
+// decoded.
+//
+// Every decoder (or recoder) has a CoefficientSpace that mirrors the span
+// of its coding matrix: a coding vector is first reduced against the space,
+// which costs O(g^2) field operations on the coefficients only, and the
+// payload is passed to decode_symbol only when the vector is innovative.
+// Since the space and the decoder see the same innovative vectors, they
+// always have the same rank. Late in a generation most packets are not
+// innovative, so this saves the O(g * symbol size) payload arithmetic of
+// the decoder for them.
+//
+// The coefficients are read in the layout of the kodo generators: GF(2)
+// packs 8 coefficients per byte starting from the least significant bit,
+// GF(2^4) packs 2 per byte starting from the low nibble, GF(2^8) uses one
+// byte and GF(2^16) a 16-bit word in host byte order per coefficient.
+// After every decoded packet, the rank of the space is compared with the
+// rank of the decoder. A wrong rejection would not show up there, since the
+// decoder never sees the packet, so every audit-interval-th rejected packet
+// is decoded anyway: if it raises the rank of the decoder, the space no
+// longer mirrors it. The filter disables itself at the first mismatch and
+// every later packet is decoded. Between two audits, a space that wrongly
+// rejects packets can still delay its decoder. The
+// kodo-innovation-filter-check program compares the spaces with the kodo
+// decoder in every field.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <kodo/finite_field.hpp>
+
+#include "kodo-coefficient-space.h"
+
+class InnovationFilter
+{
+public:
+    InnovationFilter(const kodo::finite_field field, const uint32_t symbols) :
+        m_fieldType(field), m_field(field), m_symbols(symbols),
+        m_vector(symbols), m_enabled(true), m_auditInterval(32)
+    {
+        Reset();
+    }
+
+    // The spaces refer to the field tables of the filter
+    InnovationFilter(const InnovationFilter&) = delete;
+    InnovationFilter& operator=(const InnovationFilter&) = delete;
+
+    // Returns the empty space of a new decoder
+    CoefficientSpace CreateSpace() const
+    {
+        return CoefficientSpace(m_field, m_symbols);
+    }
+
+    // With the filter disabled, every packet is decoded
+    void SetEnabled(bool enabled)
+    {
+        m_enabled = enabled;
+    }
+
+    bool IsEnabled() const
+    {
+        return m_enabled;
+    }
+
+    // Sets how many rejected packets are decoded anyway to audit the
+    // spaces: one in interval, or none with 0
+    void SetAuditInterval(uint32_t interval)
+    {
+        m_auditInterval = interval;
+    }
+
+    // Returns true if the packet with the given coefficients must be
+    // decoded, in which case an innovative coding vector is added to the
+    // space of the decoder. The symbol bytes of a rejected packet are
+    // counted as saved. An audited packet is not innovative for the space,
+    // but it is decoded.
+    bool Check(CoefficientSpace& space, const uint8_t* coefficients,
+               uint32_t symbolBytes)
+    {
+        if (!m_enabled)
+        {
+            return true;
+        }
+
+        m_checked++;
+        Unpack(coefficients);
+        if (space.Insert(m_vector))
+        {
+            return true;
+        }
+
+        // A complete space that does not mirror its decoder already shows
+        // up as a rank mismatch
+        if (m_auditInterval > 0 && !space.IsComplete() &&
+            ++m_sinceAudit >= m_auditInterval)
+        {
+            m_sinceAudit = 0;
+            m_audited++;
+            return true;
+        }
+
+        m_rejected++;
+        m_savedBytes += symbolBytes;
+        return false;
+    }
+
+    // Compares the rank of a decoder after a decoded packet with the rank
+    // of its space, which only differ if the coefficient layout is wrong.
+    // Disables the filter at the first mismatch.
+    void Confirm(const CoefficientSpace& space, uint32_t decoderRank)
+    {
+        if (m_enabled && space.Rank() != decoderRank)
+        {
+            m_mismatches++;
+            m_enabled = false;
+            std::cerr << "Innovation filter: a space of rank " << space.Rank()
+                      << " does not mirror its decoder of rank "
+                      << decoderRank << ", the filter is disabled"
+                      << std::endl;
+        }
+    }
+
+    uint64_t GetMismatchCount() const
+    {
+        return m_mismatches;
+    }
+
+    uint64_t GetRejectedCount() const
+    {
+        return m_rejected;
+    }
+
+    uint64_t GetAuditedCount() const
+    {
+        return m_audited;
+    }
+
+    uint64_t GetSavedBytes() const
+    {
+        return m_savedBytes;
+    }
+
+    void Reset()
+    {
+        m_checked = 0;
+        m_rejected = 0;
+        m_audited = 0;
+        m_sinceAudit = 0;
+        m_savedBytes = 0;
+        m_mismatches = 0;
+    }
+
+    void Print(std::ostream& out) const
+    {
+        if (!m_enabled && m_mismatches == 0)
+        {
+            return;
+        }
+
+        out << "Innovation filter: " << m_rejected << " of " << m_checked
+            << " packets rejected before decoding, " << m_savedBytes
+            << " payload bytes saved, " << m_audited << " audited"
+            << std::endl;
+        if (m_mismatches > 0)
+        {
+            out << "Innovation filter: disabled after a rank mismatch with "
+                << "a decoder" << std::endl;
+        }
+    }
+
+private:
+    void Unpack(const uint8_t* coefficients)
+    {
+        for (uint32_t i = 0; i < m_symbols; i++)
+        {
+            switch (m_fieldType)
+            {
+            case kodo::finite_field::binary:
+                m_vector[i] = (coefficients[i / 8] >> (i % 8)) & 0x1;
+                break;
+            case kodo::finite_field::binary4:
+                m_vector[i] = (coefficients[i / 2] >> (4 * (i % 2))) & 0xF;
+                break;
+            case kodo::finite_field::binary8:
+                m_vector[i] = coefficients[i];
+                break;
+            case kodo::finite_field::binary16:
+            {
+                uint16_t value;
+                std::memcpy(&value, coefficients + 2 * i, sizeof(value));
+                m_vector[i] = value;
+                break;
+            }
+            }
+        }
+    }
+
+private:
+    const kodo::finite_field m_fieldType;
+    const FiniteField m_field;
+    const uint32_t m_symbols;
+    std::vector<uint32_t> m_vector;
+    bool m_enabled;
+    uint32_t m_auditInterval;
+
+    uint64_t m_checked;
+    uint64_t m_rejected;
+    uint64_t m_audited;
+    uint32_t m_sinceAudit;
+    uint64_t m_savedBytes;
+    uint64_t m_mismatches;
+};
@@ -0,0 +1,117 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class collects delivery latencies (the time between the first
+// transmission of an object or of a generation and the delivery of a
+// symbol or of the whole generation) in fixed-width bins.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class LatencyHistogram
+{
+public:
+    LatencyHistogram(ns3::Time binWidth = ns3::Seconds(1.0)) :
+        m_binWidth(binWidth), m_samples(0), m_total(0), m_min(0), m_max(0)
+    {
+    }
+
+    void SetBinWidth(ns3::Time binWidth)
+    {
+        // Changing the bin width invalidates the collected bins
+        Reset();
+        m_binWidth = binWidth;
+    }
+
+    void Add(ns3::Time latency)
+    {
+        int64_t ns = latency.GetNanoSeconds();
+        uint32_t bin = ns / std::max<int64_t>(m_binWidth.GetNanoSeconds(), 1);
+
+        if (bin >= m_bins.size())
+        {
+            m_bins.resize(bin + 1, 0);
+        }
+        m_bins[bin]++;
+
+        m_min = m_samples == 0 ? ns : std::min(m_min, ns);
+        m_max = m_samples == 0 ? ns : std::max(m_max, ns);
+        m_total += ns;
+        m_samples++;
+    }
+
+    void Reset()
+    {
+        m_bins.clear();
+        m_samples = 0;
+        m_total = 0;
+        m_min = 0;
+        m_max = 0;
+    }
+
+    uint32_t GetSamples() const
+    {
+        return m_samples;
+    }
+
+    ns3::Time GetMean() const
+    {
+        return ns3::NanoSeconds(m_samples == 0 ? 0 : m_total / m_samples);
+    }
+
+    void Print(std::ostream& out, const std::string& title) const
+    {
+        out << title << ": " << m_samples << " samples";
+
+        if (m_samples == 0)
+        {
+            out << std::endl;
+            return;
+        }
+
+        out << ", min " << ns3::NanoSeconds(m_min).GetSeconds() << " s"
+            << ", mean " << GetMean().GetSeconds() << " s"
+            << ", max " << ns3::NanoSeconds(m_max).GetSeconds() << " s"
+            << std::endl;
+
+        for (uint32_t bin = 0; bin < m_bins.size(); bin++)
+        {
+            if (m_bins[bin] == 0)
+            {
+                continue;
+            }
+            int64_t width = m_binWidth.GetNanoSeconds();
+            out << "  [" << ns3::NanoSeconds(width * bin).GetSeconds() << ", "
+                << ns3::NanoSeconds(width * (bin + 1)).GetSeconds()
+                << ") s: " << m_bins[bin] << std::endl;
+        }
+    }
+
+private:
+    ns3::Time m_binWidth;
+    std::vector<uint32_t> m_bins;
+    uint32_t m_samples;
+    int64_t m_total;
+    int64_t m_min;
+    int64_t m_max;
+};
@@ -0,0 +1,157 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class maps a whole file into memory, either an existing file for
+// reading or a new file of a given size for writing.
+//
+// The coding helpers work directly on the mapping, so an object of any
+// size is encoded and decoded without intermediate copies. The pages of a
+// range that is no longer needed can be released, which writes back the
+// dirty pages and drops them from the resident set, so the memory use is
+// bounded by the ranges in use and not by the size of the file.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class MappedFile
+{
+public:
+    // Maps an existing file for reading
+    explicit MappedFile(const std::string& path) : m_data(nullptr), m_size(0)
+    {
+        int file = open(path.c_str(), O_RDONLY);
+        struct stat status;
+        if (file < 0 || fstat(file, &status) != 0 || status.st_size == 0)
+        {
+            std::cerr << "Cannot read " << path << std::endl;
+            if (file >= 0)
+            {
+                close(file);
+            }
+            return;
+        }
+
+        Map(file, status.st_size, PROT_READ, MAP_PRIVATE, path);
+    }
+
+    // Creates (or truncates) a file of the given size and maps it for
+    // writing
+    MappedFile(const std::string& path, uint64_t size) :
+        m_data(nullptr), m_size(0)
+    {
+        int file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (file < 0 || size == 0 || ftruncate(file, size) != 0)
+        {
+            std::cerr << "Cannot create " << path << std::endl;
+            if (file >= 0)
+            {
+                close(file);
+            }
+            return;
+        }
+
+        Map(file, size, PROT_READ | PROT_WRITE, MAP_SHARED, path);
+    }
+
+    ~MappedFile()
+    {
+        if (m_data != nullptr)
+        {
+            munmap(m_data, m_size);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool IsValid() const
+    {
+        return m_data != nullptr;
+    }
+
+    const uint8_t* GetData() const
+    {
+        return m_data;
+    }
+
+    uint8_t* GetData()
+    {
+        return m_data;
+    }
+
+    uint64_t GetSize() const
+    {
+        return m_size;
+    }
+
+    // Tells the kernel that the file is accessed sequentially, so it reads
+    // ahead and drops the pages behind
+    void AdviseSequential()
+    {
+        if (m_data != nullptr)
+        {
+            madvise(m_data, m_size, MADV_SEQUENTIAL);
+        }
+    }
+
+    // Writes back the pages of a range that is no longer used and drops
+    // them from the resident set. The range is extended to page boundaries.
+    void Release(uint64_t offset, uint64_t size)
+    {
+        if (m_data == nullptr || size == 0)
+        {
+            return;
+        }
+
+        uint64_t page = sysconf(_SC_PAGESIZE);
+        uint64_t begin = offset / page * page;
+        uint64_t end = std::min(offset + size, m_size);
+
+        msync(m_data + begin, end - begin, MS_ASYNC);
+        madvise(m_data + begin, end - begin, MADV_DONTNEED);
+    }
+
+private:
+    void Map(int file, uint64_t size, int protection, int flags,
+             const std::string& path)
+    {
+        void* data = mmap(nullptr, size, protection, flags, file, 0);
+        close(file);
+        if (data == MAP_FAILED)
+        {
+            std::cerr << "Cannot map " << path << std::endl;
+            return;
+        }
+
+        m_data = static_cast<uint8_t*>(data);
+        m_size = size;
+    }
+
+private:
+    uint8_t* m_data;
+    uint64_t m_size;
+};
@@ -0,0 +1,317 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This example shows a parallel download of one generation from several
+// sources that hold the same data, as in a storage system or a CDN where a
+// client pulls from all replicas at once (see kodo-multi-source.h).
+//
+// Every source has a point-to-point link with its own erasure channel to
+// the decoder and encodes with its own coefficient seeds. The decoder
+// sends a stop packet to all sources when it has decoded. The topology is
+// the following:
+//
+//  +----------+  +----------+        +----------+
+//  | Source 1 |  | Source 2 |   ..   | Source M |
+//  +----+-----+  +----+-----+        +----+-----+
+//       |             |                   |
+//       | e, rate 1   | e, rate 2         | e, rate M
+//       |             |                   |
+//  +----v-------------v-------------------v-----+
+//  |                  Decoder                   |
+//  +--------------------------------------------+
+//
+// The link rates fall linearly from dataRate (source 1) to
+// dataRate * (1 - rateSpread) (source M). The rate of every source is
+// allocated with one of the following policies:
+//
+//   link:         every source sends at load times its link rate
+//   equal:        totalRate is split equally over the sources
+//   proportional: totalRate is split in proportion to the link rates
+//
+// With equal and proportional, a source never sends faster than load times
+// its link rate. By default, the download is run for 1 to M sources on the
+// same topology, and the completion time, the aggregated throughput, the
+// non-innovative packets (the duplicate-innovation overhead of the
+// uncoordinated sources) and the packets sent after decoding are printed
+// for every number of sources. A run that has not decoded after deadline
+// seconds is stopped, and the program fails if a run did not complete or
+// decoded wrong data:
+//
+// python waf --run kodo-multi-source --command-template="%s --sources=8
+// --field=binary --allocation=proportional --rateSpread=0.5"
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <ns3/core-module.h>
+#include <ns3/internet-module.h>
+#include <ns3/network-module.h>
+#include <ns3/point-to-point-module.h>
+
+#include "kodo-error-models.h"
+#include "kodo-multi-source.h"
+#include <kodo/finite_field.hpp>
+
+using namespace ns3;
+
+// Returns the rates (bits per second) of the first m sources
+static std::vector<double> AllocateRates(const std::string& allocation,
+                                         const std::vector<double>& linkRates,
+                                         uint32_t m, double load,
+                                         double totalRate)
+{
+    double capacity =
+        std::accumulate(linkRates.begin(), linkRates.begin() + m, 0.0);
+
+    std::vector<double> rates(m);
+    for (uint32_t k = 0; k < m; k++)
+    {
+        double limit = load * linkRates[k];
+        if (allocation == "equal")
+        {
+            rates[k] = std::min(totalRate / m, limit);
+        }
+        else if (allocation == "proportional")
+        {
+            rates[k] = std::min(totalRate * linkRates[k] / capacity, limit);
+        }
+        else
+        {
+            rates[k] = limit;
+        }
+    }
+    return rates;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t packetSize = 1400;    // Application bytes per packet
+    uint32_t generationSize = 64;  // RLNC generation size
+    std::string field = "binary8"; // Finite field used
+    uint32_t sources = 8;          // Number of sources
+    bool sweep = true;             // Run for 1 to sources sources
+    double errorRate = 0.1;        // Packet erasure rate of the links
+    uint32_t batchSize = 1;        // Coded packets encoded ahead
+    double deadline = 60.0;        // Seconds until a run is stopped
+
+    // Point-to-point links from the sources to the decoder: the rate (Mbps)
+    // of the first link, the relative rate decrease up to the last link and
+    // the delay (ms)
+    double dataRate = 2.0;
+    double rateSpread = 0.0;
+    double delay = 20.0;
+
+    // Rate allocation (link, equal or proportional), the share of its link
+    // rate that a source sends at most, and the total rate (Mbps) of the
+    // equal and proportional allocations
+    std::string allocation = "link";
+    double load = 0.9;
+    double totalRate = 4.0;
+
+    // Create a map for the field values
+    std::map<std::string, kodo::finite_field> fieldMap;
+    fieldMap["binary"] = kodo::finite_field::binary;
+    fieldMap["binary4"] = kodo::finite_field::binary4;
+    fieldMap["binary8"] = kodo::finite_field::binary8;
+    fieldMap["binary16"] = kodo::finite_field::binary16;
+
+    CommandLine cmd;
+
+    cmd.AddValue("packetSize", "Size of application packet sent", packetSize);
+    cmd.AddValue("generationSize", "Set the generation size to use",
+                 generationSize);
+    cmd.AddValue("field", "Finite field used", field);
+    cmd.AddValue("sources", "Number of sources", sources);
+    cmd.AddValue("sweep", "Run for 1 to sources sources", sweep);
+    cmd.AddValue("errorRate", "Packet erasure rate of the links", errorRate);
+    cmd.AddValue("batchSize", "Coded packets encoded ahead in one batch",
+                 batchSize);
+    cmd.AddValue("deadline", "Seconds until a run is stopped", deadline);
+    cmd.AddValue("dataRate", "Data rate (Mbps) of the first link", dataRate);
+    cmd.AddValue("rateSpread", "Relative rate decrease up to the last link",
+                 rateSpread);
+    cmd.AddValue("delay", "Delay (ms) of the links", delay);
+    cmd.AddValue("allocation", "Rate allocation (link, equal, proportional)",
+                 allocation);
+    cmd.AddValue("load", "Share of its link rate that a source sends at most",
+                 load);
+    cmd.AddValue("totalRate", "Total rate (Mbps) of equal and proportional",
+                 totalRate);
+
+    cmd.Parse(argc, argv);
+
+    // Use the binary8 field in case of errors
+    if (fieldMap.find(field) == fieldMap.end())
+    {
+        field = "binary8";
+    }
+    sources = std::max<uint32_t>(sources, 1);
+    NS_ABORT_MSG_IF(!(dataRate > 0.0), "The data rate must be positive");
+    NS_ABORT_MSG_IF(!(rateSpread >= 0.0 && rateSpread < 1.0),
+                    "The rate spread must be at least 0 and below 1, so "
+                    "that every link has a positive rate");
+    NS_ABORT_MSG_IF(!(load > 0.0), "The load must be positive");
+    NS_ABORT_MSG_IF(allocation != "link" && !(totalRate > 0.0),
+                    "The total rate must be positive");
+    NS_ABORT_MSG_IF(!(deadline > 0.0), "The deadline must be positive");
+
+    std::vector<double> linkRates(sources);
+    for (uint32_t k = 0; k < sources; k++)
+    {
+        double position = sources > 1 ? double(k) / (sources - 1) : 0.0;
+        linkRates[k] = dataRate * 1e6 * (1.0 - rateSpread * position);
+    }
+
+    NodeContainer sourceNodes;
+    sourceNodes.Create(sources);
+    Ptr<Node> decoderNode = CreateObject<Node>();
+
+    InternetStackHelper internet;
+    internet.Install(sourceNodes);
+    internet.Install(decoderNode);
+
+    // Every source has its own link to the decoder. The nodes only talk to
+    // their neighbors, so no routing is needed.
+    PointToPointHelper ptp;
+    ptp.SetChannelAttribute("Delay", TimeValue(MilliSeconds(delay)));
+    Ipv4AddressHelper ipv4("10.0.0.0", "255.255.255.252");
+
+    std::vector<Ptr<ErrorModel>> errorModels;
+    std::vector<Address> decoderAddresses(sources);
+    std::vector<Address> sourceAddresses(sources);
+    uint16_t port = 80;
+    for (uint32_t k = 0; k < sources; k++)
+    {
+        ptp.SetDeviceAttribute(
+            "DataRate",
+            StringValue(std::to_string(uint64_t(linkRates[k])) + "bps"));
+        NetDeviceContainer devices =
+            ptp.Install(sourceNodes.Get(k), decoderNode);
+        Ipv4InterfaceContainer interfaces = ipv4.Assign(devices);
+        ipv4.NewNetwork();
+
+        sourceAddresses[k] = InetSocketAddress(interfaces.GetAddress(0), port);
+        decoderAddresses[k] =
+            InetSocketAddress(interfaces.GetAddress(1), port);
+
+        // Only the coded packets to the decoder are lost
+        errorModels.push_back(CreateErrorModel("rate", errorRate, 1.0,
+                                               nullptr, k, sources));
+        devices.Get(1)->SetAttribute("ReceiveErrorModel",
+                                     PointerValue(errorModels.back()));
+    }
+
+    MultiSource download(fieldMap[field], generationSize, packetSize);
+
+    TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
+    InetSocketAddress local = InetSocketAddress(Ipv4Address::GetAny(), port);
+    for (uint32_t k = 0; k < sources; k++)
+    {
+        Ptr<Socket> socket = Socket::CreateSocket(sourceNodes.Get(k), tid);
+        socket->Bind(local);
+        download.AddSource(socket, decoderAddresses[k], sourceAddresses[k]);
+    }
+    Ptr<Socket> decoderSocket = Socket::CreateSocket(decoderNode, tid);
+    decoderSocket->Bind(local);
+    download.SetDecoder(decoderSocket);
+    download.SetBatchSize(batchSize);
+
+    std::cout << "Downloading " << download.GetBlockBytes() << " bytes ("
+              << generationSize << " symbols, " << field << ") with "
+              << allocation << " rate allocation" << std::endl;
+    std::cout << std::setw(8) << "sources" << std::setw(14) << "completion_s"
+              << std::setw(16) << "throughput_mbps" << std::setw(10)
+              << "received" << std::setw(16) << "non_innovative"
+              << std::setw(14) << "overhead_pct" << std::setw(8) << "late"
+              << std::endl;
+
+    // Every run uses the same loss patterns and seeds for the same links
+    uint32_t first = sweep ? 1 : sources;
+    uint32_t incomplete = 0;
+    uint32_t corrupted = 0;
+    for (uint32_t m = first; m <= sources; m++)
+    {
+        if (m > first)
+        {
+            download.Reset();
+        }
+        auto rates = AllocateRates(allocation, linkRates, m, load,
+                                   totalRate * 1e6);
+        for (uint32_t k = 0; k < m; k++)
+        {
+            download.SetRate(k, rates[k]);
+        }
+        for (uint32_t k = 0; k < sources; k++)
+        {
+            AssignErrorModelStreams(errorModels[k], k);
+        }
+        download.AssignStreams(sources);
+
+        download.Start(m, Seconds(1.0));
+        Simulator::Stop(Seconds(1.0 + deadline));
+        {
+            KODO_NS3_PROFILE(download.GetProfiler(), run);
+            Simulator::Run();
+        }
+
+        // The verifier is reset with every run
+        corrupted += download.GetVerifier().GetCorruptedCount();
+        if (!download.IsComplete())
+        {
+            std::cerr << "The download from " << m
+                      << " sources did not complete in " << deadline
+                      << " seconds" << std::endl;
+            incomplete++;
+            continue;
+        }
+
+        double seconds = download.GetCompletionTime().GetSeconds();
+        uint64_t received = download.GetReceivedCount();
+        uint64_t duplicates = received - generationSize;
+        std::cout << std::setw(8) << m << std::setw(14) << seconds
+                  << std::setw(16)
+                  << 8.0 * download.GetBlockBytes() / seconds / 1e6
+                  << std::setw(10) << received << std::setw(16) << duplicates
+                  << std::setw(14) << 100.0 * duplicates / generationSize
+                  << std::setw(8) << download.GetLateCount() << std::endl;
+    }
+
+    // The share of every source in the last run
+    download.Print(std::cout);
+    download.GetVerifier().Print(std::cout);
+
+    Simulator::Destroy();
+
+    // A download that did not complete or decoded wrong data fails the run
+    if (incomplete > 0)
+    {
+        std::cerr << incomplete << " downloads did not complete" << std::endl;
+    }
+    if (corrupted > 0)
+    {
+        std::cerr << corrupted << " decoded blocks failed the verification"
+                  << std::endl;
+    }
+    return incomplete == 0 && corrupted == 0 ? 0 : 1;
+}
@@ -0,0 +1,418 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This object implements a parallel download of one generation from
+// several sources that hold the same data.
+//
+// Every source has its own link to the decoder and encodes the block on
+// its own, with coefficient seeds drawn from its own random stream, so the
+// sources do not coordinate which packets they send. Every source sends at
+// its own rate. When the decoder has decoded, it sends a stop packet to
+// every source. The coded packets that are sent before the stop packet
+// arrives are late, and the packets that the decoder receives from the
+// sources but that are not innovative are the duplicate-innovation
+// overhead of the uncoordinated sources. Every packet starts with its type:
+//
+//   coded: [type][seed][symbol]
+//   stop:  [type]
+//
+// The sources are added once, and every run uses the first sources given
+// to Start, so the number of sources can be varied on the same topology.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <endian/big_endian.hpp>
+#include <kodo/block/encoder.hpp>
+#include <kodo/block/generator/random_uniform.hpp>
+#include <kodo/finite_field.hpp>
+
+#include "kodo-batch-encoder.h"
+#include "kodo-hash.h"
+#include "kodo-profiler.h"
+#include "kodo-small-decoder.h"
+#include "kodo-verifier.h"
+
+class MultiSource
+{
+public:
+    enum class Type : uint8_t
+    {
+        coded = 0,
+        stop
+    };
+
+    MultiSource(const kodo::finite_field field, const uint32_t generationSize,
+                const uint32_t packetSize) :
+        m_field(field),
+        m_generationSize(generationSize), m_packetSize(packetSize),
+        m_encoder(field), m_decoder(field), m_generator(field),
+        m_profiler("MultiSource")
+    {
+        // The header holds the packet type and the coefficient seed
+        NS_ABORT_MSG_IF(m_packetSize <= 1 + sizeof(uint32_t),
+                        "The packet size must exceed "
+                            << 1 + sizeof(uint32_t)
+                            << " bytes, the packet type and the seed");
+        NS_ABORT_MSG_IF(m_generationSize == 0,
+                        "The generation size must be positive");
+        m_symbolBytes = m_packetSize - 1 - sizeof(uint32_t);
+        m_payload.resize(m_packetSize);
+        m_generator.configure(m_generationSize);
+        m_coefficients.resize(m_generator.max_coefficients_bytes());
+
+        // All sources hold the same pseudo-random block, which the decoder
+        // verifies against its digest
+        m_encoder.configure(m_generationSize, m_symbolBytes);
+        m_encoderBuffer.resize(m_encoder.block_bytes());
+        FillPseudoRandom(m_encoderBuffer.data(), m_encoderBuffer.size(),
+                         ns3::RngSeedManager::GetRun());
+        m_encoder.set_symbols_storage(m_encoderBuffer.data());
+        m_digest =
+            m_verifier.Digest(m_encoderBuffer.data(), m_encoderBuffer.size());
+
+        m_decoder.configure(m_generationSize, m_symbolBytes);
+        m_decoderBuffer.resize(m_decoder.block_bytes());
+        m_activeSources = 0;
+        Reset();
+    }
+
+    // Adds a source that sends to the decoder address with the socket. The
+    // decoder sends the stop packet to the source address.
+    uint32_t AddSource(ns3::Ptr<ns3::Socket> socket, ns3::Address decoder,
+                       ns3::Address source)
+    {
+        uint32_t k = m_sources.size();
+        std::unique_ptr<Source> s(
+            new Source(m_field, m_encoder, m_packetSize, m_profiler));
+        s->socket = socket;
+        s->decoder = decoder;
+        s->address = source;
+        s->variable = ns3::CreateObject<ns3::UniformRandomVariable>();
+        s->interval = ns3::Seconds(1.0);
+
+        auto variable = s->variable;
+        s->batchEncoder.SetSeedSource([variable]() {
+            return variable->GetInteger(0,
+                                        std::numeric_limits<int32_t>::max());
+        });
+        s->batchEncoder.SetPrefixSize(1);
+        s->batchEncoder.SetBatchSize(1);
+
+        m_sources.push_back(std::move(s));
+        m_sourceAddresses[ns3::InetSocketAddress::ConvertFrom(source)
+                              .GetIpv4()] = k;
+        m_sourceSockets[socket] = k;
+        socket->SetRecvCallback(
+            ns3::MakeCallback(&MultiSource::ReceiveSource, this));
+        return k;
+    }
+
+    // Adds the decoder, which receives from all sources with the socket
+    void SetDecoder(ns3::Ptr<ns3::Socket> socket)
+    {
+        m_decoderSocket = socket;
+        socket->SetRecvCallback(
+            ns3::MakeCallback(&MultiSource::ReceiveDecoder, this));
+    }
+
+    // Sets the rate (bits per second) of the coded packets of source k
+    void SetRate(uint32_t k, double rate)
+    {
+        NS_ABORT_MSG_IF(!(rate > 0.0), "The rate of source "
+                                           << k << " must be positive");
+        m_sources[k]->rate = rate;
+        m_sources[k]->interval = ns3::Seconds(8.0 * m_packetSize / rate);
+    }
+
+    // Sets the number of packets that every source encodes ahead
+    void SetBatchSize(uint32_t batchSize)
+    {
+        for (auto& source : m_sources)
+        {
+            source->batchEncoder.SetBatchSize(batchSize);
+        }
+    }
+
+    // Assigns fixed streams to the random variables and returns the number
+    // of streams used. Source k uses stream + k.
+    int64_t AssignStreams(int64_t stream)
+    {
+        for (uint32_t k = 0; k < m_sources.size(); k++)
+        {
+            m_sources[k]->variable->SetStream(stream + k);
+        }
+        return m_sources.size();
+    }
+
+    // Resets the coding state to run again on the same topology, also after
+    // a run that was stopped before the decoder decoded
+    void Reset()
+    {
+        m_decoder.reset();
+        m_decoder.set_symbols_storage(m_decoderBuffer.data());
+        for (auto& source : m_sources)
+        {
+            source->sendEvent.Cancel();
+            source->batchEncoder.Clear();
+            source->stopped = false;
+            source->sent = 0;
+            source->received = 0;
+            source->innovative = 0;
+            source->late = 0;
+        }
+        m_received = 0;
+        m_completionTime = ns3::Seconds(0);
+        m_verifier.Reset();
+    }
+
+    // Schedules the transmissions of the first sources after the delay
+    void Start(uint32_t sources, ns3::Time delay)
+    {
+        m_activeSources = std::min<uint32_t>(sources, m_sources.size());
+        m_startTime = ns3::Simulator::Now() + delay;
+        for (uint32_t k = 0; k < m_activeSources; k++)
+        {
+            m_sources[k]->sendEvent = ns3::Simulator::ScheduleWithContext(
+                m_sources[k]->socket->GetNode()->GetId(), delay,
+                &MultiSource::SendSource, this, k);
+        }
+    }
+
+    uint64_t GetBlockBytes() const
+    {
+        return m_encoderBuffer.size();
+    }
+
+    uint32_t GetSourceCount() const
+    {
+        return m_sources.size();
+    }
+
+    bool IsComplete() const
+    {
+        return m_decoder.is_complete();
+    }
+
+    // Time from the start until the decoder decoded
+    ns3::Time GetCompletionTime() const
+    {
+        return m_completionTime - m_startTime;
+    }
+
+    // Coded packets that the decoder received until it decoded
+    uint64_t GetReceivedCount() const
+    {
+        return m_received;
+    }
+
+    // Coded packets that the sources sent after the decoder decoded
+    uint64_t GetLateCount() const
+    {
+        uint64_t late = 0;
+        for (const auto& source : m_sources)
+        {
+            late += source->late;
+        }
+        return late;
+    }
+
+    uint64_t GetTransmissionCount() const
+    {
+        uint64_t sent = 0;
+        for (const auto& source : m_sources)
+        {
+            sent += source->sent;
+        }
+        return sent;
+    }
+
+    const Verifier& GetVerifier() const
+    {
+        return m_verifier;
+    }
+
+    Profiler& GetProfiler()
+    {
+        return m_profiler;
+    }
+
+    // Prints the share of every active source
+    void Print(std::ostream& out) const
+    {
+        for (uint32_t k = 0; k < m_activeSources; k++)
+        {
+            const Source& source = *m_sources[k];
+            out << "Source " << k + 1 << ": " << source.rate / 1e6
+                << " Mbps, " << source.sent << " sent, " << source.received
+                << " received, " << source.innovative << " innovative, "
+                << source.late << " late" << std::endl;
+        }
+    }
+
+private:
+    struct Source
+    {
+        Source(const kodo::finite_field field, kodo::block::encoder& encoder,
+               const uint32_t packetSize, Profiler& profiler) :
+            batchEncoder(encoder, field, BatchEncoder::Header::seed,
+                         packetSize, profiler),
+            rate(0.0), stopped(false), sent(0), received(0), innovative(0),
+            late(0)
+        {
+        }
+
+        ns3::Ptr<ns3::Socket> socket;
+        ns3::Address decoder;
+        ns3::Address address;
+        BatchEncoder batchEncoder;
+        ns3::Ptr<ns3::UniformRandomVariable> variable;
+        double rate;
+        ns3::Time interval;
+        ns3::EventId sendEvent;
+        bool stopped;
+        uint64_t sent;
+        uint64_t received;
+        uint64_t innovative;
+        uint64_t late;
+    };
+
+    void SendSource(uint32_t k)
+    {
+        Source& source = *m_sources[k];
+        if (source.stopped)
+        {
+            return;
+        }
+
+        uint8_t* payload = source.batchEncoder.Next();
+        payload[0] = uint8_t(Type::coded);
+        {
+            KODO_NS3_PROFILE(m_profiler, packet);
+            source.socket->SendTo(
+                ns3::Create<ns3::Packet>(payload, m_packetSize), 0,
+                source.decoder);
+        }
+        source.sent++;
+        source.late += m_decoder.is_complete() ? 1 : 0;
+
+        source.sendEvent = ns3::Simulator::Schedule(
+            source.interval, &MultiSource::SendSource, this, k);
+    }
+
+    void ReceiveSource(ns3::Ptr<ns3::Socket> socket)
+    {
+        uint8_t type;
+        socket->Recv()->CopyData(&type, 1);
+        if (Type(type) == Type::stop)
+        {
+            m_sources[m_sourceSockets[socket]]->stopped = true;
+        }
+    }
+
+    void ReceiveDecoder(ns3::Ptr<ns3::Socket> socket)
+    {
+        ns3::Address from;
+        auto packet = socket->RecvFrom(from);
+        {
+            KODO_NS3_PROFILE(m_profiler, packet);
+            packet->CopyData(m_payload.data(), m_payload.size());
+        }
+        auto address = ns3::InetSocketAddress::ConvertFrom(from).GetIpv4();
+        Source& source = *m_sources[m_sourceAddresses[address]];
+
+        // Packets of a stopped run may arrive before the next run starts
+        if (m_decoder.is_complete() || ns3::Simulator::Now() < m_startTime)
+        {
+            return;
+        }
+        m_received++;
+        source.received++;
+
+        uint32_t seed = endian::big_endian::get<uint32_t>(m_payload.data() + 1);
+        {
+            KODO_NS3_PROFILE(m_profiler, coefficients);
+            m_generator.set_seed(seed);
+            m_generator.generate(m_coefficients.data());
+        }
+        uint32_t rank = m_decoder.rank();
+        {
+            KODO_NS3_PROFILE(m_profiler, decode);
+            m_decoder.decode_symbol(m_payload.data() + 1 + sizeof(uint32_t),
+                                    m_coefficients.data());
+        }
+        if (m_decoder.rank() == rank)
+        {
+            return;
+        }
+        source.innovative++;
+
+        if (m_decoder.is_complete())
+        {
+            m_completionTime = ns3::Simulator::Now();
+            if (!m_verifier.Verify(m_decoderBuffer.data(),
+                                   m_decoderBuffer.size(), m_digest))
+            {
+                std::cerr << "The decoder decoded wrong data" << std::endl;
+            }
+
+            // Stop all active sources
+            uint8_t type = uint8_t(Type::stop);
+            for (uint32_t k = 0; k < m_activeSources; k++)
+            {
+                m_decoderSocket->SendTo(ns3::Create<ns3::Packet>(&type, 1), 0,
+                                        m_sources[k]->address);
+            }
+        }
+    }
+
+private:
+    const kodo::finite_field m_field;
+    const uint32_t m_generationSize;
+    const uint32_t m_packetSize;
+    uint32_t m_symbolBytes;
+    std::vector<uint8_t> m_payload;
+
+    // The block held by all sources, which share the encoder
+    kodo::block::encoder m_encoder;
+    std::vector<uint8_t> m_encoderBuffer;
+    std::vector<std::unique_ptr<Source>> m_sources;
+    std::map<ns3::Ptr<ns3::Socket>, uint32_t> m_sourceSockets;
+    std::map<ns3::Ipv4Address, uint32_t> m_sourceAddresses;
+    uint32_t m_activeSources;
+
+    BlockDecoder m_decoder;
+    std::vector<uint8_t> m_decoderBuffer;
+    kodo::block::generator::random_uniform m_generator;
+    std::vector<uint8_t> m_coefficients;
+    ns3::Ptr<ns3::Socket> m_decoderSocket;
+    uint64_t m_digest;
+    Verifier m_verifier;
+
+    uint64_t m_received;
+    ns3::Time m_startTime;
+    ns3::Time m_completionTime;
+    Profiler m_profiler;
+};
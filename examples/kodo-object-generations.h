@@ -0,0 +1,166 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class splits the object of the Broadcast helper (see
+// kodo-broadcast.h) into generations of one block each.
+//
+// The object, e.g. a MappedFile, is encoded in place, and the receivers
+// with an output decode in place into it, so only the last generation,
+// when it is shorter than a block, is copied: the source encodes it from a
+// padded block, and the receivers decode it in the storage of their pool
+// decoder and copy it to their output when they complete. A callback is
+// called with the byte range of every generation that the source has
+// finished, e.g. to release its pages.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class ObjectGenerations
+{
+public:
+    // Called with the byte range of a generation of the object when the
+    // source has finished it
+    using GenerationCallback = std::function<void(
+        uint32_t generation, uint64_t offset, uint64_t size)>;
+
+    ObjectGenerations(const uint64_t blockBytes, const uint32_t users) :
+        m_blockBytes(blockBytes), m_object(nullptr), m_objectSize(0),
+        m_generations(0), m_generation(0), m_outputs(users, nullptr)
+    {
+    }
+
+    // Sets the object to send. The data must stay valid while sending.
+    void SetObject(const uint8_t* data, uint64_t size)
+    {
+        m_object = data;
+        m_objectSize = size;
+        m_generations = uint32_t((size + m_blockBytes - 1) / m_blockBytes);
+    }
+
+    // Sets the memory of the object size that receiver n decodes into
+    void SetOutput(uint32_t n, uint8_t* data)
+    {
+        m_outputs[n] = data;
+    }
+
+    void SetGenerationCallback(const GenerationCallback& callback)
+    {
+        m_callback = callback;
+    }
+
+    uint32_t GetGenerationCount() const
+    {
+        return m_generations;
+    }
+
+    uint64_t GetObjectSize() const
+    {
+        return m_objectSize;
+    }
+
+    uint32_t GetGeneration() const
+    {
+        return m_generation;
+    }
+
+    // Moves to a generation and returns the block to encode from
+    const uint8_t* Start(uint32_t generation)
+    {
+        m_generation = generation;
+        if (!IsShort())
+        {
+            return GetData();
+        }
+        m_tailBuffer.assign(m_blockBytes, 0);
+        std::copy_n(GetData(), GetSize(), m_tailBuffer.data());
+        return m_tailBuffer.data();
+    }
+
+    // Ends the current generation at the source
+    void End() const
+    {
+        if (m_callback)
+        {
+            m_callback(m_generation, GetOffset(), GetSize());
+        }
+    }
+
+    // Returns the bytes of the object in the current generation
+    const uint8_t* GetData() const
+    {
+        return m_object + GetOffset();
+    }
+
+    uint64_t GetSize() const
+    {
+        return std::min<uint64_t>(m_blockBytes, m_objectSize - GetOffset());
+    }
+
+    // Returns the memory that receiver n decodes the current generation
+    // into in place, or nullptr if it decodes in its pool storage
+    uint8_t* GetOutput(uint32_t n) const
+    {
+        if (m_outputs[n] == nullptr || IsShort())
+        {
+            return nullptr;
+        }
+        return m_outputs[n] + GetOffset();
+    }
+
+    // Returns the block that receiver n decoded, given its pool storage
+    const uint8_t* GetBlock(uint32_t n, const uint8_t* storage) const
+    {
+        uint8_t* output = GetOutput(n);
+        return output != nullptr ? output : storage;
+    }
+
+    // Copies a short last generation decoded by receiver n from its pool
+    // storage to its output
+    void Complete(uint32_t n, const uint8_t* storage) const
+    {
+        if (m_outputs[n] != nullptr && IsShort())
+        {
+            std::copy_n(storage, GetSize(), m_outputs[n] + GetOffset());
+        }
+    }
+
+private:
+    uint64_t GetOffset() const
+    {
+        return uint64_t(m_generation) * m_blockBytes;
+    }
+
+    bool IsShort() const
+    {
+        return GetSize() < m_blockBytes;
+    }
+
+private:
+    const uint64_t m_blockBytes;
+    const uint8_t* m_object;
+    uint64_t m_objectSize;
+    uint32_t m_generations;
+    uint32_t m_generation;
+    std::vector<uint8_t*> m_outputs;
+    std::vector<uint8_t> m_tailBuffer;
+    GenerationCallback m_callback;
+};
@@ -0,0 +1,124 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class keeps the burst of the current generation of an open-loop
+// source for the Broadcast helper (see kodo-broadcast.h).
+//
+// With a RedundancyController (see kodo-redundancy.h), the source sends a
+// burst of the size given by the controller for every generation and moves
+// on without waiting for the receivers. The packets of the burst that every
+// receiver got are counted, and the outcome of the generation is passed to
+// the controller at its end. Without a controller, the source is
+// closed-loop and this class does not limit the frames.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "kodo-redundancy.h"
+
+class OpenLoopSource
+{
+public:
+    OpenLoopSource(const uint32_t users) :
+        m_controller(nullptr), m_received(users, 0)
+    {
+        StartGeneration();
+    }
+
+    // Makes the source open-loop with the burst sizes of the controller
+    void SetController(RedundancyController* controller)
+    {
+        m_controller = controller;
+    }
+
+    bool IsEnabled() const
+    {
+        return m_controller != nullptr;
+    }
+
+    void StartGeneration()
+    {
+        m_transmissions = 0;
+        m_burstSize = 0;
+        std::fill(m_received.begin(), m_received.end(), 0);
+    }
+
+    // Returns true when the burst of the current generation has been sent
+    bool IsBurstDone() const
+    {
+        return m_controller != nullptr && m_burstSize > 0 &&
+               m_transmissions == m_burstSize;
+    }
+
+    // Returns how many of the given symbols the next frame carries, so a
+    // frame ends with the burst. The controller chooses the burst size
+    // before the first frame of a generation.
+    uint32_t GetFrameSymbols(uint32_t symbols)
+    {
+        if (m_controller == nullptr)
+        {
+            return symbols;
+        }
+        if (m_transmissions == 0)
+        {
+            m_burstSize = m_controller->GetBurstSize();
+        }
+        return std::min(symbols, m_burstSize - m_transmissions);
+    }
+
+    void Transmit(uint32_t symbols)
+    {
+        m_transmissions += symbols;
+    }
+
+    // Counts a packet of the current generation received by receiver n
+    void Receive(uint32_t n)
+    {
+        m_received[n]++;
+    }
+
+    // Passes the outcome of the generation to the controller
+    void EndGeneration(const std::vector<bool>& decoded)
+    {
+        if (m_controller != nullptr)
+        {
+            m_controller->EndGeneration(m_transmissions, m_received, decoded);
+        }
+    }
+
+    void Print(std::ostream& out) const
+    {
+        if (m_controller != nullptr)
+        {
+            m_controller->Print(out);
+        }
+    }
+
+private:
+    RedundancyController* m_controller;
+
+    // Packets of the current generation sent and received by every
+    // receiver, and the burst size
+    uint32_t m_transmissions;
+    std::vector<uint32_t> m_received;
+    uint32_t m_burstSize;
+};
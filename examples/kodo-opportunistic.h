@@ -0,0 +1,513 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class implements opportunistic RLNC on a broadcast medium, where
+// every receiver is also a recoder for the receivers that are behind it.
+//
+// Node 0 is the source and nodes 1 to N are the receivers. All nodes hear
+// each other's transmissions. In every slot, a scheduler at the source
+// picks the node that transmits: the source sends a coded packet and a
+// receiver sends a packet recoded from what it has decoded so far. The
+// scheduler chooses the node with the highest expected number of
+// innovative receptions,
+//
+//   sum over receivers j of q(i, j) * [rank(i) > rank(j)],
+//
+// where the ranks are the ones last advertised to the source and q(i, j)
+// is the delivery ratio of the link from i to j estimated from the
+// reception counters of j. The grant of a slot to a receiver is not
+// modelled as a frame.
+//
+// Every packet starts with a type, the index of the sender and its rank:
+//
+//   data:          [type][sender][rank][coefficients][symbol]
+//   advertisement: [type][sender][rank][packets received from node 0..N]
+//
+// With overhearing enabled, a receiver advertises its rank whenever it
+// grows. Without overhearing, the source is the only transmitter and the
+// receivers never advertise, which is the source-only broadcast of the
+// Broadcast helper with the same packet format.
+//
+// The source encodes its packets ahead in batches (see kodo-batch-encoder.h)
+// with its own generator, the receivers draw their recoding coefficients
+// from another one. The coding metrics have a receiver and a link for every
+// receiver; every data packet is offered to all receivers but its sender.
+// Every decoded block is verified against the digest of the source block
+// (see kodo-verifier.h).
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <endian/big_endian.hpp>
+#include <kodo/block/decoder.hpp>
+#include <kodo/block/encoder.hpp>
+#include <kodo/block/generator/random_uniform.hpp>
+#include <kodo/finite_field.hpp>
+
+#include "kodo-batch-encoder.h"
+#include "kodo-coding-metrics.h"
+#include "kodo-hash.h"
+#include "kodo-profiler.h"
+#include "kodo-verifier.h"
+
+class Opportunistic
+{
+public:
+    Opportunistic(const kodo::finite_field field,
+                  const uint32_t generationSize, const uint32_t packetSize,
+                  const std::vector<ns3::Ptr<ns3::Socket>>& sockets) :
+        m_field(field),
+        m_generationSize(generationSize), m_packetSize(packetSize),
+        m_sockets(sockets), m_nodes(sockets.size()), m_encoder(field),
+        m_generator(field), m_overhearing(true),
+        m_metrics(generationSize), m_profiler("Opportunistic"),
+        m_batchEncoder(m_encoder, field, BatchEncoder::Header::coefficients,
+                       packetSize, m_profiler),
+        m_trials(0), m_totalSent(0), m_totalRecoded(0),
+        m_totalAdvertisements(0)
+    {
+        // The sender index is a single byte
+        NS_ABORT_MSG_IF(m_nodes > 256, "The Opportunistic helper supports "
+                                           << "at most 256 nodes, not "
+                                           << m_nodes);
+
+        m_generator.configure(m_generationSize);
+        m_coefficientsBytes = m_generator.max_coefficients_bytes();
+        m_advertisementSize = m_headerSize + 2 * m_nodes;
+
+        // Data packets and advertisements share the payload buffer
+        NS_ABORT_MSG_IF(m_packetSize <= m_headerSize + m_coefficientsBytes,
+                        "The packet size must exceed "
+                            << m_headerSize + m_coefficientsBytes
+                            << " bytes, the header and the coefficients");
+        NS_ABORT_MSG_IF(m_packetSize < m_advertisementSize,
+                        "The packet size must be at least "
+                            << m_advertisementSize << " bytes to advertise "
+                            << "the reception counters of " << m_nodes
+                            << " nodes");
+        m_symbolBytes = m_packetSize - m_headerSize - m_coefficientsBytes;
+
+        // The source holds a pseudo-random block, which the receivers verify
+        // against its digest
+        m_encoder.configure(m_generationSize, m_symbolBytes);
+        m_encoderBuffer.resize(m_encoder.block_bytes());
+        FillPseudoRandom(m_encoderBuffer.data(), m_encoderBuffer.size(),
+                         ns3::RngSeedManager::GetRun());
+        m_encoder.set_symbols_storage(m_encoderBuffer.data());
+        m_digest =
+            m_verifier.Digest(m_encoderBuffer.data(), m_encoderBuffer.size());
+
+        // The source has no decoder, decoder n - 1 belongs to node n
+        for (uint32_t n = 1; n < m_nodes; n++)
+        {
+            m_decoders.emplace_back(m_field);
+            m_decoders.back().configure(m_generationSize, m_symbolBytes);
+            m_decoderBuffers.emplace_back(m_decoders.back().block_bytes());
+
+            std::string decoder = "decoder-" + std::to_string(n);
+            m_metrics.AddReceiver(decoder);
+            m_metrics.AddLink("medium-" + decoder, false);
+        }
+
+        m_payload.resize(m_packetSize);
+        m_coefficients.resize(m_coefficientsBytes);
+
+        m_seedVariable = ns3::CreateObject<ns3::UniformRandomVariable>();
+        m_batchEncoder.SetPrefixSize(m_headerSize);
+        m_batchEncoder.SetBatchSize(1);
+        Reset();
+    }
+
+    void SetOverhearing(bool overhearing)
+    {
+        m_overhearing = overhearing;
+    }
+
+    // Sets the number of packets that the source encodes ahead
+    void SetBatchSize(uint32_t batchSize)
+    {
+        m_batchEncoder.SetBatchSize(batchSize);
+    }
+
+    // Assigns a fixed stream to the random variable of this helper and
+    // returns the number of streams used
+    int64_t AssignStreams(int64_t stream)
+    {
+        m_seedVariable->SetStream(stream);
+        return 1;
+    }
+
+    const Verifier& GetVerifier() const
+    {
+        return m_verifier;
+    }
+
+    const CodingMetrics& GetMetrics() const
+    {
+        return m_metrics;
+    }
+
+    Profiler& GetProfiler()
+    {
+        return m_profiler;
+    }
+
+    // Coded and recoded packets sent by all nodes
+    uint32_t GetTransmissionCount() const
+    {
+        uint32_t count = 0;
+        for (auto sent : m_sent)
+        {
+            count += sent;
+        }
+        return count;
+    }
+
+    uint32_t GetRecodedCount() const
+    {
+        return GetTransmissionCount() - m_sent[0];
+    }
+
+    uint32_t GetAdvertisementCount() const
+    {
+        return m_advertisements;
+    }
+
+    // Time from the first transmission until the last receiver decoded, or
+    // zero if not all receivers decoded in this trial
+    ns3::Time GetCompletionTime() const
+    {
+        if (m_completion < m_firstTransmission)
+        {
+            return ns3::Seconds(0);
+        }
+        return m_completion - m_firstTransmission;
+    }
+
+    // Resets the coding state to run another trial on the same topology.
+    // The metrics and the totals of PrintSummary keep accumulating over all
+    // trials.
+    void Reset()
+    {
+        for (uint32_t n = 0; n < m_decoders.size(); n++)
+        {
+            m_decoders[n].reset();
+            m_decoders[n].set_symbols_storage(m_decoderBuffers[n].data());
+        }
+
+        m_sent.assign(m_nodes, 0);
+        m_receivedFrom.assign(m_nodes, std::vector<uint32_t>(m_nodes, 0));
+        m_advertisedRank.assign(m_nodes, 0);
+        m_advertisedRank[0] = m_generationSize;
+        m_advertisedReceived.assign(m_nodes,
+                                    std::vector<uint32_t>(m_nodes, 0));
+        m_advertisements = 0;
+        m_seeded = false;
+        m_firstTransmission = ns3::Seconds(0);
+        m_completion = ns3::Seconds(0);
+        m_batchEncoder.Clear();
+        if (m_trials > 0)
+        {
+            m_metrics.StartTrial();
+        }
+    }
+
+    // Prints the mean packet counts over the completed trials, once after
+    // the last trial
+    void PrintSummary(std::ostream& out) const
+    {
+        double trials = std::max<uint32_t>(m_trials, 1);
+        out << "Opportunistic (" << (m_overhearing ? "overhearing" : "source")
+            << "): " << m_trials << " trials, mean data packets "
+            << m_totalSent / trials << " (" << m_totalRecoded / trials
+            << " recoded), mean advertisements "
+            << m_totalAdvertisements / trials << std::endl;
+        m_verifier.Print(out);
+    }
+
+    // Runs the scheduler of the source every interval until all receivers
+    // have decoded
+    void Slot(ns3::Time interval)
+    {
+        if (AllDecoded())
+        {
+            m_trials++;
+            m_totalSent += GetTransmissionCount();
+            m_totalRecoded += GetRecodedCount();
+            m_totalAdvertisements += m_advertisements;
+            std::cout << "Decoding completed! Data packets: "
+                      << GetTransmissionCount() << " (" << GetRecodedCount()
+                      << " recoded), advertisements: " << m_advertisements
+                      << std::endl;
+            return;
+        }
+
+        // The source and the recoders draw their coefficients with their
+        // own generators
+        if (!m_seeded)
+        {
+            m_firstTransmission = ns3::Simulator::Now();
+            m_batchEncoder.SetSeed(m_seedVariable->GetInteger(
+                0, std::numeric_limits<int32_t>::max()));
+            m_generator.set_seed(m_seedVariable->GetInteger(
+                0, std::numeric_limits<int32_t>::max()));
+            m_seeded = true;
+        }
+
+        uint32_t node = m_overhearing ? Schedule() : 0;
+        ns3::Simulator::ScheduleWithContext(
+            m_sockets[node]->GetNode()->GetId(), ns3::Seconds(0),
+            &Opportunistic::SendData, this, node);
+
+        ns3::Simulator::Schedule(interval, &Opportunistic::Slot, this,
+                                 interval);
+    }
+
+    void ReceivePacket(ns3::Ptr<ns3::Socket> socket)
+    {
+        auto it = std::find(m_sockets.begin(), m_sockets.end(), socket);
+        uint32_t n = std::distance(m_sockets.begin(), it);
+
+        auto packet = socket->Recv();
+        {
+            KODO_NS3_PROFILE(m_profiler, packet);
+            packet->CopyData(m_payload.data(),
+                             std::min<uint32_t>(packet->GetSize(),
+                                                m_payload.size()));
+        }
+
+        uint8_t type = m_payload[0];
+        uint32_t sender = m_payload[1];
+        uint32_t rank = endian::big_endian::get<uint32_t>(&m_payload[2]);
+
+        // The source keeps the view of the scheduler
+        if (n == 0)
+        {
+            m_advertisedRank[sender] = rank;
+            if (type == m_advertisementType)
+            {
+                for (uint32_t i = 0; i < m_nodes; i++)
+                {
+                    m_advertisedReceived[sender][i] =
+                        endian::big_endian::get<uint16_t>(
+                            &m_payload[m_headerSize + 2 * i]);
+                }
+            }
+            return;
+        }
+
+        if (type != m_dataType)
+        {
+            return;
+        }
+
+        m_receivedFrom[n][sender]++;
+        m_metrics.Deliver(n - 1);
+        auto& decoder = m_decoders[n - 1];
+        if (decoder.is_complete())
+        {
+            m_metrics.Receive(n - 1, m_generationSize, m_generationSize);
+            return;
+        }
+
+        uint32_t oldRank = decoder.rank();
+        {
+            KODO_NS3_PROFILE(m_profiler, decode);
+            decoder.decode_symbol(m_payload.data() + m_headerSize +
+                                      m_coefficientsBytes,
+                                  m_payload.data() + m_headerSize);
+        }
+        m_metrics.Receive(n - 1, oldRank, decoder.rank());
+
+        if (decoder.is_complete() &&
+            !m_verifier.Verify(m_decoderBuffers[n - 1].data(),
+                               m_decoderBuffers[n - 1].size(), m_digest))
+        {
+            std::cerr << "Decoder " << n << " decoded wrong data" << std::endl;
+        }
+
+        if (decoder.is_complete() && AllDecoded())
+        {
+            m_completion = ns3::Simulator::Now();
+        }
+        if (m_overhearing && decoder.rank() > oldRank)
+        {
+            SendAdvertisement(n);
+        }
+    }
+
+private:
+    bool AllDecoded() const
+    {
+        return std::all_of(m_decoders.begin(), m_decoders.end(),
+                           [](const kodo::block::decoder& decoder) {
+                               return decoder.is_complete();
+                           });
+    }
+
+    uint32_t Rank(uint32_t node) const
+    {
+        return node == 0 ? m_generationSize : m_decoders[node - 1].rank();
+    }
+
+    // Returns the node with the highest expected number of innovative
+    // receptions in the view of the source. Ties go to the source.
+    uint32_t Schedule() const
+    {
+        uint32_t best = 0;
+        double bestScore = -1.0;
+
+        for (uint32_t i = 0; i < m_nodes; i++)
+        {
+            double score = 0.0;
+            for (uint32_t j = 1; j < m_nodes; j++)
+            {
+                if (j == i || m_advertisedRank[i] <= m_advertisedRank[j])
+                {
+                    continue;
+                }
+                // Delivery ratio with a uniform prior for unused links
+                score += (m_advertisedReceived[j][i] + 1.0) / (m_sent[i] + 2.0);
+            }
+            if (score > bestScore)
+            {
+                best = i;
+                bestScore = score;
+            }
+        }
+        return best;
+    }
+
+    void SendData(uint32_t node)
+    {
+        uint8_t* payload = m_payload.data();
+        if (node == 0)
+        {
+            payload = m_batchEncoder.Next();
+        }
+        else
+        {
+            auto& decoder = m_decoders[node - 1];
+            {
+                KODO_NS3_PROFILE(m_profiler, coefficients);
+                m_generator.generate_recode(m_coefficients.data(), decoder);
+            }
+            KODO_NS3_PROFILE(m_profiler, recode);
+            decoder.recode_symbol(payload + m_headerSize + m_coefficientsBytes,
+                                  payload + m_headerSize,
+                                  m_coefficients.data());
+        }
+
+        WriteHeader(payload, m_dataType, node);
+        m_sent[node]++;
+        m_metrics.Transmit();
+        for (uint32_t n = 1; n < m_nodes; n++)
+        {
+            if (n != node)
+            {
+                m_metrics.Offer(n - 1);
+            }
+        }
+        Send(node, payload, m_packetSize);
+    }
+
+    void SendAdvertisement(uint32_t node)
+    {
+        WriteHeader(m_payload.data(), m_advertisementType, node);
+        for (uint32_t i = 0; i < m_nodes; i++)
+        {
+            uint16_t received = std::min<uint32_t>(
+                m_receivedFrom[node][i], std::numeric_limits<uint16_t>::max());
+            endian::big_endian::put(received,
+                                    &m_payload[m_headerSize + 2 * i]);
+        }
+        m_advertisements++;
+        Send(node, m_payload.data(), m_advertisementSize);
+    }
+
+    void WriteHeader(uint8_t* payload, uint8_t type, uint32_t node)
+    {
+        payload[0] = type;
+        payload[1] = uint8_t(node);
+        endian::big_endian::put<uint32_t>(Rank(node), payload + 2);
+    }
+
+    void Send(uint32_t node, const uint8_t* payload, uint32_t size)
+    {
+        KODO_NS3_PROFILE(m_profiler, packet);
+        auto packet = ns3::Create<ns3::Packet>(payload, size);
+        m_sockets[node]->Send(packet);
+    }
+
+    const kodo::finite_field m_field;
+    const uint32_t m_generationSize;
+    const uint32_t m_packetSize;
+    const uint32_t m_headerSize = 6;
+    const uint8_t m_dataType = 0;
+    const uint8_t m_advertisementType = 1;
+
+    std::vector<ns3::Ptr<ns3::Socket>> m_sockets;
+    const uint32_t m_nodes;
+
+    uint32_t m_coefficientsBytes;
+    uint32_t m_symbolBytes;
+    uint32_t m_advertisementSize;
+
+    kodo::block::encoder m_encoder;
+    std::vector<uint8_t> m_encoderBuffer;
+    uint64_t m_digest;
+    Verifier m_verifier;
+    std::vector<kodo::block::decoder> m_decoders;
+    std::vector<std::vector<uint8_t>> m_decoderBuffers;
+
+    std::vector<uint8_t> m_payload;
+    kodo::block::generator::random_uniform m_generator;
+    std::vector<uint8_t> m_coefficients;
+    ns3::Ptr<ns3::UniformRandomVariable> m_seedVariable;
+    bool m_seeded;
+    bool m_overhearing;
+
+    // Data packets sent by every node and packets received by every node
+    // from every other node
+    std::vector<uint32_t> m_sent;
+    std::vector<std::vector<uint32_t>> m_receivedFrom;
+
+    // The view of the scheduler at the source
+    std::vector<uint32_t> m_advertisedRank;
+    std::vector<std::vector<uint32_t>> m_advertisedReceived;
+
+    uint32_t m_advertisements;
+    ns3::Time m_firstTransmission;
+    ns3::Time m_completion;
+
+    CodingMetrics m_metrics;
+    Profiler m_profiler;
+    BatchEncoder m_batchEncoder;
+
+    // Totals over the completed trials
+    uint32_t m_trials;
+    uint64_t m_totalSent;
+    uint64_t m_totalRecoded;
+    uint64_t m_totalAdvertisements;
+};
@@ -0,0 +1,247 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Scoped wall-clock timers for the hot paths of the coding helpers.
+//
+// The timers are compiled out unless KODO_NS3_PROFILING is defined, e.g.
+// by configuring ns-3 with CXXFLAGS="-DKODO_NS3_PROFILING". When enabled,
+// every timed scope adds one steady_clock sample to the statistics of its
+// phase and the Profiler prints a per-phase breakdown (total time, calls,
+// ns/call, minimum, maximum and percentiles) when it is destroyed at the
+// end of the program. The "run" phase is meant to cover Simulator::Run(),
+// so the time that is not spent in any of the coding phases is the
+// simulator overhead.
+//
+// The samples are not kept: every phase has a count, a sum, a minimum, a
+// maximum and a fixed log-linear histogram with 8 buckets per power of
+// two, so the memory does not grow with the length of the run and the
+// percentiles are within 1/16 of the measured value.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+enum class ProfilerPhase : uint32_t
+{
+    coefficients = 0,
+    encode,
+    decode,
+    recode,
+    packet,
+    filter,
+    run,
+    count
+};
+
+#ifdef KODO_NS3_PROFILING
+
+class Profiler
+{
+public:
+    Profiler(const std::string& name) :
+        m_name(name), m_phases(uint32_t(ProfilerPhase::count))
+    {
+    }
+
+    ~Profiler()
+    {
+        Print(std::cout);
+    }
+
+    void Add(ProfilerPhase phase, uint64_t ns)
+    {
+        m_phases[uint32_t(phase)].Add(ns);
+    }
+
+    void Print(std::ostream& out)
+    {
+        static const char* names[] = {"coefficients", "encode", "decode",
+                                      "recode",       "packet", "filter",
+                                      "run"};
+
+        uint64_t coding = 0;
+        uint64_t run = m_phases[uint32_t(ProfilerPhase::run)].sum;
+
+        out << "Profile: " << m_name << std::endl;
+        out << std::left << std::setw(14) << "phase" << std::right
+            << std::setw(14) << "total [ns]" << std::setw(10) << "calls"
+            << std::setw(10) << "ns/call" << std::setw(10) << "min"
+            << std::setw(10) << "p50" << std::setw(10) << "p90"
+            << std::setw(10) << "p99" << std::setw(12) << "max" << std::endl;
+
+        for (uint32_t phase = 0; phase < m_phases.size(); phase++)
+        {
+            const auto& stats = m_phases[phase];
+            if (stats.count == 0)
+            {
+                continue;
+            }
+
+            if (phase != uint32_t(ProfilerPhase::run))
+            {
+                coding += stats.sum;
+            }
+
+            out << std::left << std::setw(14) << names[phase] << std::right
+                << std::setw(14) << stats.sum << std::setw(10) << stats.count
+                << std::setw(10) << stats.sum / stats.count << std::setw(10)
+                << stats.min << std::setw(10) << stats.Percentile(0.50)
+                << std::setw(10) << stats.Percentile(0.90) << std::setw(10)
+                << stats.Percentile(0.99) << std::setw(12) << stats.max
+                << std::endl;
+        }
+
+        if (run > coding)
+        {
+            out << std::left << std::setw(14) << "simulator" << std::right
+                << std::setw(14) << run - coding << std::endl;
+        }
+    }
+
+private:
+    // Streaming statistics of the samples of one phase. Values below 8 ns
+    // have their own bucket, and every power of two above is split into 8
+    // linear buckets.
+    struct PhaseStats
+    {
+        static const uint32_t buckets = 8 + 61 * 8;
+
+        PhaseStats() :
+            count(0), sum(0), min(std::numeric_limits<uint64_t>::max()),
+            max(0)
+        {
+            histogram.fill(0);
+        }
+
+        void Add(uint64_t ns)
+        {
+            count++;
+            sum += ns;
+            min = std::min(min, ns);
+            max = std::max(max, ns);
+            histogram[Bucket(ns)]++;
+        }
+
+        // Returns the middle of the bucket of the p-quantile, within the
+        // measured range
+        uint64_t Percentile(double p) const
+        {
+            uint64_t rank = uint64_t(p * (count - 1));
+            uint64_t seen = 0;
+            for (uint32_t i = 0; i < buckets; i++)
+            {
+                seen += histogram[i];
+                if (seen > rank)
+                {
+                    uint64_t middle = Lower(i) + Width(i) / 2;
+                    return std::min(std::max(middle, min), max);
+                }
+            }
+            return max;
+        }
+
+        static uint32_t Bucket(uint64_t ns)
+        {
+            if (ns < 8)
+            {
+                return uint32_t(ns);
+            }
+            uint32_t exponent = 63 - __builtin_clzll(ns);
+            uint32_t sub = (ns >> (exponent - 3)) & 7;
+            return 8 + (exponent - 3) * 8 + sub;
+        }
+
+        static uint64_t Lower(uint32_t bucket)
+        {
+            if (bucket < 8)
+            {
+                return bucket;
+            }
+            uint32_t exponent = (bucket - 8) / 8 + 3;
+            return (8 + (bucket - 8) % 8) << (exponent - 3);
+        }
+
+        static uint64_t Width(uint32_t bucket)
+        {
+            return bucket < 8 ? 1 : uint64_t(1) << ((bucket - 8) / 8);
+        }
+
+        uint64_t count;
+        uint64_t sum;
+        uint64_t min;
+        uint64_t max;
+        std::array<uint64_t, buckets> histogram;
+    };
+
+private:
+    std::string m_name;
+    std::vector<PhaseStats> m_phases;
+};
+
+class ScopedTimer
+{
+public:
+    ScopedTimer(Profiler& profiler, ProfilerPhase phase) :
+        m_profiler(profiler), m_phase(phase),
+        m_start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~ScopedTimer()
+    {
+        auto elapsed = std::chrono::steady_clock::now() - m_start;
+        m_profiler.Add(
+            m_phase,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                .count());
+    }
+
+private:
+    Profiler& m_profiler;
+    ProfilerPhase m_phase;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#define KODO_NS3_CONCAT_(a, b) a##b
+#define KODO_NS3_CONCAT(a, b) KODO_NS3_CONCAT_(a, b)
+#define KODO_NS3_PROFILE(profiler, phase)                                      \
+    ScopedTimer KODO_NS3_CONCAT(kodoNs3Timer, __LINE__)(profiler,              \
+                                                        ProfilerPhase::phase)
+
+#else
+
+// Empty stand-in so that the helpers can keep a Profiler member
+class Profiler
+{
+public:
+    Profiler(const std::string&)
+    {
+    }
+};
+
+#define KODO_NS3_PROFILE(profiler, phase)
+
+#endif
@@ -0,0 +1,440 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This example runs the topology of kodo-recoders (an encoder, N recoders
+// and a decoder) on the distributed simulator of ns-3, so large numbers of
+// recoders are simulated on several cores with MPI.
+//
+// Every rank simulates a part of the nodes and only holds their coding
+// state (see kodo-distributed-recoders.h). The encoder is on the first
+// rank and the decoder on the last one. Both handle one packet per recoder
+// and slot, so the recoders are split in contiguous blocks over the ranks
+// such that every rank gets about the same number of packets per slot,
+// including the encoder and decoder packets. A rank whose encoder or
+// decoder packets alone exceed that share gets no recoders, and the share
+// is computed again over the other ranks. The links are point-to-point
+// links with the given delay, which is the lookahead of the distributed
+// simulator: a short delay synchronizes the ranks more often, and the
+// delay must be positive.
+//
+// At the end, the statistics of all ranks are merged on the first rank,
+// which prints the transmissions, the decoding result, the wall time of
+// the slowest rank and the peak resident set and coding state per rank.
+//
+// ns-3 must be configured with --enable-mpi. Example on a single machine
+// with 8 cores (from the ns-3 folder):
+//
+// mpirun -np 8 build/examples/kodo/ns3.30-kodo-recoders-mpi-debug
+// --recoders=4000 --generationSize=16 --field=binary8
+//
+// The speedup from 1 to 16 ranks is measured by kodo-benchmark with
+// --mpiRanks=1,2,4,8,16.
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ns3/core-module.h>
+#include <ns3/internet-module.h>
+#include <ns3/mpi-interface.h>
+#include <ns3/network-module.h>
+#include <ns3/point-to-point-module.h>
+
+#ifdef NS3_MPI
+#include <mpi.h>
+#endif
+
+#include "kodo-distributed-recoders.h"
+#include "kodo-error-models.h"
+#include <kodo/finite_field.hpp>
+
+using namespace ns3;
+
+#ifdef NS3_MPI
+
+// Returns the rank of every recoder. The packets per slot are about one
+// per recoder at the encoder, transmitProbability per recoder at the
+// decoder and 1 + transmitProbability at every recoder.
+static std::vector<uint32_t> PartitionRecoders(uint32_t recoders,
+                                               uint32_t ranks,
+                                               double transmitProbability)
+{
+    std::vector<double> load(ranks, 0.0);
+    load[0] += recoders;
+    load[ranks - 1] += recoders * transmitProbability;
+    double recoderLoad = 1.0 + transmitProbability;
+
+    // The target is the mean load of the ranks that get recoders. A rank
+    // above the target gets none, and the target is computed again over
+    // the remaining ranks and all recoders until no rank is above it.
+    std::vector<bool> full(ranks, false);
+    double target = 0.0;
+    for (bool changed = true; changed;)
+    {
+        double total = recoders * recoderLoad;
+        uint32_t count = 0;
+        for (uint32_t rank = 0; rank < ranks; rank++)
+        {
+            if (!full[rank])
+            {
+                total += load[rank];
+                count++;
+            }
+        }
+        target = total / count;
+
+        changed = false;
+        for (uint32_t rank = 0; rank < ranks; rank++)
+        {
+            if (!full[rank] && load[rank] > target)
+            {
+                full[rank] = true;
+                changed = true;
+            }
+        }
+    }
+
+    // Fill the other ranks up to the target in order, the last one takes
+    // the rest
+    uint32_t last = ranks - 1;
+    while (full[last])
+    {
+        last--;
+    }
+
+    std::vector<uint32_t> partition(recoders);
+    uint32_t n = 0;
+    for (uint32_t rank = 0; rank <= last; rank++)
+    {
+        while (!full[rank] && n < recoders &&
+               (rank == last || load[rank] + recoderLoad / 2 <= target))
+        {
+            partition[n++] = rank;
+            load[rank] += recoderLoad;
+        }
+    }
+    return partition;
+}
+
+#endif
+
+int main(int argc, char* argv[])
+{
+#ifdef NS3_MPI
+    uint32_t packetSize = 1000;           // Application bytes per packet
+    double interval = 0.01;               // Time between events
+    uint32_t generationSize = 16;         // RLNC generation size
+    double errorRateEncoderRecoder = 0.4; // Error rate for encoder-recoder
+    double errorRateRecoderDecoder = 0.2; // Error rate for recoder-decoder
+    bool recodingFlag = true;             // Flag to control recoding
+    uint32_t recoders = 100;              // Number of recoders
+    std::string field = "binary8";        // Finite field used
+    double transmitProbability = 0.5; // Transmit probability for the recoders
+
+    // Point-to-point links, whose delay (ms) is the lookahead
+    std::string dataRate = "100Mbps";
+    double delay = 1.0;
+
+    // Loss model of the links: rate (i.i.d.), gilbert (bursts with the
+    // given mean length) or trace (replay of a recorded loss trace)
+    std::string lossModel = "rate";
+    double burstLength = 4.0;
+    std::string lossTrace = "";
+
+    // Reject the non-innovative packets before decoding their payload
+    bool innovationFilter = true;
+
+    // Use the null message synchronization instead of the global barrier
+    bool nullmsg = false;
+
+    // Create a map for the field values
+    std::map<std::string, kodo::finite_field> fieldMap;
+    fieldMap["binary"] = kodo::finite_field::binary;
+    fieldMap["binary4"] = kodo::finite_field::binary4;
+    fieldMap["binary8"] = kodo::finite_field::binary8;
+    fieldMap["binary16"] = kodo::finite_field::binary16;
+
+    CommandLine cmd;
+
+    cmd.AddValue("packetSize", "Size of application packet sent", packetSize);
+    cmd.AddValue("interval", "Interval (seconds) between packets", interval);
+    cmd.AddValue("generationSize", "Set the generation size to use",
+                 generationSize);
+    cmd.AddValue("errorRateEncoderRecoder",
+                 "Packet erasure rate for the encoder-recoder link",
+                 errorRateEncoderRecoder);
+    cmd.AddValue("errorRateRecoderDecoder",
+                 "Packet erasure rate for the recoder-decoder link",
+                 errorRateRecoderDecoder);
+    cmd.AddValue("recodingFlag", "Enable packet recoding", recodingFlag);
+    cmd.AddValue("recoders", "Amount of recoders", recoders);
+    cmd.AddValue("field", "Finite field used", field);
+    cmd.AddValue("transmitProbability", "Transmit probability from recoder",
+                 transmitProbability);
+    cmd.AddValue("dataRate", "Data rate of the links", dataRate);
+    cmd.AddValue("delay", "Delay (ms) of the links, the lookahead", delay);
+    cmd.AddValue("lossModel", "Loss model (rate, gilbert or trace)",
+                 lossModel);
+    cmd.AddValue("burstLength", "Mean burst length of the gilbert model",
+                 burstLength);
+    cmd.AddValue("lossTrace", "Loss trace file of the trace model", lossTrace);
+    cmd.AddValue("innovationFilter",
+                 "Reject non-innovative packets before decoding",
+                 innovationFilter);
+    cmd.AddValue("nullmsg", "Use the null message synchronization", nullmsg);
+
+    cmd.Parse(argc, argv);
+
+    NS_ABORT_MSG_IF(!(delay > 0.0),
+                    "The delay must be positive, it is the lookahead of "
+                    "the distributed simulator");
+
+    // Use the binary8 field in case of errors
+    if (fieldMap.find(field) == fieldMap.end())
+    {
+        field = "binary8";
+    }
+
+    if (nullmsg)
+    {
+        GlobalValue::Bind("SimulatorImplementationType",
+                          StringValue("ns3::NullMessageSimulatorImpl"));
+    }
+    else
+    {
+        GlobalValue::Bind("SimulatorImplementationType",
+                          StringValue("ns3::DistributedSimulatorImpl"));
+    }
+    MpiInterface::Enable(&argc, &argv);
+
+    uint32_t rank = MpiInterface::GetSystemId();
+    uint32_t ranks = MpiInterface::GetSize();
+
+    Time::SetResolution(Time::NS);
+
+    // The nodes are created on all ranks, but only simulated by their own
+    auto partition = PartitionRecoders(recoders, ranks, transmitProbability);
+    uint32_t decoderRank = ranks - 1;
+
+    Ptr<Node> encoderNode = CreateObject<Node>(0);
+    Ptr<Node> decoderNode = CreateObject<Node>(decoderRank);
+    NodeContainer recoderNodes;
+    for (uint32_t n = 0; n < recoders; n++)
+    {
+        recoderNodes.Add(CreateObject<Node>(partition[n]));
+    }
+
+    InternetStackHelper internet;
+    internet.Install(encoderNode);
+    internet.Install(recoderNodes);
+    internet.Install(decoderNode);
+
+    PointToPointHelper ptp;
+    ptp.SetDeviceAttribute("DataRate", StringValue(dataRate));
+    ptp.SetChannelAttribute("Delay", TimeValue(MilliSeconds(delay)));
+
+    // Every recoder has a link from the encoder and a link to the decoder.
+    // The nodes only talk to their neighbors, so no routing is needed.
+    Ipv4AddressHelper toRecoders("10.0.0.0", "255.255.255.252");
+    Ipv4AddressHelper toDecoder("10.128.0.0", "255.255.255.252");
+    std::vector<Ipv4Address> encoderAddresses(recoders);
+    std::vector<Ipv4Address> decoderAddresses(recoders);
+    std::vector<Address> recoderAddresses(recoders);
+
+    std::shared_ptr<const LossTrace> trace;
+    if (lossModel == "trace")
+    {
+        trace = std::make_shared<LossTrace>(lossTrace);
+    }
+    std::vector<Ptr<ErrorModel>> errorModels;
+    std::vector<int64_t> errorStreams;
+
+    uint16_t port = 80;
+    for (uint32_t n = 0; n < recoders; n++)
+    {
+        Ptr<Node> recoder = recoderNodes.Get(n);
+        NetDeviceContainer first = ptp.Install(encoderNode, recoder);
+        Ipv4InterfaceContainer firstInterfaces = toRecoders.Assign(first);
+        toRecoders.NewNetwork();
+
+        NetDeviceContainer second = ptp.Install(recoder, decoderNode);
+        Ipv4InterfaceContainer secondInterfaces = toDecoder.Assign(second);
+        toDecoder.NewNetwork();
+
+        encoderAddresses[n] = firstInterfaces.GetAddress(0);
+        decoderAddresses[n] = secondInterfaces.GetAddress(1);
+        recoderAddresses[n] =
+            InetSocketAddress(secondInterfaces.GetAddress(0), port);
+
+        // Only the error models of the local receivers are created. They
+        // use the streams of the same links in kodo-recoders.
+        if (partition[n] == rank)
+        {
+            errorModels.push_back(
+                CreateErrorModel(lossModel, errorRateEncoderRecoder,
+                                 burstLength, trace, n, 2 * recoders));
+            errorStreams.push_back(2 * n);
+            first.Get(1)->SetAttribute("ReceiveErrorModel",
+                                       PointerValue(errorModels.back()));
+        }
+        if (decoderRank == rank)
+        {
+            errorModels.push_back(CreateErrorModel(
+                lossModel, errorRateRecoderDecoder, burstLength, trace,
+                recoders + n, 2 * recoders));
+            errorStreams.push_back(2 * n + 1);
+            second.Get(1)->SetAttribute("ReceiveErrorModel",
+                                        PointerValue(errorModels.back()));
+        }
+    }
+    for (uint32_t i = 0; i < errorModels.size(); i++)
+    {
+        errorModels[i]->Enable();
+        AssignErrorModelStreams(errorModels[i], errorStreams[i]);
+    }
+
+    // Add the coding state and the sockets of the local nodes
+    DistributedRecoders multihop(fieldMap[field], recoders, generationSize,
+                                 packetSize, recodingFlag,
+                                 transmitProbability);
+    multihop.SetInnovationFilter(innovationFilter);
+
+    TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
+    InetSocketAddress local = InetSocketAddress(Ipv4Address::GetAny(), port);
+
+    if (rank == 0)
+    {
+        Ptr<Socket> socket = Socket::CreateSocket(encoderNode, tid);
+        socket->Bind(local);
+        socket->SetAllowBroadcast(true);
+        multihop.SetEncoder(
+            socket, InetSocketAddress(Ipv4Address("255.255.255.255"), port));
+    }
+    for (uint32_t n = 0; n < recoders; n++)
+    {
+        if (partition[n] == rank)
+        {
+            Ptr<Socket> socket = Socket::CreateSocket(recoderNodes.Get(n), tid);
+            socket->Bind(local);
+            multihop.AddRecoder(n, socket,
+                                InetSocketAddress(encoderAddresses[n], port),
+                                InetSocketAddress(decoderAddresses[n], port));
+        }
+    }
+    if (rank == decoderRank)
+    {
+        Ptr<Socket> socket = Socket::CreateSocket(decoderNode, tid);
+        socket->Bind(local);
+        multihop.SetDecoder(socket, recoderAddresses);
+    }
+
+    multihop.AssignStreams(2 * recoders);
+    multihop.Start(Seconds(1.0), Seconds(1.5), Seconds(interval));
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        KODO_NS3_PROFILE(multihop.GetProfiler(), run);
+        Simulator::Run();
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    // Merge the statistics of all ranks on the first rank
+    auto counters = multihop.GetCounters();
+    std::vector<uint64_t> totals(counters.size(), 0);
+    MPI_Reduce(counters.data(), totals.data(), counters.size(), MPI_UINT64_T,
+               MPI_SUM, 0, MPI_COMM_WORLD);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    uint64_t events = Simulator::GetEventCount();
+    uint64_t stateBytes = multihop.GetStateBytes();
+    double values[] = {elapsed.count(), usage.ru_maxrss / 1024.0,
+                       double(stateBytes),
+                       multihop.GetCompletionTime().GetSeconds()};
+    double maxima[4];
+    uint64_t totalEvents = 0;
+    MPI_Reduce(values, maxima, 4, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&events, &totalEvents, 1, MPI_UINT64_T, MPI_SUM, 0,
+               MPI_COMM_WORLD);
+
+    // A block that does not match its digest fails the run
+    int status = 0;
+    if (rank == 0)
+    {
+        using Counter = DistributedRecoders::Counter;
+        uint64_t total = totals[Counter::encoderTransmissions] +
+                         totals[Counter::recoderTransmissions];
+
+        std::cout << "Ranks: " << ranks << ", recoders: " << recoders
+                  << std::endl;
+        std::cout << "Decoding "
+                  << (totals[Counter::decoderComplete] > 0 ? "completed"
+                                                           : "failed")
+                  << " at " << maxima[3] << " s, "
+                  << totals[Counter::decoderVerified] << " verified"
+                  << std::endl;
+        std::cout << "Encoder transmissions: "
+                  << totals[Counter::encoderTransmissions] << std::endl;
+        std::cout << "Recoders transmissions: "
+                  << totals[Counter::recoderTransmissions] << std::endl;
+        std::cout << "Total transmissions: " << total << std::endl;
+        std::cout << "Recoders complete: " << totals[Counter::recodersComplete]
+                  << " of " << recoders << std::endl;
+        std::cout << "Decoder packets: " << totals[Counter::decoderPackets]
+                  << " (" << totals[Counter::decoderInnovative]
+                  << " innovative)" << std::endl;
+        std::cout << "Innovation filter: " << totals[Counter::rejectedPackets]
+                  << " packets rejected before decoding, "
+                  << totals[Counter::savedBytes] << " payload bytes saved"
+                  << std::endl;
+        std::cout << "Simulation wall time: " << maxima[0] << " s"
+                  << std::endl;
+        std::cout << "Peak resident set per rank: " << maxima[1]
+                  << " MB, coding state per rank: " << maxima[2] / 1e6
+                  << " MB" << std::endl;
+
+        // Read by the kodo-benchmark suite
+        std::cout << "Simulator events: " << totalEvents << std::endl;
+
+        uint64_t corrupted = totals[Counter::decoderComplete] -
+                             totals[Counter::decoderVerified];
+        if (corrupted > 0)
+        {
+            std::cerr << corrupted
+                      << " decoded blocks failed the verification"
+                      << std::endl;
+            status = 1;
+        }
+    }
+
+    Simulator::Destroy();
+    MpiInterface::Disable();
+
+    return status;
+#else
+    std::cerr << "kodo-recoders-mpi needs ns-3 configured with --enable-mpi"
+              << std::endl;
+    return 1;
+#endif
+}
@@ -92,6 +92,7 @@
 //! [2]
 
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -101,7 +102,11 @@
 #include <ns3/network-module.h>
 #include <ns3/point-to-point-star.h>
 
+#include "kodo-analytic.h"
+#include "kodo-error-models.h"
 #include "kodo-recoders.h"
+#include "kodo-trials.h"
+#include "kodo-tuner.h"
 #include <kodo/finite_field.hpp>
 //! [3]
 using namespace ns3;
@@ -110,13 +115,37 @@ int main(int argc, char* argv[])
 {
     uint32_t packetSize = 1000;           // Application bytes per packet
     double interval = 1.0;                // Time between events
-    uint32_t generationSize = 3;          // RLNC generation size
+    std::string generationSize = "3";     // RLNC generation size
     double errorRateEncoderRecoder = 0.4; // Error rate for encoder-recoder link
     double errorRateRecoderDecoder = 0.2; // Error rate for recoder-decoder link
     bool recodingFlag = true;             // Flag to control recoding
     uint32_t recoders = 2;                // Number of recoders
     std::string field = "binary";         // Finite field used
     double transmitProbability = 0.5; // Transmit probability for the recoders
+    uint32_t trials = 1;                  // Trials on the same topology
+
+    // Prefix and format (csv or omnet) of the metrics output files
+    std::string metrics = "";
+    std::string metricsFormat = "csv";
+
+    // Loss model of the links: rate (i.i.d.), gilbert (bursts with the
+    // given mean length) or trace (replay of a recorded loss trace)
+    std::string lossModel = "rate";
+    double burstLength = 4.0;
+    std::string lossTrace = "";
+
+    // Coding CPU budget (microseconds per source symbol) of the tuner that
+    // chooses the field and the generation size set to auto
+    double cpuBudget = 100.0;
+
+    // Coded packets encoded ahead of the send events in one batch
+    uint32_t batchSize = 1;
+
+    // Reject the non-innovative packets before decoding their payload
+    bool innovationFilter = true;
+
+    // Decode binary generations of up to 64 symbols with the small decoder
+    bool smallDecoders = true;
 
     // Create a map for the field values
     std::map<std::string, kodo::finite_field> fieldMap;
@@ -125,13 +154,11 @@ int main(int argc, char* argv[])
     fieldMap["binary8"] = kodo::finite_field::binary8;
     fieldMap["binary16"] = kodo::finite_field::binary16;
 
-    Time interPacketInterval = Seconds(interval);
-
     CommandLine cmd;
 
     cmd.AddValue("packetSize", "Size of application packet sent", packetSize);
     cmd.AddValue("interval", "Interval (seconds) between packets", interval);
-    cmd.AddValue("generationSize", "Set the generation size to use",
+    cmd.AddValue("generationSize", "Set the generation size to use (or auto)",
                  generationSize);
     cmd.AddValue("errorRateEncoderRecoder",
                  "Packet erasure rate for the encoder-recoder link",
@@ -141,12 +168,61 @@ int main(int argc, char* argv[])
                  errorRateRecoderDecoder);
     cmd.AddValue("recodingFlag", "Enable packet recoding", recodingFlag);
     cmd.AddValue("recoders", "Amount of recoders", recoders);
-    cmd.AddValue("field", "Finite field used", field);
+    cmd.AddValue("field", "Finite field used (or auto)", field);
+    cmd.AddValue("cpuBudget", "Coding CPU budget (us per symbol) for auto",
+                 cpuBudget);
+    cmd.AddValue("batchSize", "Coded packets encoded ahead in one batch",
+                 batchSize);
+    cmd.AddValue("innovationFilter",
+                 "Reject non-innovative packets before decoding",
+                 innovationFilter);
+    cmd.AddValue("smallDecoders", "Use the small decoder for small generations",
+                 smallDecoders);
     cmd.AddValue("transmitProbability", "Transmit probability from recoder",
                  transmitProbability);
+    cmd.AddValue("metrics", "Prefix of the metrics output (disabled if empty)",
+                 metrics);
+    cmd.AddValue("metricsFormat", "Metrics output format (csv or omnet)",
+                 metricsFormat);
+    cmd.AddValue("trials", "Number of trials on the same topology", trials);
+    cmd.AddValue("lossModel", "Loss model (rate, gilbert or trace)",
+                 lossModel);
+    cmd.AddValue("burstLength", "Mean burst length of the gilbert model",
+                 burstLength);
+    cmd.AddValue("lossTrace", "Loss trace file of the trace model", lossTrace);
 
     cmd.Parse(argc, argv);
 
+    // Convert to time object
+    Time interPacketInterval = Seconds(interval);
+
+    // The setup time is shared by all trials
+    TrialStatistics trialStatistics;
+
+    // Let the tuner choose the field and the generation size set to auto.
+    // The coding vectors are sent in the packets.
+    if (!TuneConfiguration(
+            field, generationSize, recoders + 1, packetSize,
+            [](kodo::finite_field f, uint32_t g) {
+                kodo::block::generator::random_uniform generator(f);
+                generator.configure(g);
+                return generator.max_coefficients_bytes();
+            },
+            cpuBudget, [&](kodo::finite_field f, uint32_t g) {
+                RecodersModel model(f, g, recoders, errorRateEncoderRecoder,
+                                    errorRateRecoderDecoder,
+                                    transmitProbability, recodingFlag);
+                double mean = 0.0;
+                for (auto t : model.Sample(200, 1))
+                {
+                    mean += t / 200.0;
+                }
+                return mean;
+            }))
+    {
+        return 1;
+    }
+
     // Use the binary8 field in case of errors
     if (fieldMap.find(field) == fieldMap.end())
     {
@@ -198,27 +274,30 @@ int main(int argc, char* argv[])
     Ipv4AddressHelper fromRecoders("10.2.1.0", "255.255.255.0");
     fromRecoders.Assign(recodersDecoderDev);
     //! [5]
-    // Set error model for the net devices
-    Config::SetDefault("ns3::RateErrorModel::ErrorUnit",
-                       StringValue("ERROR_UNIT_PACKET"));
+    // Set an independent error model for every link
+    std::shared_ptr<const LossTrace> trace;
+    if (lossModel == "trace")
+    {
+        trace = std::make_shared<LossTrace>(lossTrace);
+    }
 
     // Create error rate models per branch
-    std::vector<Ptr<RateErrorModel>> errorEncoderRecoders(recoders);
-    std::vector<Ptr<RateErrorModel>> errorRecodersDecoder(recoders);
+    std::vector<Ptr<ErrorModel>> errorEncoderRecoders(recoders);
+    std::vector<Ptr<ErrorModel>> errorRecodersDecoder(recoders);
 
     for (uint32_t n = 0; n < recoders; n++)
     {
         // Encoder to recoders branches
-        errorEncoderRecoders[n] = CreateObject<RateErrorModel>();
-        errorEncoderRecoders[n]->SetAttribute(
-            "ErrorRate", DoubleValue(errorRateEncoderRecoder));
+        errorEncoderRecoders[n] =
+            CreateErrorModel(lossModel, errorRateEncoderRecoder, burstLength,
+                             trace, n, 2 * recoders);
         toRecoders.GetSpokeNode(n)->GetDevice(0)->SetAttribute(
             "ReceiveErrorModel", PointerValue(errorEncoderRecoders[n]));
 
         // Recoders to decoder branches
-        errorRecodersDecoder[n] = CreateObject<RateErrorModel>();
-        errorRecodersDecoder[n]->SetAttribute(
-            "ErrorRate", DoubleValue(errorRateRecoderDecoder));
+        errorRecodersDecoder[n] =
+            CreateErrorModel(lossModel, errorRateRecoderDecoder, burstLength,
+                             trace, recoders + n, 2 * recoders);
         recodersDecoderDev.Get(2 * n + 1)->SetAttribute(
             "ReceiveErrorModel", PointerValue(errorRecodersDecoder[n]));
 
@@ -259,8 +338,13 @@ int main(int argc, char* argv[])
         recodersSockets[n]->Connect(decoderSocketAddress);
     }
 
-    Recoders multihop(fieldMap[field], recoders, generationSize, packetSize,
-                      recodersSockets, recodingFlag, transmitProbability);
+    Recoders multihop(fieldMap[field], recoders, std::stoul(generationSize),
+                      packetSize, recodersSockets, recodingFlag,
+                      transmitProbability);
+    multihop.SetLatencyBinWidth(interPacketInterval);
+    multihop.SetBatchSize(batchSize);
+    multihop.SetInnovationFilter(innovationFilter);
+    multihop.SetSmallDecoders(smallDecoders);
 
     // Recoders callbacks
     for (uint32_t n = 0; n < recoders; n++)
@@ -283,25 +367,76 @@ int main(int argc, char* argv[])
     // convention is: kodo-recoders-[NODE_NUMBER]-[DEVICE_NUMBER].pcap
     // ptp.EnablePcapAll ("kodo-recoders");
 
-    // Schedule processes
-    // Encoder
-    Simulator::ScheduleWithContext(encoderSocket->GetNode()->GetId(),
-                                   Seconds(1.0), &Recoders::SendPacketEncoder,
-                                   &multihop, encoderSocket,
-                                   interPacketInterval);
+    trialStatistics.SetupDone();
+    uint64_t firstRun = RngSeedManager::GetRun();
+
+    for (uint32_t trial = 0; trial < trials; trial++)
+    {
+        // Only the coding state and the random streams are reset between
+        // the trials. Trial k uses the same streams as a separate run with
+        // --RngRun=firstRun+k.
+        if (trial > 0)
+        {
+            RngSeedManager::SetRun(firstRun + trial);
+            multihop.Reset();
+        }
+        for (uint32_t n = 0; n < recoders; n++)
+        {
+            AssignErrorModelStreams(errorEncoderRecoders[n], 2 * n);
+            AssignErrorModelStreams(errorRecodersDecoder[n], 2 * n + 1);
+        }
+        multihop.AssignStreams(2 * recoders);
+
+        trialStatistics.StartTrial();
+
+        // Schedule processes
+        // Encoder
+        Simulator::ScheduleWithContext(
+            encoderSocket->GetNode()->GetId(), Seconds(1.0),
+            &Recoders::SendPacketEncoder, &multihop, encoderSocket,
+            interPacketInterval);
+
+        //! [6]
+        // Recoders
+        for (auto recoderSocket : recodersSockets)
+        {
+            Simulator::ScheduleWithContext(
+                recoderSocket->GetNode()->GetId(), Seconds(1.5),
+                &Recoders::SendPacketRecoder, &multihop, recoderSocket,
+                interPacketInterval);
+        }
+        //! [7]
+        {
+            KODO_NS3_PROFILE(multihop.GetProfiler(), run);
+            Simulator::Run();
+        }
+        trialStatistics.EndTrial(multihop.GetTransmissionCount());
+    }
+
+    multihop.PrintSummary(std::cout);
+    if (trials > 1)
+    {
+        trialStatistics.Print(std::cout);
+    }
 
-    //! [6]
-    // Recoders
-    for (auto recoderSocket : recodersSockets)
+    if (!metrics.empty())
     {
-        Simulator::ScheduleWithContext(recoderSocket->GetNode()->GetId(),
-                                       Seconds(1.5),
-                                       &Recoders::SendPacketRecoder, &multihop,
-                                       recoderSocket, interPacketInterval);
+        multihop.GetMetrics().Write(metrics, metricsFormat, "kodo-recoders");
     }
-    //! [7]
-    Simulator::Run();
+
+    // Read by the kodo-benchmark suite
+    std::cout << "Simulator events: " << Simulator::GetEventCount()
+              << std::endl;
+
     Simulator::Destroy();
 
+    // A block that does not match its digest fails the run
+    uint32_t corrupted = multihop.GetVerifier().GetCorruptedCount();
+    if (corrupted > 0)
+    {
+        std::cerr << corrupted << " decoded blocks failed the verification"
+                  << std::endl;
+        return 1;
+    }
     return 0;
 }
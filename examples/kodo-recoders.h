@@ -18,11 +18,21 @@
 
 // This object implements network coding in the application layer for
 // a encoder - N recoders - decoders topology.
+//
+// The recoders and the decoder reject the non-innovative packets before
+// decoding their payload (see kodo-innovation-filter.h).
+//
+// Binary generations of up to 64 symbols are decoded and recoded by the
+// fixed-size SmallDecoder (see kodo-small-decoder.h).
 
 #pragma once
 
 #include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <endian/big_endian.hpp>
@@ -31,9 +41,22 @@
 #include <kodo/block/generator/random_uniform.hpp>
 #include <kodo/finite_field.hpp>
 
+#include "kodo-batch-encoder.h"
+#include "kodo-coding-metrics.h"
+#include "kodo-innovation-filter.h"
+#include "kodo-latency-histogram.h"
+#include "kodo-profiler.h"
+#include "kodo-small-decoder.h"
+#include "kodo-verifier.h"
+
 class Recoders
 {
 public:
+    // Called for every symbol as soon as it and all symbols before it
+    // have been decoded at the decoder
+    using DeliveryCallback = std::function<void(
+        uint32_t index, const uint8_t* symbol, ns3::Time latency)>;
+
     Recoders(const kodo::finite_field field, const uint32_t users,
              const uint32_t generationSize, const uint32_t packetSize,
              const std::vector<ns3::Ptr<ns3::Socket>>& recodersSockets,
@@ -43,20 +66,28 @@ public:
         m_packetSize(packetSize), m_recodingFlag(recodingFlag),
         m_transmitProbability(transmitProbability),
         m_recodersSockets(recodersSockets), m_encoder(field), m_decoder(field),
-        m_generator(field)
+        m_generator(field), m_metrics(generationSize), m_profiler("Recoders"),
+        m_batchEncoder(m_encoder, field, BatchEncoder::Header::coefficients,
+                       packetSize, m_profiler),
+        m_filter(field, generationSize), m_decoderSpace(m_filter.CreateSpace())
     {
         m_payload.resize(packetSize);
         m_generator.configure(m_generationSize);
-        m_generator.set_seed(rand());
         m_coefficients.resize(m_generator.max_coefficients_bytes());
         auto symbol_bytes = packetSize - m_generator.max_coefficients_bytes();
 
         // Create encoder and disable systematic mode
         m_encoder.configure(m_generationSize, symbol_bytes);
 
-        // Initialize the encoder data buffer
+        // Initialize the encoder data buffer with pseudo-random data, which
+        // the decoder verifies against its digest
         m_encoderBuffer.resize(m_encoder.block_bytes());
+        FillPseudoRandom(m_encoderBuffer.data(), m_encoderBuffer.size(),
+                         ns3::RngSeedManager::GetRun());
+        m_digest =
+            m_verifier.Digest(m_encoderBuffer.data(), m_encoderBuffer.size());
         m_encoder.set_symbols_storage(m_encoderBuffer.data());
+        m_batchEncoder.SetBatchSize(1);
 
         // Create recoders and place them in a vector
         m_recoderBuffers.resize(m_users);
@@ -69,6 +100,7 @@ public:
             // Create data buffer for the decoder
             m_recoderBuffers[n].resize(recoder.block_bytes());
             recoder.set_symbols_storage(m_recoderBuffers[n].data());
+            m_recoderSpaces.push_back(m_filter.CreateSpace());
         }
 
         // Create decoder and its data buffer
@@ -80,6 +112,7 @@ public:
         m_encoderTransmissionCount = 0;
         m_recodersTransmissionCount = 0;
         m_decoderRank = 0;
+        m_nextSymbol = 0;
 
         // Initialize previous packets buffer
         // m_previousPackets = std::vector<ns3::Ptr<ns3::Packet>> (m_users);
@@ -88,6 +121,150 @@ public:
             ns3::CreateObject<ns3::UniformRandomVariable>();
         m_uniformRandomVariable->SetAttribute("Min", ns3::DoubleValue(0.0));
         m_uniformRandomVariable->SetAttribute("Max", ns3::DoubleValue(1.0));
+
+        // The coefficient generator is seeded from an ns-3 random stream at
+        // the start of every trial, so a run is reproducible from the
+        // RngSeed and RngRun values
+        m_seedVariable = ns3::CreateObject<ns3::UniformRandomVariable>();
+
+        // Register the nodes and links with the metrics. The recoders are
+        // receivers 0 to N-1 and the decoder is receiver N. The links from
+        // the encoder come first, followed by the links to the decoder.
+        for (uint32_t n = 0; n < m_users; n++)
+        {
+            m_metrics.AddReceiver("recoder-" + std::to_string(n + 1));
+        }
+        m_metrics.AddReceiver("decoder");
+
+        for (uint32_t n = 0; n < m_users; n++)
+        {
+            m_metrics.AddLink("encoder-recoder-" + std::to_string(n + 1),
+                              true);
+        }
+        for (uint32_t n = 0; n < m_users; n++)
+        {
+            m_metrics.AddLink("recoder-" + std::to_string(n + 1) + "-decoder",
+                              false);
+        }
+
+        // Map the recoder addresses to identify the sender of the packets
+        // that arrive at the decoder
+        for (uint32_t n = 0; n < m_users; n++)
+        {
+            auto ipv4 = m_recodersSockets[n]->GetNode()->GetObject<ns3::Ipv4>();
+            for (uint32_t i = 0; i < ipv4->GetNInterfaces(); i++)
+            {
+                m_recoderAddresses[ipv4->GetAddress(i, 0).GetLocal()] = n;
+            }
+        }
+    }
+
+    void SetDeliveryCallback(const DeliveryCallback& callback)
+    {
+        m_deliveryCallback = callback;
+    }
+
+    void SetLatencyBinWidth(ns3::Time binWidth)
+    {
+        m_symbolLatency.SetBinWidth(binWidth);
+        m_generationLatency.SetBinWidth(binWidth);
+    }
+
+    const Verifier& GetVerifier() const
+    {
+        return m_verifier;
+    }
+
+    const CodingMetrics& GetMetrics() const
+    {
+        return m_metrics;
+    }
+
+    Profiler& GetProfiler()
+    {
+        return m_profiler;
+    }
+
+    uint32_t GetTransmissionCount() const
+    {
+        return m_encoderTransmissionCount + m_recodersTransmissionCount;
+    }
+
+    // Enables or disables the small decoder for small binary generations,
+    // which also resets the coding state of the recoders and the decoder
+    void SetSmallDecoders(bool enabled)
+    {
+        auto symbol_bytes = m_packetSize - m_generator.max_coefficients_bytes();
+        for (uint32_t n = 0; n < m_users; n++)
+        {
+            m_recoders[n].set_small_enabled(enabled);
+            m_recoders[n].configure(m_generationSize, symbol_bytes);
+        }
+        m_decoder.set_small_enabled(enabled);
+        m_decoder.configure(m_generationSize, symbol_bytes);
+        Reset();
+    }
+
+    // Resets the coding state to run another trial on the same topology.
+    // The metrics, the latency histograms, the verifier and the filter
+    // statistics keep accumulating over all trials.
+    void Reset()
+    {
+        for (uint32_t n = 0; n < m_users; n++)
+        {
+            m_recoders[n].reset();
+            m_recoders[n].set_symbols_storage(m_recoderBuffers[n].data());
+            m_recoderSpaces[n].Reset();
+        }
+
+        m_decoder.reset();
+        m_decoder.set_symbols_storage(m_decoderBuffer.data());
+        m_decoderSpace.Reset();
+
+        m_previousPackets.clear();
+        m_batchEncoder.Clear();
+        m_metrics.StartTrial();
+        m_encoderTransmissionCount = 0;
+        m_recodersTransmissionCount = 0;
+        m_decoderRank = 0;
+        m_nextSymbol = 0;
+    }
+
+    // Prints the statistics that are collected over all trials, once after
+    // the last trial
+    void PrintSummary(std::ostream& out) const
+    {
+        m_symbolLatency.Print(out, "Decoder symbol latency");
+        m_generationLatency.Print(out, "Decoder generation latency");
+        m_verifier.Print(out);
+        m_filter.Print(out);
+    }
+
+    // Assigns fixed streams to the random variables of this helper and
+    // returns the number of streams used
+    int64_t AssignStreams(int64_t stream)
+    {
+        m_uniformRandomVariable->SetStream(stream);
+        m_seedVariable->SetStream(stream + 1);
+        return 2;
+    }
+
+    // Sets the number of packets encoded ahead of the send events
+    void SetBatchSize(uint32_t batchSize)
+    {
+        m_batchEncoder.SetBatchSize(batchSize);
+    }
+
+    // Enables or disables the rejection of non-innovative packets before
+    // decoding
+    void SetInnovationFilter(bool enabled)
+    {
+        m_filter.SetEnabled(enabled);
+    }
+
+    const InnovationFilter& GetInnovationFilter() const
+    {
+        return m_filter;
     }
 
     void SendPacketEncoder(ns3::Ptr<ns3::Socket> socket, ns3::Time pktInterval)
@@ -105,23 +282,29 @@ public:
             std::cout << "|Sending a coded packet from ENCODER|" << std::endl;
             std::cout << "+-----------------------------------+" << std::endl;
 
-            m_generator.generate(m_payload.data());
+            if (m_encoderTransmissionCount == 0)
+            {
+                m_firstTransmission = ns3::Simulator::Now();
+                // The encoder and the recoders draw their coefficients
+                // with their own generators
+                m_batchEncoder.SetSeed(m_seedVariable->GetInteger(
+                    0, std::numeric_limits<int32_t>::max()));
+                m_generator.set_seed(m_seedVariable->GetInteger(
+                    0, std::numeric_limits<int32_t>::max()));
+            }
 
-            m_encoder.encode_symbol(m_payload.data() +
-                                        m_generator.max_coefficients_bytes(),
-                                    m_coefficients.data());
-            auto packet =
-                ns3::Create<ns3::Packet>(m_payload.data(), m_payload.size());
-            socket->Send(packet);
+            const uint8_t* payload = m_batchEncoder.Next();
+            {
+                KODO_NS3_PROFILE(m_profiler, packet);
+                auto packet = ns3::Create<ns3::Packet>(payload, m_packetSize);
+                socket->Send(packet);
+            }
             m_encoderTransmissionCount++;
+            m_metrics.Transmit();
 
             ns3::Simulator::Schedule(pktInterval, &Recoders::SendPacketEncoder,
                                      this, socket, pktInterval);
         }
-        else
-        {
-            socket->Close();
-        }
     }
 
     void ReceivePacketRecoder(ns3::Ptr<ns3::Socket> socket)
@@ -135,12 +318,30 @@ public:
 
         auto& recoder = m_recoders[id];
 
-        auto packet = socket->Recv();
-        packet->CopyData(m_payload.data(), packet->GetSize());
+        ns3::Ptr<ns3::Packet> packet;
+        {
+            KODO_NS3_PROFILE(m_profiler, packet);
+            packet = socket->Recv();
+            packet->CopyData(m_payload.data(), packet->GetSize());
+        }
 
-        recoder.decode_symbol(m_payload.data() +
-                                  m_generator.max_coefficients_bytes(),
-                              m_payload.data());
+        uint32_t rank = recoder.rank();
+        bool innovative;
+        {
+            KODO_NS3_PROFILE(m_profiler, filter);
+            innovative = m_filter.Check(m_recoderSpaces[id], m_payload.data(),
+                                        recoder.symbol_bytes());
+        }
+        if (innovative)
+        {
+            KODO_NS3_PROFILE(m_profiler, decode);
+            recoder.decode_symbol(m_payload.data() +
+                                      m_generator.max_coefficients_bytes(),
+                                  m_payload.data());
+            m_filter.Confirm(m_recoderSpaces[id], recoder.rank());
+        }
+        m_metrics.Deliver(id);
+        m_metrics.Receive(id, rank, recoder.rank());
 
         // Keep track of the received packets for each recoder
         // when no recoding is employed to forward one of them
@@ -163,7 +364,7 @@ public:
                             socket);
         auto id = std::distance(m_recodersSockets.begin(), it);
 
-        kodo::block::decoder& recoder = m_recoders[id];
+        BlockDecoder& recoder = m_recoders[id];
 
         // A node wil transmit at random with probability
         // m_transmitProbability. Thus, we throw a coin
@@ -192,16 +393,25 @@ public:
 
                 // Recode a new packet and send it
 
-                m_generator.generate_recode(m_coefficients.data(), recoder);
-
-                recoder.recode_symbol(m_payload.data() +
-                                          m_generator.max_coefficients_bytes(),
-                                      m_payload.data(), m_coefficients.data());
-
-                auto packet = ns3::Create<ns3::Packet>(m_payload.data(),
-                                                       m_payload.size());
-                socket->Send(packet);
+                {
+                    KODO_NS3_PROFILE(m_profiler, coefficients);
+                    recoder.generate_recode(m_generator,
+                                            m_coefficients.data());
+                }
+                {
+                    KODO_NS3_PROFILE(m_profiler, recode);
+                    recoder.recode_symbol(
+                        m_payload.data() + m_generator.max_coefficients_bytes(),
+                        m_payload.data(), m_coefficients.data());
+                }
+                {
+                    KODO_NS3_PROFILE(m_profiler, packet);
+                    auto packet = ns3::Create<ns3::Packet>(m_payload.data(),
+                                                           m_payload.size());
+                    socket->Send(packet);
+                }
                 m_recodersTransmissionCount++;
+                m_metrics.Offer(m_users + id);
             }
             else
             {
@@ -225,9 +435,11 @@ public:
                 // ~/ns-3-dev/src/applications/udp-echo/udp-echo-server.cc
                 // for packet forwarding
 
+                KODO_NS3_PROFILE(m_profiler, packet);
                 packet->RemoveAllPacketTags();
                 socket->Send(packet);
                 m_recodersTransmissionCount++;
+                m_metrics.Offer(m_users + id);
             }
         }
 
@@ -241,12 +453,38 @@ public:
 
     void ReceivePacketDecoder(ns3::Ptr<ns3::Socket> socket)
     {
-        auto packet = socket->Recv();
-        packet->CopyData(m_payload.data(), packet->GetSize());
+        ns3::Address from;
+        {
+            KODO_NS3_PROFILE(m_profiler, packet);
+            auto packet = socket->RecvFrom(from);
+            packet->CopyData(m_payload.data(), packet->GetSize());
+        }
+
+        uint32_t rank = m_decoder.rank();
+        bool innovative;
+        {
+            KODO_NS3_PROFILE(m_profiler, filter);
+            innovative = m_filter.Check(m_decoderSpace, m_payload.data(),
+                                        m_decoder.symbol_bytes());
+        }
+        if (innovative)
+        {
+            KODO_NS3_PROFILE(m_profiler, decode);
+            m_decoder.decode_symbol(m_payload.data() +
+                                        m_generator.max_coefficients_bytes(),
+                                    m_payload.data());
+            m_filter.Confirm(m_decoderSpace, m_decoder.rank());
+        }
+
+        auto sender = m_recoderAddresses.find(
+            ns3::InetSocketAddress::ConvertFrom(from).GetIpv4());
+        if (sender != m_recoderAddresses.end())
+        {
+            m_metrics.Deliver(m_users + sender->second);
+        }
+        m_metrics.Receive(m_users, rank, m_decoder.rank());
 
-        m_decoder.decode_symbol(m_payload.data() +
-                                    m_generator.max_coefficients_bytes(),
-                                m_payload.data());
+        DeliverSymbols();
 
         if (m_decoder.rank() > m_decoderRank)
         {
@@ -258,7 +496,11 @@ public:
 
             if (m_decoder.is_complete())
             {
-                socket->Close();
+                if (!m_verifier.Verify(m_decoderBuffer.data(),
+                                       m_decoderBuffer.size(), m_digest))
+                {
+                    std::cerr << "The decoder decoded wrong data" << std::endl;
+                }
                 std::cout << "*** Decoding completed! ***" << std::endl;
                 std::cout << "Encoder transmissions: "
                           << m_encoderTransmissionCount << std::endl;
@@ -272,6 +514,32 @@ public:
     }
 
 private:
+    void DeliverSymbols()
+    {
+        auto latency = ns3::Simulator::Now() - m_firstTransmission;
+
+        // Deliver the longest decoded prefix of the generation
+        while (m_nextSymbol < m_generationSize &&
+               m_decoder.is_symbol_decoded(m_nextSymbol))
+        {
+            uint32_t index = m_nextSymbol++;
+            m_symbolLatency.Add(latency);
+
+            if (m_deliveryCallback)
+            {
+                m_deliveryCallback(index,
+                                   m_decoderBuffer.data() +
+                                       index * m_decoder.symbol_bytes(),
+                                   latency);
+            }
+
+            if (m_nextSymbol == m_generationSize)
+            {
+                m_generationLatency.Add(latency);
+            }
+        }
+    }
+
     const kodo::finite_field m_field;
     const uint32_t m_users;
     const uint32_t m_generationSize;
@@ -282,11 +550,14 @@ private:
     std::vector<ns3::Ptr<ns3::Socket>> m_recodersSockets;
     kodo::block::encoder m_encoder;
     std::vector<uint8_t> m_encoderBuffer;
-    std::vector<kodo::block::decoder> m_recoders;
+    std::vector<BlockDecoder> m_recoders;
     std::vector<std::vector<uint8_t>> m_recoderBuffers;
-    kodo::block::decoder m_decoder;
+    BlockDecoder m_decoder;
     std::vector<uint8_t> m_decoderBuffer;
 
+    uint64_t m_digest;
+    Verifier m_verifier;
+
     std::vector<uint8_t> m_payload;
     uint32_t m_encoderTransmissionCount;
     uint32_t m_recodersTransmissionCount;
@@ -294,7 +565,24 @@ private:
     std::map<uint32_t, std::vector<ns3::Ptr<ns3::Packet>>> m_previousPackets;
 
     ns3::Ptr<ns3::UniformRandomVariable> m_uniformRandomVariable;
+    ns3::Ptr<ns3::UniformRandomVariable> m_seedVariable;
 
     kodo::block::generator::random_uniform m_generator;
     std::vector<uint8_t> m_coefficients;
+
+    ns3::Time m_firstTransmission;
+    uint32_t m_nextSymbol;
+    LatencyHistogram m_symbolLatency;
+    LatencyHistogram m_generationLatency;
+    DeliveryCallback m_deliveryCallback;
+
+    CodingMetrics m_metrics;
+    Profiler m_profiler;
+    BatchEncoder m_batchEncoder;
+
+    // The spaces of the recoders and of the decoder for the filter
+    InnovationFilter m_filter;
+    std::vector<CoefficientSpace> m_recoderSpaces;
+    CoefficientSpace m_decoderSpace;
+    std::map<ns3::Ipv4Address, uint32_t> m_recoderAddresses;
 };
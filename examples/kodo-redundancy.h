@@ -0,0 +1,199 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class decides how many coded packets an open-loop source sends per
+// generation, without knowing when the receivers have decoded.
+//
+// Every receiver counts the packets it receives from the burst of each
+// generation, whose size is known from the packet sequence, and reports the
+// counts to the source only every reportInterval generations (staggered
+// over the receivers). The source keeps a loss-rate estimate per receiver
+// from the reports, starting from a prior, and sends the smallest burst
+// that all receivers decode with the target probability according to the
+// BroadcastModel of the estimated loss rates.
+//
+// The feedback channel is not simulated: a report is applied at the source
+// at the end of its generation, without delay, and reports are never lost.
+// The estimates are therefore optimistic compared with a real feedback
+// channel, where reports arrive late or not at all.
+//
+// The achieved decoding probability and the channel overhead are collected
+// over all generations, so the open-loop source can be compared with the
+// target and with the closed-loop source of the Broadcast helper.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <kodo/finite_field.hpp>
+
+#include "kodo-analytic.h"
+
+class RedundancyController
+{
+public:
+    RedundancyController(const kodo::finite_field field,
+                         const uint32_t generationSize, const uint32_t users,
+                         const double targetProbability,
+                         const uint32_t reportInterval = 4,
+                         const double priorLoss = 0.2) :
+        m_model(field, generationSize),
+        m_generationSize(generationSize), m_users(users),
+        m_targetProbability(targetProbability),
+        m_reportInterval(std::max<uint32_t>(reportInterval, 1)),
+        m_priorLoss(priorLoss)
+    {
+        Reset();
+    }
+
+    // Forgets the loss estimates and the collected outcomes
+    void Reset()
+    {
+        m_sent.assign(m_users, 0.0);
+        m_lost.assign(m_users, 0.0);
+        m_pendingSent.assign(m_users, 0);
+        m_pendingReceived.assign(m_users, 0);
+        m_burstSize = 0;
+        m_generations = 0;
+        m_transmissions = 0;
+        m_decoded = 0;
+        m_allDecoded = 0;
+        m_reports = 0;
+    }
+
+    // Returns the number of packets to send for the next generation
+    uint32_t GetBurstSize()
+    {
+        // The burst only changes when a report has arrived
+        if (m_burstSize == 0)
+        {
+            std::vector<double> erasures(m_users);
+            for (uint32_t n = 0; n < m_users; n++)
+            {
+                // Rounding groups the receivers with similar estimates,
+                // which share their distribution in the model
+                erasures[n] = std::round(GetLossEstimate(n) * 200.0) / 200.0;
+            }
+            auto cdf = m_model.Cdf(erasures);
+            m_burstSize = std::max(
+                BroadcastModel::Quantile(cdf, m_targetProbability),
+                m_generationSize);
+        }
+        return m_burstSize;
+    }
+
+    // Returns the estimated loss rate of receiver n
+    double GetLossEstimate(uint32_t n) const
+    {
+        // The prior weighs as much as one generation of packets
+        double weight = m_generationSize;
+        return (m_lost[n] + m_priorLoss * weight) / (m_sent[n] + weight);
+    }
+
+    // Records the outcome of a generation: the packets sent and, for every
+    // receiver, the packets it received and whether it decoded
+    void EndGeneration(uint32_t sent, const std::vector<uint32_t>& received,
+                       const std::vector<bool>& decoded)
+    {
+        bool allDecoded = true;
+        for (uint32_t n = 0; n < m_users; n++)
+        {
+            m_pendingSent[n] += sent;
+            m_pendingReceived[n] += std::min(received[n], sent);
+            m_decoded += decoded[n] ? 1 : 0;
+            allDecoded &= decoded[n];
+
+            if ((m_generations + n) % m_reportInterval == 0)
+            {
+                Report(n);
+            }
+        }
+
+        m_generations++;
+        m_transmissions += sent;
+        m_allDecoded += allDecoded ? 1 : 0;
+    }
+
+    void Print(std::ostream& out) const
+    {
+        if (m_generations == 0)
+        {
+            return;
+        }
+
+        double sourceSymbols = double(m_generations) * m_generationSize;
+        double meanLoss = 0.0;
+        for (uint32_t n = 0; n < m_users; n++)
+        {
+            meanLoss += GetLossEstimate(n) / m_users;
+        }
+
+        out << "Open-loop redundancy (target decoding probability "
+            << m_targetProbability << ", a report every " << m_reportInterval
+            << " generations):" << std::endl;
+        out << "  Decoding probability: "
+            << double(m_allDecoded) / m_generations << " all receivers ("
+            << m_allDecoded << " of " << m_generations << " generations), "
+            << double(m_decoded) / (double(m_generations) * m_users)
+            << " per receiver" << std::endl;
+        out << "  Channel overhead: "
+            << (m_transmissions / sourceSymbols - 1.0) * 100.0 << "% ("
+            << m_transmissions / double(m_generations)
+            << " packets per generation of " << m_generationSize << ")"
+            << std::endl;
+        out << "  Loss estimate: " << meanLoss << " mean over " << m_users
+            << " receivers from " << m_reports << " reports" << std::endl;
+    }
+
+private:
+    // Delivers the counts of receiver n since its last report
+    void Report(uint32_t n)
+    {
+        m_sent[n] += m_pendingSent[n];
+        m_lost[n] += m_pendingSent[n] - m_pendingReceived[n];
+        m_pendingSent[n] = 0;
+        m_pendingReceived[n] = 0;
+        m_burstSize = 0;
+        m_reports++;
+    }
+
+private:
+    const BroadcastModel m_model;
+    const uint32_t m_generationSize;
+    const uint32_t m_users;
+    const double m_targetProbability;
+    const uint32_t m_reportInterval;
+    const double m_priorLoss;
+
+    // Packets sent to and lost by every receiver, as known from the reports
+    std::vector<double> m_sent;
+    std::vector<double> m_lost;
+    std::vector<uint32_t> m_pendingSent;
+    std::vector<uint32_t> m_pendingReceived;
+    uint32_t m_burstSize;
+
+    uint32_t m_generations;
+    uint64_t m_transmissions;
+    uint64_t m_decoded;
+    uint32_t m_allDecoded;
+    uint32_t m_reports;
+};
@@ -0,0 +1,364 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// A decoder for small binary generations with a compile-time size.
+//
+// SmallDecoder<MaxSymbols> decodes GF(2) generations of up to MaxSymbols
+// (at most 64) symbols. Every coding vector is a single 64-bit word, so the
+// coefficient rows are stored inline and reducing a vector against the
+// basis takes one XOR per pivot. The rows are kept in reduced echelon form,
+// like the CoefficientSpace, and the payload of a row is kept in the symbol
+// storage at the index of its pivot, so the storage holds the decoded block
+// when the decoder is complete.
+//
+// BlockDecoder uses a SmallDecoder<64> for binary generations of up to 64
+// symbols and the kodo decoder otherwise. Both have the interface of
+// kodo::block::decoder that the helpers use, so a helper can switch to
+// BlockDecoder without other changes. The coefficients are read and written
+// in the layout of the kodo generator: 8 coefficients per byte starting from
+// the least significant bit.
+
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include <kodo/block/decoder.hpp>
+#include <kodo/block/generator/random_uniform.hpp>
+#include <kodo/finite_field.hpp>
+
+template <uint32_t MaxSymbols>
+class SmallDecoder
+{
+    static_assert(MaxSymbols > 0 && MaxSymbols <= 64,
+                  "A coding vector must fit in a 64-bit word");
+
+public:
+    static const uint32_t max_symbols = MaxSymbols;
+
+    SmallDecoder() : m_symbols(0), m_symbolBytes(0), m_storage(nullptr)
+    {
+        reset();
+    }
+
+    void configure(uint32_t symbols, uint32_t symbolBytes)
+    {
+        assert(symbols > 0 && symbols <= MaxSymbols);
+        m_symbols = symbols;
+        m_symbolBytes = symbolBytes;
+        m_mask = symbols == 64 ? ~uint64_t(0) : (uint64_t(1) << symbols) - 1;
+        reset();
+    }
+
+    void reset()
+    {
+        m_pivots = 0;
+        m_decoded = 0;
+        m_rank = 0;
+    }
+
+    uint32_t symbols() const
+    {
+        return m_symbols;
+    }
+
+    uint32_t symbol_bytes() const
+    {
+        return m_symbolBytes;
+    }
+
+    uint32_t block_bytes() const
+    {
+        return m_symbols * m_symbolBytes;
+    }
+
+    void set_symbols_storage(uint8_t* storage)
+    {
+        m_storage = storage;
+    }
+
+    uint32_t rank() const
+    {
+        return m_rank;
+    }
+
+    bool is_complete() const
+    {
+        return m_rank == m_symbols;
+    }
+
+    bool is_symbol_decoded(uint32_t index) const
+    {
+        return (m_decoded >> index) & 1;
+    }
+
+    // Decodes a coded symbol in place, like the kodo decoder
+    void decode_symbol(uint8_t* symbol, const uint8_t* coefficients)
+    {
+        uint64_t vector = Load(coefficients);
+
+        // A basis row only has its own pivot among the pivot columns, so a
+        // single pass over the pivots of the vector reduces it
+        for (uint64_t pivots = vector & m_pivots; pivots != 0;
+             pivots &= pivots - 1)
+        {
+            uint32_t i = __builtin_ctzll(pivots);
+            vector ^= m_rows[i];
+            Add(symbol, Symbol(i));
+        }
+        if (vector == 0)
+        {
+            return;
+        }
+
+        // Eliminate the new pivot from the other rows
+        uint32_t pivot = __builtin_ctzll(vector);
+        uint64_t bit = uint64_t(1) << pivot;
+        for (uint64_t rows = m_pivots; rows != 0; rows &= rows - 1)
+        {
+            uint32_t i = __builtin_ctzll(rows);
+            if (m_rows[i] & bit)
+            {
+                m_rows[i] ^= vector;
+                Add(Symbol(i), symbol);
+                m_decoded |= m_rows[i] == (uint64_t(1) << i) ? 1ULL << i : 0;
+            }
+        }
+
+        m_rows[pivot] = vector;
+        std::memcpy(Symbol(pivot), symbol, m_symbolBytes);
+        m_pivots |= bit;
+        m_decoded |= vector == bit ? bit : 0;
+        m_rank++;
+    }
+
+    // Combines the basis rows selected by the bits of coefficientsIn (a
+    // full coding vector of random coefficients) into a coded symbol
+    void recode_symbol(uint8_t* symbol, uint8_t* coefficientsOut,
+                       const uint8_t* coefficientsIn) const
+    {
+        uint64_t vector = 0;
+        std::memset(symbol, 0, m_symbolBytes);
+        for (uint64_t rows = Load(coefficientsIn) & m_pivots; rows != 0;
+             rows &= rows - 1)
+        {
+            uint32_t i = __builtin_ctzll(rows);
+            vector ^= m_rows[i];
+            Add(symbol, Symbol(i));
+        }
+        Store(vector, coefficientsOut);
+    }
+
+private:
+    uint8_t* Symbol(uint32_t index) const
+    {
+        return m_storage + index * m_symbolBytes;
+    }
+
+    uint64_t Load(const uint8_t* coefficients) const
+    {
+        uint64_t vector = 0;
+        for (uint32_t i = 0; i < (m_symbols + 7) / 8; i++)
+        {
+            vector |= uint64_t(coefficients[i]) << (8 * i);
+        }
+        return vector & m_mask;
+    }
+
+    void Store(uint64_t vector, uint8_t* coefficients) const
+    {
+        for (uint32_t i = 0; i < (m_symbols + 7) / 8; i++)
+        {
+            coefficients[i] = uint8_t(vector >> (8 * i));
+        }
+    }
+
+    // Adds the source symbol to the target symbol a word at a time
+    void Add(uint8_t* target, const uint8_t* source) const
+    {
+        uint32_t i = 0;
+        for (; i + sizeof(uint64_t) <= m_symbolBytes; i += sizeof(uint64_t))
+        {
+            uint64_t a;
+            uint64_t b;
+            std::memcpy(&a, target + i, sizeof(a));
+            std::memcpy(&b, source + i, sizeof(b));
+            a ^= b;
+            std::memcpy(target + i, &a, sizeof(a));
+        }
+        for (; i < m_symbolBytes; i++)
+        {
+            target[i] ^= source[i];
+        }
+    }
+
+private:
+    uint32_t m_symbols;
+    uint32_t m_symbolBytes;
+    uint64_t m_mask;
+    uint8_t* m_storage;
+
+    // The coefficient row of every pivot column, the pivot columns and the
+    // rows that only have their pivot left
+    std::array<uint64_t, MaxSymbols> m_rows;
+    uint64_t m_pivots;
+    uint64_t m_decoded;
+    uint32_t m_rank;
+};
+
+class BlockDecoder
+{
+public:
+    using Small = SmallDecoder<64>;
+
+    BlockDecoder(const kodo::finite_field field) :
+        m_field(field), m_decoder(field), m_smallEnabled(true),
+        m_isSmall(false)
+    {
+    }
+
+    // Allows the small decoder for the next configure (the default)
+    void set_small_enabled(bool enabled)
+    {
+        m_smallEnabled = enabled;
+    }
+
+    // Returns true if the generation is decoded by the small decoder
+    bool is_small() const
+    {
+        return m_isSmall;
+    }
+
+    void configure(uint32_t symbols, uint32_t symbolBytes)
+    {
+        m_isSmall = m_smallEnabled && m_field == kodo::finite_field::binary &&
+                    symbols <= Small::max_symbols;
+        if (m_isSmall)
+        {
+            m_small.configure(symbols, symbolBytes);
+        }
+        else
+        {
+            m_decoder.configure(symbols, symbolBytes);
+        }
+    }
+
+    void reset()
+    {
+        if (m_isSmall)
+        {
+            m_small.reset();
+        }
+        else
+        {
+            m_decoder.reset();
+        }
+    }
+
+    uint32_t symbols() const
+    {
+        return m_isSmall ? m_small.symbols() : m_decoder.symbols();
+    }
+
+    uint32_t symbol_bytes() const
+    {
+        return m_isSmall ? m_small.symbol_bytes() : m_decoder.symbol_bytes();
+    }
+
+    uint32_t block_bytes() const
+    {
+        return m_isSmall ? m_small.block_bytes() : m_decoder.block_bytes();
+    }
+
+    void set_symbols_storage(uint8_t* storage)
+    {
+        if (m_isSmall)
+        {
+            m_small.set_symbols_storage(storage);
+        }
+        else
+        {
+            m_decoder.set_symbols_storage(storage);
+        }
+    }
+
+    uint32_t rank() const
+    {
+        return m_isSmall ? m_small.rank() : m_decoder.rank();
+    }
+
+    bool is_complete() const
+    {
+        return m_isSmall ? m_small.is_complete() : m_decoder.is_complete();
+    }
+
+    bool is_symbol_decoded(uint32_t index) const
+    {
+        return m_isSmall ? m_small.is_symbol_decoded(index)
+                         : m_decoder.is_symbol_decoded(index);
+    }
+
+    void decode_symbol(uint8_t* symbol, uint8_t* coefficients)
+    {
+        if (m_isSmall)
+        {
+            m_small.decode_symbol(symbol, coefficients);
+        }
+        else
+        {
+            m_decoder.decode_symbol(symbol, coefficients);
+        }
+    }
+
+    // Draws the coefficients of a recoded symbol. The small decoder takes a
+    // full coding vector and the kodo decoder one coefficient per rank.
+    void generate_recode(kodo::block::generator::random_uniform& generator,
+                         uint8_t* coefficients) const
+    {
+        if (m_isSmall)
+        {
+            generator.generate(coefficients);
+        }
+        else
+        {
+            generator.generate_recode(coefficients, m_decoder);
+        }
+    }
+
+    void recode_symbol(uint8_t* symbol, uint8_t* coefficientsOut,
+                       const uint8_t* coefficientsIn) const
+    {
+        if (m_isSmall)
+        {
+            m_small.recode_symbol(symbol, coefficientsOut, coefficientsIn);
+        }
+        else
+        {
+            m_decoder.recode_symbol(symbol, coefficientsOut, coefficientsIn);
+        }
+    }
+
+private:
+    const kodo::finite_field m_field;
+    kodo::block::decoder m_decoder;
+    Small m_small;
+    bool m_smallEnabled;
+    bool m_isSmall;
+};
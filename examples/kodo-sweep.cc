@@ -0,0 +1,401 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program runs a parameter sweep of one of the kodo examples.
+//
+// The parameter grid is given as a list of parameters with their values,
+// e.g. "generationSize=3,5,8;errorRate=0.1,0.3", and every point of the
+// grid is simulated a number of times (runs). Every simulation is a
+// separate process of the example program with its own --RngRun value, so
+// the simulations are independent and run in parallel on all cores. The
+// --RngRun value is a hash of the parameters of the point and of the
+// repetition, so a simulation keeps its seed when the grid is changed or
+// reordered.
+//
+// Every finished simulation is appended to the output CSV file right away.
+// If the file already exists, the simulations that it contains are not
+// run again, so an interrupted sweep can be resumed with the same command.
+// Lines that cannot be parsed, like a line cut off by an interruption, are
+// skipped and their simulations are run again.
+// At the end, the mean and the 95% confidence interval of the number of
+// transmissions are written for every point to <output>-summary.csv and
+// <output>-summary.json.
+//
+// Example (from the ns-3 folder):
+//
+// python waf --run kodo-sweep --command-template="%s
+// --program=build/examples/kodo/ns3.30-kodo-wired-broadcast-debug
+// --grid=generationSize=3,5,8;errorRate=0.1,0.3 --runs=100"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <ns3/core-module.h>
+
+using namespace ns3;
+
+// A single simulation of the sweep
+struct Job
+{
+    std::string point;
+    std::string arguments;
+    uint32_t repetition;
+    uint64_t rngRun;
+};
+
+static std::vector<std::string> Split(const std::string& text, char separator)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+
+    while (std::getline(stream, part, separator))
+    {
+        if (!part.empty())
+        {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+// Expands "a=1,2;b=x,y" to the points "a=1 b=x", "a=1 b=y", "a=2 b=x", ...
+static std::vector<std::string> ExpandGrid(const std::string& grid)
+{
+    std::vector<std::string> points = {""};
+
+    for (const auto& parameter : Split(grid, ';'))
+    {
+        auto separator = parameter.find('=');
+        if (separator == std::string::npos)
+        {
+            std::cerr << "Ignoring invalid parameter: " << parameter
+                      << std::endl;
+            continue;
+        }
+
+        std::string name = parameter.substr(0, separator);
+        std::vector<std::string> expanded;
+
+        for (const auto& point : points)
+        {
+            for (const auto& value :
+                 Split(parameter.substr(separator + 1), ','))
+            {
+                expanded.push_back(point + (point.empty() ? "" : " ") + name +
+                                   "=" + value);
+            }
+        }
+        points = expanded;
+    }
+    return points;
+}
+
+// Returns the point with its parameters sorted, which identifies the point
+// whatever the order of the parameters in the grid
+static std::string CanonicalPoint(const std::string& point)
+{
+    auto parameters = Split(point, ' ');
+    std::sort(parameters.begin(), parameters.end());
+
+    std::string canonical;
+    for (const auto& parameter : parameters)
+    {
+        canonical += (canonical.empty() ? "" : " ") + parameter;
+    }
+    return canonical;
+}
+
+// Returns the RngRun value of a repetition of a point, which only depends
+// on the parameter values
+static uint64_t RngRunOf(const std::string& point, uint32_t repetition)
+{
+    std::string key = CanonicalPoint(point);
+    key += (key.empty() ? "" : " ") + std::to_string(repetition);
+
+    // 64-bit FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : key)
+    {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Parses a whole field as a number, returns false if it is not one
+static bool ParseNumber(const std::string& field, double& value)
+{
+    char* end = nullptr;
+    value = std::strtod(field.c_str(), &end);
+    return !field.empty() && end == field.c_str() + field.size() &&
+           std::isfinite(value);
+}
+
+// Returns the number of transmissions reported by the example, or -1
+static double RunJob(const std::string& program, const std::string& extra,
+                     const Job& job)
+{
+    std::string command = program + " --RngRun=" +
+                          std::to_string(job.rngRun) + job.arguments + " " +
+                          extra + " 2>/dev/null";
+
+    FILE* pipe = popen(command.c_str(), "r");
+    if (pipe == nullptr)
+    {
+        return -1;
+    }
+
+    // All examples end their output with "Total transmissions: N"
+    const std::string marker = "Total transmissions: ";
+    double transmissions = -1;
+    char line[512];
+
+    while (fgets(line, sizeof(line), pipe) != nullptr)
+    {
+        std::string text(line);
+        auto position = text.find(marker);
+        if (position != std::string::npos)
+        {
+            transmissions = std::strtod(
+                text.c_str() + position + marker.size(), nullptr);
+        }
+    }
+
+    if (pclose(pipe) != 0)
+    {
+        return -1;
+    }
+    return transmissions;
+}
+
+// Two-sided 95% quantile of the Student t distribution
+static double StudentT95(uint32_t degrees)
+{
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+    if (degrees == 0)
+    {
+        return 0.0;
+    }
+    return degrees <= 30 ? table[degrees - 1] : 1.960;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string program = "";          // Example program to run
+    std::string grid = "";             // Parameter grid
+    std::string extra = "";            // Fixed arguments for all runs
+    uint32_t runs = 10;                // Repetitions per point
+    uint32_t jobs = 0;                 // Parallel processes (0: all cores)
+    std::string output = "kodo-sweep"; // Prefix of the output files
+
+    CommandLine cmd;
+
+    cmd.AddValue("program", "Path of the example program", program);
+    cmd.AddValue("grid", "Parameter grid, e.g. a=1,2;b=0.1,0.2", grid);
+    cmd.AddValue("extra", "Arguments passed to every run", extra);
+    cmd.AddValue("runs", "Repetitions per grid point", runs);
+    cmd.AddValue("jobs", "Parallel simulations (0 for all cores)", jobs);
+    cmd.AddValue("output", "Prefix of the output files", output);
+
+    cmd.Parse(argc, argv);
+
+    if (program.empty())
+    {
+        std::cerr << "The --program option is required" << std::endl;
+        return 1;
+    }
+
+    if (jobs == 0)
+    {
+        jobs = std::max(1U, std::thread::hardware_concurrency());
+    }
+
+    // Read the results of a previous, partial sweep. The results are keyed
+    // on the canonical points, so they still match a reordered grid.
+    std::string resultsFile = output + ".csv";
+    std::map<std::string, std::vector<double>> results;
+    std::set<std::pair<std::string, uint32_t>> completed;
+    bool writeHeader = true;
+    bool endsWithNewline = true;
+    {
+        std::ifstream previous(resultsFile);
+        std::string line;
+        if (std::getline(previous, line)) // Header
+        {
+            writeHeader = false;
+            endsWithNewline = !previous.eof();
+        }
+
+        while (std::getline(previous, line))
+        {
+            endsWithNewline = !previous.eof();
+            auto fields = Split(line, ',');
+            double repetition = 0.0;
+            double transmissions = 0.0;
+            if (fields.size() != 5 || !ParseNumber(fields[1], repetition) ||
+                !ParseNumber(fields[3], transmissions) || repetition < 0)
+            {
+                std::cerr << "Skipping malformed line: " << line << std::endl;
+                continue;
+            }
+            std::string point = CanonicalPoint(fields[0]);
+            completed.emplace(point, uint32_t(repetition));
+            results[point].push_back(transmissions);
+        }
+    }
+
+    std::ofstream resultsStream(resultsFile, std::ios::app);
+    if (!endsWithNewline)
+    {
+        // Finish the line that was cut off, the new results start below it
+        resultsStream << std::endl;
+    }
+    if (writeHeader)
+    {
+        resultsStream << "point,repetition,rng_run,transmissions,seconds"
+                      << std::endl;
+    }
+
+    // Create the jobs that are still missing. Each simulation in the grid
+    // gets its own RngRun value from its parameters.
+    auto points = ExpandGrid(grid);
+    std::vector<Job> pending;
+
+    for (uint32_t p = 0; p < points.size(); p++)
+    {
+        std::string arguments;
+        for (const auto& parameter : Split(points[p], ' '))
+        {
+            arguments += " --" + parameter;
+        }
+
+        for (uint32_t r = 0; r < runs; r++)
+        {
+            if (completed.count(
+                    std::make_pair(CanonicalPoint(points[p]), r)) == 0)
+            {
+                pending.push_back(
+                    {points[p], arguments, r, RngRunOf(points[p], r)});
+            }
+        }
+    }
+
+    std::cout << points.size() << " points, " << completed.size()
+              << " simulations already done, " << pending.size()
+              << " to run on " << jobs << " cores" << std::endl;
+
+    // Run the simulations as separate processes from a pool of threads
+    std::atomic<uint32_t> next(0);
+    std::mutex mutex;
+    std::vector<std::thread> workers;
+
+    for (uint32_t w = 0; w < jobs; w++)
+    {
+        workers.emplace_back([&]() {
+            for (uint32_t j = next++; j < pending.size(); j = next++)
+            {
+                const Job& job = pending[j];
+                auto start = std::chrono::steady_clock::now();
+                double transmissions = RunJob(program, extra, job);
+                std::chrono::duration<double> elapsed =
+                    std::chrono::steady_clock::now() - start;
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (transmissions < 0)
+                {
+                    std::cerr << "Simulation failed: " << job.point
+                              << " --RngRun=" << job.rngRun << std::endl;
+                    continue;
+                }
+                resultsStream << job.point << "," << job.repetition << ","
+                              << job.rngRun << "," << transmissions << ","
+                              << elapsed.count() << std::endl;
+                results[CanonicalPoint(job.point)].push_back(transmissions);
+            }
+        });
+    }
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    // Aggregate the results per point
+    std::ofstream summaryCsv(output + "-summary.csv");
+    std::ofstream summaryJson(output + "-summary.json");
+    summaryCsv << "point,runs,mean,stddev,ci95" << std::endl;
+    summaryJson << "[" << std::endl;
+
+    for (uint32_t p = 0; p < points.size(); p++)
+    {
+        const auto& samples = results[CanonicalPoint(points[p])];
+        double mean = 0.0;
+        double variance = 0.0;
+
+        for (auto x : samples)
+        {
+            mean += x / samples.size();
+        }
+        for (auto x : samples)
+        {
+            variance += (x - mean) * (x - mean) /
+                        std::max<double>(samples.size() - 1, 1);
+        }
+
+        double stddev = std::sqrt(variance);
+        double ci95 =
+            samples.empty()
+                ? 0.0
+                : StudentT95(samples.size() - 1) * stddev /
+                      std::sqrt(samples.size());
+
+        summaryCsv << points[p] << "," << samples.size() << "," << mean << ","
+                   << stddev << "," << ci95 << std::endl;
+        summaryJson << "  {\"point\": \"" << points[p]
+                    << "\", \"runs\": " << samples.size()
+                    << ", \"mean\": " << mean << ", \"stddev\": " << stddev
+                    << ", \"ci95\": " << ci95 << "}"
+                    << (p + 1 < points.size() ? "," : "") << std::endl;
+
+        std::cout << points[p] << ": " << mean << " +/- " << ci95
+                  << " transmissions (" << samples.size() << " runs)"
+                  << std::endl;
+    }
+    summaryJson << "]" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class collects the results of the trials of an example that runs
+// several independent trials on the same topology (--trials option).
+// Besides the distribution of the number of transmissions, it reports how
+// much wall-clock time was saved by building the topology only once.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+class TrialStatistics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TrialStatistics() : m_setupStart(Clock::now()), m_setupSeconds(0.0)
+    {
+    }
+
+    // Marks the end of the topology setup that is shared by all trials
+    void SetupDone()
+    {
+        m_setupSeconds = Seconds(Clock::now() - m_setupStart);
+    }
+
+    void StartTrial()
+    {
+        m_trialStart = Clock::now();
+    }
+
+    void EndTrial(uint32_t transmissions)
+    {
+        m_trialSeconds.push_back(Seconds(Clock::now() - m_trialStart));
+        m_transmissions.push_back(transmissions);
+    }
+
+    void Print(std::ostream& out) const
+    {
+        uint32_t trials = m_transmissions.size();
+        if (trials == 0)
+        {
+            return;
+        }
+
+        std::vector<uint32_t> sorted(m_transmissions);
+        std::sort(sorted.begin(), sorted.end());
+
+        double mean = 0.0;
+        double variance = 0.0;
+        double trialSeconds = 0.0;
+        for (uint32_t t = 0; t < trials; t++)
+        {
+            mean += double(sorted[t]) / trials;
+            trialSeconds += m_trialSeconds[t] / trials;
+        }
+        for (auto x : sorted)
+        {
+            variance += (x - mean) * (x - mean) / std::max(trials - 1, 1U);
+        }
+
+        out << "*** Trials: " << trials << " ***" << std::endl;
+        out << "Transmissions: mean " << mean << ", stddev "
+            << std::sqrt(variance) << ", min " << sorted.front() << ", p50 "
+            << sorted[trials / 2] << ", p90 " << sorted[(trials * 9) / 10]
+            << ", max " << sorted.back() << std::endl;
+
+        out << "Transmissions distribution:" << std::endl;
+        for (uint32_t t = 0; t < trials;)
+        {
+            uint32_t value = sorted[t];
+            uint32_t count = 0;
+            for (; t < trials && sorted[t] == value; t++)
+            {
+                count++;
+            }
+            out << "  " << value << ": " << count << std::endl;
+        }
+
+        out << "Setup time: " << m_setupSeconds << " s, mean trial time: "
+            << trialSeconds << " s" << std::endl;
+        out << "Setup time saved per trial: " << m_setupSeconds
+            << " s (total " << m_setupSeconds * (trials - 1) << " s)"
+            << std::endl;
+    }
+
+private:
+    static double Seconds(Clock::duration duration)
+    {
+        return std::chrono::duration<double>(duration).count();
+    }
+
+private:
+    Clock::time_point m_setupStart;
+    Clock::time_point m_trialStart;
+    double m_setupSeconds;
+    std::vector<double> m_trialSeconds;
+    std::vector<uint32_t> m_transmissions;
+};
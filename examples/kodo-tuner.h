@@ -0,0 +1,303 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class chooses the finite field and the generation size of an
+// example (--field=auto and --generationSize=auto).
+//
+// For every candidate configuration, a short calibration run measures the
+// encoding and decoding cost of one generation with the kodo library on
+// this machine, and a model of the example (see kodo-analytic.h) gives the
+// expected number of transmissions. The goodput is the share of the sent
+// bytes that carries source data, g * symbol bytes / (E[T] * packet
+// bytes). The tuner returns the configuration with the highest goodput
+// whose coding cost per source symbol, (E[T] * encode + receivers * decode)
+// / g, is within the CPU budget. If no configuration fits the budget, the
+// cheapest one is returned. Configurations whose coding header leaves no
+// room for a symbol in the packet are not candidates.
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <kodo/block/decoder.hpp>
+#include <kodo/block/encoder.hpp>
+#include <kodo/block/generator/random_uniform.hpp>
+#include <kodo/finite_field.hpp>
+
+class Tuner
+{
+public:
+    // Returns the expected number of transmissions for a field and a
+    // generation size
+    using TransmissionModel =
+        std::function<double(kodo::finite_field, uint32_t)>;
+
+    // Returns the bytes of the coding header for a field and a generation
+    // size
+    using HeaderSize = std::function<uint32_t(kodo::finite_field, uint32_t)>;
+
+    struct Configuration
+    {
+        std::string field;
+        uint32_t generationSize;
+        double transmissions;
+        double goodput;
+        double cpuPerSymbol; // Microseconds per source symbol
+    };
+
+    Tuner(const uint32_t receivers, const uint32_t packetSize,
+          const HeaderSize& headerSize, const double cpuBudget,
+          const TransmissionModel& model) :
+        m_receivers(receivers),
+        m_packetSize(packetSize), m_headerSize(headerSize),
+        m_cpuBudget(cpuBudget), m_model(model)
+    {
+    }
+
+    // Returns the best configuration from the given candidates
+    Configuration Tune(const std::vector<std::string>& fields,
+                       const std::vector<uint32_t>& generationSizes) const
+    {
+        std::vector<Configuration> configurations;
+        for (const auto& field : fields)
+        {
+            for (auto g : generationSizes)
+            {
+                if (Fits(field, g))
+                {
+                    configurations.push_back(Evaluate(field, g));
+                }
+            }
+        }
+
+        std::cout << "Tuning for " << m_receivers << " receivers, CPU budget "
+                  << m_cpuBudget << " us per symbol:" << std::endl;
+        std::cout << "field,generation_size,transmissions,goodput,cpu_us"
+                  << std::endl;
+        for (const auto& c : configurations)
+        {
+            std::cout << c.field << "," << c.generationSize << ","
+                      << c.transmissions << "," << c.goodput << ","
+                      << c.cpuPerSymbol << std::endl;
+        }
+
+        auto best = configurations.end();
+        for (auto it = configurations.begin(); it != configurations.end();
+             it++)
+        {
+            if (it->cpuPerSymbol <= m_cpuBudget &&
+                (best == configurations.end() || it->goodput > best->goodput))
+            {
+                best = it;
+            }
+        }
+        if (best == configurations.end())
+        {
+            best = std::min_element(
+                configurations.begin(), configurations.end(),
+                [](const Configuration& a, const Configuration& b) {
+                    return a.cpuPerSymbol < b.cpuPerSymbol;
+                });
+        }
+
+        std::cout << "Tuned configuration: field " << best->field
+                  << ", generation size " << best->generationSize
+                  << " (goodput " << best->goodput << ", "
+                  << best->cpuPerSymbol << " us per symbol)" << std::endl;
+        return *best;
+    }
+
+    // Returns true if a packet has room for a symbol after the header
+    bool Fits(const std::string& field, uint32_t g) const
+    {
+        return m_headerSize(Field(field), g) < m_packetSize;
+    }
+
+    static kodo::finite_field Field(const std::string& field)
+    {
+        if (field == "binary4")
+        {
+            return kodo::finite_field::binary4;
+        }
+        if (field == "binary8")
+        {
+            return kodo::finite_field::binary8;
+        }
+        if (field == "binary16")
+        {
+            return kodo::finite_field::binary16;
+        }
+        return kodo::finite_field::binary;
+    }
+
+    // Measures the time of encoding one symbol and of decoding a whole
+    // generation. The best of a few rounds is kept to filter out noise.
+    static void Calibrate(kodo::finite_field field, uint32_t g,
+                          uint32_t symbolBytes, double& encodeUs,
+                          double& decodeUs)
+    {
+        using Clock = std::chrono::steady_clock;
+        const uint32_t rounds = 3;
+
+        kodo::block::encoder encoder(field);
+        encoder.configure(g, symbolBytes);
+        std::vector<uint8_t> data(encoder.block_bytes());
+        for (uint32_t i = 0; i < data.size(); i++)
+        {
+            data[i] = uint8_t(i * 7 + 3);
+        }
+        encoder.set_symbols_storage(data.data());
+
+        kodo::block::decoder decoder(field);
+        decoder.configure(g, symbolBytes);
+        std::vector<uint8_t> decoded(decoder.block_bytes());
+
+        kodo::block::generator::random_uniform generator(field);
+        generator.configure(g);
+        std::vector<uint8_t> coefficients(generator.max_coefficients_bytes());
+        std::vector<uint8_t> symbol(symbolBytes);
+
+        encodeUs = 1e12;
+        decodeUs = 1e12;
+        for (uint32_t round = 0; round < rounds; round++)
+        {
+            decoder.reset();
+            decoder.set_symbols_storage(decoded.data());
+            generator.set_seed(round);
+
+            Clock::duration encode(0);
+            Clock::duration decode(0);
+            uint32_t symbols = 0;
+
+            while (!decoder.is_complete())
+            {
+                generator.generate(coefficients.data());
+
+                auto start = Clock::now();
+                encoder.encode_symbol(symbol.data(), coefficients.data());
+                auto encoded = Clock::now();
+                decoder.decode_symbol(symbol.data(), coefficients.data());
+                decode += Clock::now() - encoded;
+                encode += encoded - start;
+                symbols++;
+            }
+
+            encodeUs = std::min(encodeUs, Microseconds(encode) / symbols);
+            decodeUs = std::min(decodeUs, Microseconds(decode));
+        }
+    }
+
+private:
+    Configuration Evaluate(const std::string& field, uint32_t g) const
+    {
+        const uint32_t symbolBytes =
+            m_packetSize - m_headerSize(Field(field), g);
+        double encodeUs = 0.0;
+        double decodeUs = 0.0;
+        Calibrate(Field(field), g, symbolBytes, encodeUs, decodeUs);
+
+        Configuration c;
+        c.field = field;
+        c.generationSize = g;
+        c.transmissions = m_model(Field(field), g);
+        c.goodput = double(g) * symbolBytes / (c.transmissions * m_packetSize);
+        c.cpuPerSymbol =
+            (c.transmissions * encodeUs + m_receivers * decodeUs) / g;
+        return c;
+    }
+
+    static double Microseconds(std::chrono::steady_clock::duration duration)
+    {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+
+private:
+    const uint32_t m_receivers;
+    const uint32_t m_packetSize;
+    const HeaderSize m_headerSize;
+    const double m_cpuBudget;
+    const TransmissionModel m_model;
+};
+
+// Resolves the --field and --generationSize options of an example, where
+// "auto" lets the tuner choose the value. Returns false with a message if
+// the generation size is not a positive number or if the packets have no
+// room for a symbol with the header of the configuration.
+inline bool TuneConfiguration(std::string& field, std::string& generationSize,
+                              const uint32_t receivers,
+                              const uint32_t packetSize,
+                              const Tuner::HeaderSize& headerSize,
+                              const double cpuBudget,
+                              const Tuner::TransmissionModel& model)
+{
+    std::vector<std::string> fields = {field};
+    if (field == "auto")
+    {
+        fields = {"binary", "binary4", "binary8", "binary16"};
+    }
+
+    std::vector<uint32_t> generationSizes = {2, 4, 8, 16, 32, 64, 128};
+    if (generationSize != "auto")
+    {
+        char* end = nullptr;
+        unsigned long g = std::strtoul(generationSize.c_str(), &end, 10);
+        if (!std::isdigit(generationSize.c_str()[0]) || *end != '\0' ||
+            g == 0 || g > UINT32_MAX)
+        {
+            std::cerr << "Invalid generation size: " << generationSize
+                      << std::endl;
+            return false;
+        }
+        generationSizes = {uint32_t(g)};
+    }
+
+    Tuner tuner(receivers, packetSize, headerSize, cpuBudget, model);
+    bool fits = false;
+    for (const auto& f : fields)
+    {
+        for (auto g : generationSizes)
+        {
+            fits |= tuner.Fits(f, g);
+        }
+    }
+    if (!fits)
+    {
+        std::cerr << "A packet of " << packetSize
+                  << " bytes has no room for a symbol after the coding header"
+                  << std::endl;
+        return false;
+    }
+
+    if (field != "auto" && generationSize != "auto")
+    {
+        return true;
+    }
+
+    auto best = tuner.Tune(fields, generationSizes);
+    field = best.field;
+    generationSize = std::to_string(best.generationSize);
+    return true;
+}
@@ -0,0 +1,284 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This example shows inter-flow network coding with the Kodo library in a
+// two-way relay scenario within a ns-3 simulation.
+//
+// Two endpoints exchange one generation each through a relay. The endpoints
+// cannot hear each other, while all packets between an endpoint and the
+// relay are subject to the same random loss as in the kodo-wifi-broadcast
+// example. The relay recodes the packets of both flows and, with mixing
+// enabled, broadcasts the sum of a packet of each flow, which both
+// endpoints can use since they know their own data (see
+// kodo-two-way-relay.h). By default, each endpoint sends a generation of 5
+// packets and 1000 (application) bytes.
+//
+// The considered topology is the following:
+//
+//  +---------------------+     +-----------------+     +---------------------+
+//  | Endpoint 1 (Node 0) |     | Relay (Node 1)  |     | Endpoint 2 (Node 2) |
+//  |    IP: 10.1.1.1     |     |  IP: 10.1.1.2   |     |    IP: 10.1.1.3     |
+//  +----------+----------+     +--------+--------+     +----------+----------+
+//             |                         |                         |
+//             +------- loss ------------+------------ loss -------+
+//                          WiFi 802.11b ad-hoc, random loss
+//
+// With --compare, the exchange is simulated with plain forwarding at the
+// relay and with mixing, using the same random streams, and the number of
+// transmissions saved by mixing is printed:
+//
+// python waf --run kodo-two-way-relay --command-template="%s --compare=1"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <ns3/config-store-module.h>
+#include <ns3/core-module.h>
+#include <ns3/internet-module.h>
+#include <ns3/mobility-module.h>
+#include <ns3/network-module.h>
+#include <ns3/wifi-module.h>
+
+#include "kodo-two-way-relay.h"
+#include <kodo/block/generator/random_uniform.hpp>
+#include <kodo/finite_field.hpp>
+
+using namespace ns3;
+
+int main(int argc, char* argv[])
+{
+    std::string phyMode("DsssRate1Mbps");
+    double minLoss = 98.0 - 40.0; // dBm
+    double maxLoss = 98.0 + 40.0; // dBm
+    uint32_t packetSize = 1000;   // bytes
+    double interval = 1.0;        // seconds
+    uint32_t generationSize = 5;
+    std::string field = "binary"; // Finite field used
+    bool mixing = true;           // Mix the flows at the relay
+    bool compare = false;         // Compare with plain forwarding
+
+    // Create a map for the field values
+    std::map<std::string, kodo::finite_field> fieldMap;
+    fieldMap["binary"] = kodo::finite_field::binary;
+    fieldMap["binary4"] = kodo::finite_field::binary4;
+    fieldMap["binary8"] = kodo::finite_field::binary8;
+    fieldMap["binary16"] = kodo::finite_field::binary16;
+
+    CommandLine cmd;
+
+    cmd.AddValue("phyMode", "Wifi Phy mode", phyMode);
+    cmd.AddValue("minLoss", "Lower bound for receiver random loss", minLoss);
+    cmd.AddValue("maxLoss", "Higher bound for receiver random loss", maxLoss);
+    cmd.AddValue("packetSize", "size of application packet sent", packetSize);
+    cmd.AddValue("interval", "interval (seconds) between packets", interval);
+    cmd.AddValue("generationSize", "Set the generation size to use",
+                 generationSize);
+    cmd.AddValue("field", "Finite field used", field);
+    cmd.AddValue("mixing", "Mix the two flows at the relay", mixing);
+    cmd.AddValue("compare", "Run with and without mixing", compare);
+
+    cmd.Parse(argc, argv);
+
+    // Use the binary field in case of errors
+    if (fieldMap.find(field) == fieldMap.end())
+    {
+        field = "binary";
+    }
+
+    // A packet holds the type, the coefficients of both flows and a symbol
+    if (generationSize == 0)
+    {
+        std::cerr << "Invalid generation size: " << generationSize
+                  << std::endl;
+        return 1;
+    }
+    kodo::block::generator::random_uniform generator(fieldMap[field]);
+    generator.configure(generationSize);
+    uint32_t headerSize = 1 + 2 * generator.max_coefficients_bytes();
+    if (packetSize <= headerSize)
+    {
+        std::cerr << "A packet of " << packetSize
+                  << " bytes has no room for a symbol after the coding header"
+                  << std::endl;
+        return 1;
+    }
+
+    // Convert to time object
+    Time interPacketInterval = Seconds(interval);
+
+    // disable fragmentation and RTS/CTS for frames below 2200 bytes
+    Config::SetDefault("ns3::WifiRemoteStationManager::FragmentationThreshold",
+                       StringValue("2200"));
+    Config::SetDefault("ns3::WifiRemoteStationManager::RtsCtsThreshold",
+                       StringValue("2200"));
+
+    // Fix non-unicast data rate to be the same as that of unicast
+    Config::SetDefault("ns3::WifiRemoteStationManager::NonUnicastMode",
+                       StringValue(phyMode));
+
+    // Endpoint 1, relay and endpoint 2
+    NodeContainer nodes;
+    nodes.Create(3);
+
+    WifiHelper wifi;
+    wifi.SetStandard(WIFI_STANDARD_80211b);
+
+    YansWifiPhyHelper wifiPhy;
+    wifiPhy.SetPcapDataLinkType(YansWifiPhyHelper::DLT_IEEE802_11_RADIO);
+
+    // The random loss of the kodo-wifi-broadcast example is chained with a
+    // matrix loss model, which puts the endpoints out of range of each other
+    Ptr<UniformRandomVariable> random = CreateObject<UniformRandomVariable>();
+    random->SetAttribute("Min", DoubleValue(minLoss));
+    random->SetAttribute("Max", DoubleValue(maxLoss));
+
+    Ptr<RandomPropagationLossModel> randomLoss =
+        CreateObject<RandomPropagationLossModel>();
+    randomLoss->SetAttribute("Variable", PointerValue(random));
+
+    Ptr<MatrixPropagationLossModel> matrixLoss =
+        CreateObject<MatrixPropagationLossModel>();
+    matrixLoss->SetDefaultLoss(0.0);
+    randomLoss->SetNext(matrixLoss);
+
+    Ptr<YansWifiChannel> channel = CreateObject<YansWifiChannel>();
+    channel->SetPropagationLossModel(randomLoss);
+    channel->SetPropagationDelayModel(
+        CreateObject<ConstantSpeedPropagationDelayModel>());
+    wifiPhy.SetChannel(channel);
+
+    // Disable rate control
+    wifi.SetRemoteStationManager("ns3::ConstantRateWifiManager", "DataMode",
+                                 StringValue(phyMode), "ControlMode",
+                                 StringValue(phyMode));
+
+    WifiMacHelper wifiMac;
+    wifiMac.SetType("ns3::AdhocWifiMac");
+
+    NetDeviceContainer devices = wifi.Install(wifiPhy, wifiMac, nodes);
+
+    // The positions are not relevant for the received signal strength
+    MobilityHelper mobility;
+    Ptr<ListPositionAllocator> positionAlloc =
+        CreateObject<ListPositionAllocator>();
+    positionAlloc->Add(Vector(0.0, 0.0, 0.0));
+    positionAlloc->Add(Vector(5.0, 0.0, 0.0));
+    positionAlloc->Add(Vector(10.0, 0.0, 0.0));
+
+    mobility.SetPositionAllocator(positionAlloc);
+    mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
+    mobility.Install(nodes);
+
+    matrixLoss->SetLoss(nodes.Get(0)->GetObject<MobilityModel>(),
+                        nodes.Get(2)->GetObject<MobilityModel>(), 200.0);
+
+    InternetStackHelper internet;
+    internet.Install(nodes);
+
+    Ipv4AddressHelper ipv4;
+    ipv4.SetBase("10.1.1.0", "255.255.255.0");
+    ipv4.Assign(devices);
+
+    // All nodes broadcast their packets
+    TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
+    uint16_t port = 80;
+    InetSocketAddress remote =
+        InetSocketAddress(Ipv4Address("255.255.255.255"), port);
+    InetSocketAddress local = InetSocketAddress(Ipv4Address::GetAny(), port);
+
+    std::vector<Ptr<Socket>> sockets(3);
+    for (uint32_t n = 0; n < 3; n++)
+    {
+        sockets[n] = Socket::CreateSocket(nodes.Get(n), tid);
+        sockets[n]->SetAllowBroadcast(true);
+        sockets[n]->Bind(local);
+        sockets[n]->Connect(remote);
+    }
+
+    std::vector<Ptr<Socket>> endpoints = {sockets[0], sockets[2]};
+    Ptr<Socket> relaySocket = sockets[1];
+
+    TwoWayRelay relay(fieldMap[field], generationSize, packetSize, endpoints,
+                      mixing);
+
+    for (const auto endpoint : endpoints)
+    {
+        endpoint->SetRecvCallback(
+            MakeCallback(&TwoWayRelay::ReceivePacketEndpoint, &relay));
+    }
+    relaySocket->SetRecvCallback(
+        MakeCallback(&TwoWayRelay::ReceivePacketRelay, &relay));
+
+    // Plain forwarding first, so both runs use the same random streams
+    std::vector<bool> modes = {mixing};
+    if (compare)
+    {
+        modes = {false, true};
+    }
+
+    std::vector<uint32_t> transmissions;
+    for (uint32_t run = 0; run < modes.size(); run++)
+    {
+        if (run > 0)
+        {
+            relay.Reset();
+        }
+        relay.SetMixing(modes[run]);
+
+        random->SetStream(0);
+        int64_t stream = 1 + wifi.AssignStreams(devices, 1);
+        relay.AssignStreams(stream);
+
+        // The nodes send in turn within every interval
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            Simulator::ScheduleWithContext(
+                endpoints[i]->GetNode()->GetId(),
+                Seconds(1.0 + interval * i / 3.0),
+                &TwoWayRelay::SendPacketEndpoint, &relay, endpoints[i],
+                interPacketInterval);
+        }
+        Simulator::ScheduleWithContext(
+            relaySocket->GetNode()->GetId(),
+            Seconds(1.0 + interval * 2 / 3.0),
+            &TwoWayRelay::SendPacketRelay, &relay, relaySocket,
+            interPacketInterval);
+
+        {
+            KODO_NS3_PROFILE(relay.GetProfiler(), run);
+            Simulator::Run();
+        }
+        transmissions.push_back(relay.GetTransmissionCount());
+    }
+
+    if (compare)
+    {
+        int32_t saved = int32_t(transmissions[0]) - int32_t(transmissions[1]);
+        std::cout << "Transmissions with plain forwarding: "
+                  << transmissions[0] << std::endl;
+        std::cout << "Transmissions with mixing: " << transmissions[1]
+                  << std::endl;
+        std::cout << "Transmissions saved by mixing: " << saved << " ("
+                  << 100.0 * saved / transmissions[0] << "%)" << std::endl;
+    }
+
+    Simulator::Destroy();
+
+    return 0;
+}
@@ -0,0 +1,390 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This object implements inter-flow network coding in the application layer
+// for a two-way relay topology: endpoint 1 - relay - endpoint 2.
+//
+// Every endpoint encodes its own generation (flow) and sends it to the
+// relay, which keeps one recoder per flow. When both endpoints still need
+// data, the relay recodes a packet of each flow and broadcasts their sum
+// (XOR for the symbol data). An endpoint encodes its own part of the mixed
+// packet from its own data with the coefficients in the header, removes it
+// and decodes the part of the other flow. Without mixing, the relay sends
+// the recoded packets of the two flows in turn.
+//
+// Packet layout: flags (1 byte), the coefficients of flow 1, the
+// coefficients of flow 2 and the symbol data. The flags tell which flows
+// are contained in the packet and whether it was sent by the relay.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <kodo/block/decoder.hpp>
+#include <kodo/block/encoder.hpp>
+#include <kodo/block/generator/random_uniform.hpp>
+#include <kodo/finite_field.hpp>
+
+#include "kodo-profiler.h"
+
+class TwoWayRelay
+{
+public:
+    TwoWayRelay(const kodo::finite_field field, const uint32_t generationSize,
+                const uint32_t packetSize,
+                const std::vector<ns3::Ptr<ns3::Socket>>& endpointSockets,
+                const bool mixing) :
+        m_field(field),
+        m_generationSize(generationSize), m_packetSize(packetSize),
+        m_endpointSockets(endpointSockets), m_mixing(mixing),
+        m_generator(field), m_profiler("TwoWayRelay")
+    {
+        m_generator.configure(m_generationSize);
+        m_coefficientsBytes = m_generator.max_coefficients_bytes();
+        m_symbolBytes = m_packetSize - 1 - 2 * m_coefficientsBytes;
+
+        m_coefficients.resize(m_coefficientsBytes);
+        m_payload.resize(m_packetSize);
+        m_mixed.resize(m_symbolBytes);
+        m_sideInformation.resize(m_symbolBytes);
+
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            // The data of every endpoint is a fixed pattern, so the decoded
+            // data can be verified at the other endpoint
+            m_encoders.emplace_back(m_field);
+            m_encoders[i].configure(m_generationSize, m_symbolBytes);
+            m_data.emplace_back(m_encoders[i].block_bytes());
+            for (uint32_t j = 0; j < m_data[i].size(); j++)
+            {
+                m_data[i][j] = uint8_t(j * 31 + i * 17 + 1);
+            }
+            m_encoders[i].set_symbols_storage(m_data[i].data());
+
+            // Decoder of endpoint i for the flow of the other endpoint
+            m_decoders.emplace_back(m_field);
+            m_decoders[i].configure(m_generationSize, m_symbolBytes);
+            m_decoderBuffers.emplace_back(m_decoders[i].block_bytes());
+            m_decoders[i].set_symbols_storage(m_decoderBuffers[i].data());
+
+            // Recoder of the relay for flow i
+            m_recoders.emplace_back(m_field);
+            m_recoders[i].configure(m_generationSize, m_symbolBytes);
+            m_recoderBuffers.emplace_back(m_recoders[i].block_bytes());
+            m_recoders[i].set_symbols_storage(m_recoderBuffers[i].data());
+        }
+
+        m_seedVariable = ns3::CreateObject<ns3::UniformRandomVariable>();
+        Reset();
+    }
+
+    void SetMixing(bool mixing)
+    {
+        m_mixing = mixing;
+    }
+
+    // Assigns a fixed stream to the random variable of this helper and
+    // returns the number of streams used
+    int64_t AssignStreams(int64_t stream)
+    {
+        m_seedVariable->SetStream(stream);
+        return 1;
+    }
+
+    Profiler& GetProfiler()
+    {
+        return m_profiler;
+    }
+
+    uint32_t GetTransmissionCount() const
+    {
+        return m_endpointTransmissions[0] + m_endpointTransmissions[1] +
+               m_relayTransmissions;
+    }
+
+    // Resets the coding state to run another trial on the same topology
+    void Reset()
+    {
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            m_decoders[i].reset();
+            m_decoders[i].set_symbols_storage(m_decoderBuffers[i].data());
+            m_recoders[i].reset();
+            m_recoders[i].set_symbols_storage(m_recoderBuffers[i].data());
+            m_endpointTransmissions[i] = 0;
+        }
+        m_relayTransmissions = 0;
+        m_mixedTransmissions = 0;
+        m_nextFlow = 0;
+        m_seeded = false;
+    }
+
+    void SendPacketEndpoint(ns3::Ptr<ns3::Socket> socket, ns3::Time pktInterval)
+    {
+        uint32_t i = Endpoint(socket);
+
+        // The endpoint sends until the relay has its whole generation
+        if (m_recoders[i].is_complete())
+        {
+            return;
+        }
+
+        std::cout << "Sending a coded packet from ENDPOINT " << i + 1
+                  << std::endl;
+        SeedGenerator();
+
+        std::fill(m_payload.begin(), m_payload.end(), 0);
+        m_payload[0] = 1 << i;
+        {
+            KODO_NS3_PROFILE(m_profiler, coefficients);
+            m_generator.generate(Coefficients(i));
+        }
+        {
+            KODO_NS3_PROFILE(m_profiler, encode);
+            m_encoders[i].encode_symbol(Symbol(), Coefficients(i));
+        }
+        Send(socket);
+        m_endpointTransmissions[i]++;
+
+        ns3::Simulator::Schedule(pktInterval, &TwoWayRelay::SendPacketEndpoint,
+                                 this, socket, pktInterval);
+    }
+
+    void ReceivePacketRelay(ns3::Ptr<ns3::Socket> socket)
+    {
+        if (!Receive(socket) || (m_payload[0] & m_relayFlag))
+        {
+            return;
+        }
+
+        uint32_t i = m_payload[0] & 1 ? 0 : 1;
+        KODO_NS3_PROFILE(m_profiler, decode);
+        m_recoders[i].decode_symbol(Symbol(), Coefficients(i));
+    }
+
+    void SendPacketRelay(ns3::Ptr<ns3::Socket> socket, ns3::Time pktInterval)
+    {
+        if (m_decoders[0].is_complete() && m_decoders[1].is_complete())
+        {
+            return;
+        }
+
+        // Flow i is useful if the relay has some of it and the other
+        // endpoint has not decoded it yet
+        bool useful[2];
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            useful[i] = m_recoders[i].rank() > 0 &&
+                        !m_decoders[1 - i].is_complete();
+        }
+
+        std::fill(m_payload.begin(), m_payload.end(), 0);
+
+        if (m_mixing && useful[0] && useful[1])
+        {
+            std::cout << "Sending a mixed packet from RELAY" << std::endl;
+            Recode(0);
+            std::copy(Symbol(), Symbol() + m_symbolBytes, m_mixed.begin());
+            Recode(1);
+
+            // The sum of the two symbols in GF(2^m)
+            uint8_t* symbol = Symbol();
+            for (uint32_t b = 0; b < m_symbolBytes; b++)
+            {
+                symbol[b] ^= m_mixed[b];
+            }
+            m_payload[0] = m_relayFlag | 1 | 2;
+            m_mixedTransmissions++;
+        }
+        else if (useful[0] || useful[1])
+        {
+            // Alternate between the useful flows
+            uint32_t i = useful[m_nextFlow] ? m_nextFlow : 1 - m_nextFlow;
+            m_nextFlow = 1 - i;
+
+            std::cout << "Sending a packet of flow " << i + 1 << " from RELAY"
+                      << std::endl;
+            Recode(i);
+            m_payload[0] = m_relayFlag | (1 << i);
+        }
+
+        if (m_payload[0] != 0)
+        {
+            Send(socket);
+            m_relayTransmissions++;
+        }
+
+        ns3::Simulator::Schedule(pktInterval, &TwoWayRelay::SendPacketRelay,
+                                 this, socket, pktInterval);
+    }
+
+    void ReceivePacketEndpoint(ns3::Ptr<ns3::Socket> socket)
+    {
+        uint32_t i = Endpoint(socket);
+        uint32_t other = 1 - i;
+
+        if (!Receive(socket) || !(m_payload[0] & m_relayFlag) ||
+            !(m_payload[0] & (1 << other)) || m_decoders[i].is_complete())
+        {
+            return;
+        }
+
+        // Remove the own flow from a mixed packet. The endpoint knows its
+        // own data, so it can encode its part of the symbol.
+        if (m_payload[0] & (1 << i))
+        {
+            {
+                KODO_NS3_PROFILE(m_profiler, encode);
+                m_encoders[i].encode_symbol(m_sideInformation.data(),
+                                            Coefficients(i));
+            }
+            uint8_t* symbol = Symbol();
+            for (uint32_t b = 0; b < m_symbolBytes; b++)
+            {
+                symbol[b] ^= m_sideInformation[b];
+            }
+        }
+
+        {
+            KODO_NS3_PROFILE(m_profiler, decode);
+            m_decoders[i].decode_symbol(Symbol(), Coefficients(other));
+        }
+
+        if (m_decoders[i].is_complete())
+        {
+            bool verified = std::equal(m_data[other].begin(),
+                                       m_data[other].end(),
+                                       m_decoderBuffers[i].begin());
+            std::cout << "*** ENDPOINT " << i + 1 << " decoded flow "
+                      << other + 1 << (verified ? " (data verified)" : "")
+                      << " ***" << std::endl;
+        }
+
+        if (m_decoders[0].is_complete() && m_decoders[1].is_complete())
+        {
+            std::cout << "Endpoint transmissions: "
+                      << m_endpointTransmissions[0] << " + "
+                      << m_endpointTransmissions[1] << std::endl;
+            std::cout << "Relay transmissions: " << m_relayTransmissions
+                      << " (" << m_mixedTransmissions << " mixed)"
+                      << std::endl;
+            std::cout << "Total transmissions: " << GetTransmissionCount()
+                      << std::endl;
+        }
+    }
+
+private:
+    uint32_t Endpoint(ns3::Ptr<ns3::Socket> socket) const
+    {
+        return socket == m_endpointSockets[0] ? 0 : 1;
+    }
+
+    uint8_t* Coefficients(uint32_t flow)
+    {
+        return m_payload.data() + 1 + flow * m_coefficientsBytes;
+    }
+
+    uint8_t* Symbol()
+    {
+        return m_payload.data() + 1 + 2 * m_coefficientsBytes;
+    }
+
+    // Seeds the coefficient generator from an ns-3 random stream at the
+    // start of every trial
+    void SeedGenerator()
+    {
+        if (!m_seeded)
+        {
+            m_generator.set_seed(m_seedVariable->GetInteger(
+                0, std::numeric_limits<int32_t>::max()));
+            m_seeded = true;
+        }
+    }
+
+    void Recode(uint32_t flow)
+    {
+        SeedGenerator();
+        {
+            KODO_NS3_PROFILE(m_profiler, coefficients);
+            m_generator.generate_recode(m_coefficients.data(),
+                                        m_recoders[flow]);
+        }
+        KODO_NS3_PROFILE(m_profiler, recode);
+        m_recoders[flow].recode_symbol(Symbol(), Coefficients(flow),
+                                       m_coefficients.data());
+    }
+
+    void Send(ns3::Ptr<ns3::Socket> socket)
+    {
+        KODO_NS3_PROFILE(m_profiler, packet);
+        auto packet =
+            ns3::Create<ns3::Packet>(m_payload.data(), m_payload.size());
+        socket->Send(packet);
+    }
+
+    bool Receive(ns3::Ptr<ns3::Socket> socket)
+    {
+        KODO_NS3_PROFILE(m_profiler, packet);
+        auto packet = socket->Recv();
+        if (packet->GetSize() != m_packetSize)
+        {
+            return false;
+        }
+        packet->CopyData(m_payload.data(), m_payload.size());
+        return true;
+    }
+
+    const kodo::finite_field m_field;
+    const uint32_t m_generationSize;
+    const uint32_t m_packetSize;
+    const uint8_t m_relayFlag = 0x80;
+
+    std::vector<ns3::Ptr<ns3::Socket>> m_endpointSockets;
+    bool m_mixing;
+
+    uint32_t m_coefficientsBytes;
+    uint32_t m_symbolBytes;
+
+    std::vector<kodo::block::encoder> m_encoders;
+    std::vector<std::vector<uint8_t>> m_data;
+    std::vector<kodo::block::decoder> m_decoders;
+    std::vector<std::vector<uint8_t>> m_decoderBuffers;
+    std::vector<kodo::block::decoder> m_recoders;
+    std::vector<std::vector<uint8_t>> m_recoderBuffers;
+
+    std::vector<uint8_t> m_payload;
+    std::vector<uint8_t> m_mixed;
+    std::vector<uint8_t> m_sideInformation;
+
+    kodo::block::generator::random_uniform m_generator;
+    std::vector<uint8_t> m_coefficients;
+    ns3::Ptr<ns3::UniformRandomVariable> m_seedVariable;
+    bool m_seeded;
+
+    uint32_t m_endpointTransmissions[2];
+    uint32_t m_relayTransmissions;
+    uint32_t m_mixedTransmissions;
+    uint32_t m_nextFlow;
+
+    Profiler m_profiler;
+};
@@ -0,0 +1,100 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Steinwurf ApS
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This class verifies the decoded blocks against the digests of the source
+// blocks (see kodo-hash.h).
+//
+// The source computes a digest of every generation, which the receivers
+// know as in a manifest of the object, and every decoded block is hashed
+// and compared with it. The blocks that do not match are reported, and the
+// time spent hashing at the receivers is measured on its own, so the cost
+// of the verification is not mixed with the cost of the decoding.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "kodo-hash.h"
+
+class Verifier
+{
+public:
+    Verifier()
+    {
+        Reset();
+    }
+
+    // Returns the digest of a source block
+    uint64_t Digest(const uint8_t* data, uint64_t size) const
+    {
+        return Hash64(data, size);
+    }
+
+    // Returns true if the decoded block matches the digest
+    bool Verify(const uint8_t* data, uint64_t size, uint64_t digest)
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool valid = Hash64(data, size) == digest;
+        m_time += std::chrono::steady_clock::now() - start;
+
+        m_bytes += size;
+        m_verified++;
+        m_corrupted += valid ? 0 : 1;
+        return valid;
+    }
+
+    uint32_t GetVerifiedCount() const
+    {
+        return m_verified;
+    }
+
+    uint32_t GetCorruptedCount() const
+    {
+        return m_corrupted;
+    }
+
+    void Reset()
+    {
+        m_verified = 0;
+        m_corrupted = 0;
+        m_bytes = 0;
+        m_time = std::chrono::steady_clock::duration(0);
+    }
+
+    void Print(std::ostream& out) const
+    {
+        double seconds = std::chrono::duration<double>(m_time).count();
+        out << "Verified blocks: " << m_verified - m_corrupted << " of "
+            << m_verified << " correct (" << m_bytes << " bytes hashed in "
+            << seconds * 1e3 << " ms";
+        if (seconds > 0.0)
+        {
+            out << ", " << m_bytes / seconds / 1e6 << " MB/s";
+        }
+        out << ")" << std::endl;
+    }
+
+private:
+    uint32_t m_verified;
+    uint32_t m_corrupted;
+    uint64_t m_bytes;
+    std::chrono::steady_clock::duration m_time;
+};
@@ -83,6 +83,32 @@
 // parameter of the simulation:
 //
 // python waf --run kodo-wifi-broadcast --command-template="%s --minLoss=30"
+//
+// With the overhearing option, every receiver also recodes for the
+// receivers that are behind it, and a scheduler at the sender picks the
+// transmitter of every interval from the ranks that the receivers advertise
+// (see kodo-opportunistic.h). With the compare option, the source-only
+// broadcast and the overhearing mode are run for 1, 2, 4, ... users and for
+// all users with the same random streams, and the mean airtime and
+// completion time of every user count are printed:
+//
+// python waf --run kodo-wifi-broadcast --command-template="%s --compare=1
+// --users=10 --trials=20"
+//
+// At 1 Mbps, the preamble, the MAC header and the contention before every
+// frame take a large share of the airtime of a 1000-byte packet. With the
+// symbolsPerFrame option, the sender packs several coded symbols into one
+// frame (0 packs as many as fit below the fragmentation threshold, and
+// more than fit is an error). With
+// the comparePacking option, one symbol per frame and the packed frames are
+// run with the same random streams, and their airtime, completion time and
+// goodput are printed:
+//
+// python waf --run kodo-wifi-broadcast --command-template="%s
+// --comparePacking=1 --symbolsPerFrame=0 --packetSize=500 --interval=0.01"
+//
+// Every mode runs the given number of trials and writes its metrics to
+// <metrics>-<mode> when several modes are compared.
 //! [2]
 
 #include <algorithm>
@@ -97,11 +123,137 @@
 #include <ns3/network-module.h>
 #include <ns3/wifi-module.h>
 
+#include "kodo-analytic.h"
 #include "kodo-broadcast.h"
+#include "kodo-opportunistic.h"
+#include "kodo-trials.h"
+#include "kodo-tuner.h"
 #include <kodo/finite_field.hpp>
 //! [3]
 using namespace ns3;
 
+// Adds the transmissions of a PHY to the airtime
+static void AddAirtime(Time* airtime, Time start, Time duration,
+                       WifiPhyState state)
+{
+    if (state == WifiPhyState::TX)
+    {
+        *airtime += duration;
+    }
+}
+
+// Drops the packets of a receiver that does not take part in a mode
+static void DropPacket(Ptr<Socket> socket)
+{
+    while (socket->Recv())
+    {
+    }
+}
+
+// The options and the state of the simulation shared by all modes
+struct TrialSetup
+{
+    uint32_t trials;
+    uint64_t firstRun;
+    Ptr<UniformRandomVariable> random;
+    WifiHelper* wifi;
+    NetDeviceContainer devices;
+    Time* airtime;
+    TrialStatistics statistics;
+    std::string metrics;
+    std::string metricsFormat;
+};
+
+// The means of a mode over its trials
+struct ModeResult
+{
+    uint32_t users;
+    double transmissions;
+    double airtime;    // seconds
+    double completion; // seconds, over the trials that completed
+
+    // Decoded blocks that failed the verification
+    uint32_t corrupted;
+};
+
+// Runs the trials of a mode with a coding helper (Broadcast or
+// Opportunistic) and prints its results. Only the coding state and the
+// random streams are reset between the trials, and trial k of every mode
+// uses the same streams as a separate run with --RngRun=firstRun+k. The
+// metrics of a named mode are written to <metrics>-<name>.
+template <typename Helper, typename Start>
+static ModeResult RunMode(const std::string& name, Helper& helper,
+                          Start start, TrialSetup& setup)
+{
+    if (!name.empty())
+    {
+        std::cout << "*** Mode: " << name << " ***" << std::endl;
+    }
+
+    TrialStatistics statistics = setup.statistics;
+    ModeResult result = {0, 0.0, 0.0, 0.0, 0};
+    uint32_t completed = 0;
+    for (uint32_t trial = 0; trial < setup.trials; trial++)
+    {
+        RngSeedManager::SetRun(setup.firstRun + trial);
+        if (trial > 0)
+        {
+            helper.Reset();
+        }
+        setup.random->SetStream(0);
+        int64_t stream = 1 + setup.wifi->AssignStreams(setup.devices, 1);
+        helper.AssignStreams(stream);
+        *setup.airtime = Seconds(0);
+
+        statistics.StartTrial();
+        start();
+        {
+            KODO_NS3_PROFILE(helper.GetProfiler(), run);
+            Simulator::Run();
+        }
+        statistics.EndTrial(helper.GetTransmissionCount());
+
+        result.transmissions +=
+            double(helper.GetTransmissionCount()) / setup.trials;
+        result.airtime += setup.airtime->GetSeconds() / setup.trials;
+
+        // A trial in which the receivers did not decode has no completion
+        // time
+        double completion = helper.GetCompletionTime().GetSeconds();
+        if (completion > 0.0)
+        {
+            result.completion += completion;
+            completed++;
+        }
+    }
+    if (completed > 0)
+    {
+        result.completion /= completed;
+    }
+    RngSeedManager::SetRun(setup.firstRun);
+    result.corrupted = helper.GetVerifier().GetCorruptedCount();
+
+    helper.PrintSummary(std::cout);
+    std::cout << "Mean transmissions: " << result.transmissions
+              << ", airtime: " << 1e3 * result.airtime
+              << " ms, completion time: " << result.completion << " s ("
+              << completed << " of " << setup.trials
+              << " trials completed)" << std::endl;
+    if (setup.trials > 1)
+    {
+        statistics.Print(std::cout);
+    }
+
+    if (!setup.metrics.empty())
+    {
+        std::string prefix =
+            name.empty() ? setup.metrics : setup.metrics + "-" + name;
+        helper.GetMetrics().Write(prefix, setup.metricsFormat,
+                                  "kodo-wifi-broadcast");
+    }
+    return result;
+}
+
 int main(int argc, char* argv[])
 {
     //! [4]
@@ -113,9 +265,32 @@ int main(int argc, char* argv[])
     double maxLoss = 98.0 + 40.0; // dBm
     uint32_t packetSize = 1000;   // bytes
     double interval = 1.0;        // seconds
-    uint32_t generationSize = 5;
+    std::string generationSize = "5";
     uint32_t users = 2;           // Number of users
     std::string field = "binary"; // Finite field used
+    uint32_t trials = 1;          // Trials on the same topology
+
+    // Prefix and format (csv or omnet) of the metrics output files
+    std::string metrics = "";
+    std::string metricsFormat = "csv";
+
+    // Coding CPU budget (microseconds per source symbol) of the tuner that
+    // chooses the field and the generation size set to auto
+    double cpuBudget = 100.0;
+
+    // Coded packets encoded ahead of the send events in one batch
+    uint32_t batchSize = 1;
+
+    // Coded symbols packed into every frame (0 for as many as fit below the
+    // fragmentation threshold), and whether to compare them with one symbol
+    // per frame
+    uint32_t symbolsPerFrame = 1;
+    bool comparePacking = false;
+
+    // Let the receivers recode for each other (overhearing) or run both the
+    // source-only broadcast and the overhearing mode (compare)
+    bool overhearing = false;
+    bool compare = false;
 
     // Create a map for the field values
     std::map<std::string, kodo::finite_field> fieldMap;
@@ -131,13 +306,48 @@ int main(int argc, char* argv[])
     cmd.AddValue("maxLoss", "Higher bound for receiver random loss", maxLoss);
     cmd.AddValue("packetSize", "size of application packet sent", packetSize);
     cmd.AddValue("interval", "interval (seconds) between packets", interval);
-    cmd.AddValue("generationSize", "Set the generation size to use",
+    cmd.AddValue("generationSize", "Set the generation size to use (or auto)",
                  generationSize);
     cmd.AddValue("users", "Number of receivers", users);
-    cmd.AddValue("field", "Finite field used", field);
+    cmd.AddValue("field", "Finite field used (or auto)", field);
+    cmd.AddValue("cpuBudget", "Coding CPU budget (us per symbol) for auto",
+                 cpuBudget);
+    cmd.AddValue("batchSize", "Coded packets encoded ahead in one batch",
+                 batchSize);
+    cmd.AddValue("symbolsPerFrame", "Coded symbols per frame (0 for auto)",
+                 symbolsPerFrame);
+    cmd.AddValue("comparePacking", "Compare packed frames with one symbol",
+                 comparePacking);
+    cmd.AddValue("overhearing", "Let the receivers recode for each other",
+                 overhearing);
+    cmd.AddValue("compare", "Compare source-only broadcast with overhearing",
+                 compare);
+    cmd.AddValue("metrics", "Prefix of the metrics output (disabled if empty)",
+                 metrics);
+    cmd.AddValue("metricsFormat", "Metrics output format (csv or omnet)",
+                 metricsFormat);
+    cmd.AddValue("trials", "Number of trials on the same topology", trials);
 
     cmd.Parse(argc, argv);
 
+    // The setup time is shared by all trials
+    TrialStatistics trialStatistics;
+
+    // Let the tuner choose the field and the generation size set to auto.
+    // A packet is lost when the random loss exceeds the detection threshold.
+    double erasure = (maxLoss - 98.0) / (maxLoss - minLoss);
+    erasure = std::min(std::max(erasure, 0.0), 1.0);
+    if (!TuneConfiguration(
+            field, generationSize, users, packetSize,
+            [](kodo::finite_field, uint32_t) { return 2 * sizeof(uint32_t); },
+            cpuBudget, [&](kodo::finite_field f, uint32_t g) {
+                std::vector<double> erasures(users, erasure);
+                return BroadcastModel::Mean(BroadcastModel(f, g).Cdf(erasures));
+            }))
+    {
+        return 1;
+    }
+
     // Use the binary field in case of errors
     if (fieldMap.find(field) == fieldMap.end())
     {
@@ -146,10 +356,15 @@ int main(int argc, char* argv[])
 
     // Convert to time object
     Time interPacketInterval = Seconds(interval);
+
+    // The IP, UDP, LLC and MAC headers and the FCS of a frame count toward
+    // the fragmentation threshold
+    const uint32_t fragmentationThreshold = 2200;
+    const uint32_t frameOverhead = 20 + 8 + 8 + 24 + 4;
     //! [5]
     // disable fragmentation for frames below 2200 bytes
     Config::SetDefault("ns3::WifiRemoteStationManager::FragmentationThreshold",
-                       StringValue("2200"));
+                       StringValue(std::to_string(fragmentationThreshold)));
 
     // turn off RTS/CTS for frames below 2200 bytes
     Config::SetDefault("ns3::WifiRemoteStationManager::RtsCtsThreshold",
@@ -234,8 +449,34 @@ int main(int argc, char* argv[])
     }
     //! [11]
     // Creates the Broadcast helper for this broadcast topology
-    Broadcast wifiBroadcast(fieldMap[field], users, generationSize, packetSize,
-                            source, sinks);
+    Broadcast wifiBroadcast(fieldMap[field], users, std::stoul(generationSize),
+                            packetSize, source, sinks);
+    wifiBroadcast.SetLatencyBinWidth(interPacketInterval);
+    wifiBroadcast.SetBatchSize(batchSize);
+
+    // Pack as many symbols as fit in an unfragmented frame, which is also
+    // the packed mode compared with one symbol per frame by default
+    if (symbolsPerFrame == 0 || (comparePacking && symbolsPerFrame == 1))
+    {
+        uint32_t maxFrameSize = fragmentationThreshold - frameOverhead;
+        symbolsPerFrame = 1;
+        while (symbolsPerFrame < 255 &&
+               wifiBroadcast.GetFrameSize(symbolsPerFrame + 1) <= maxFrameSize)
+        {
+            symbolsPerFrame++;
+        }
+    }
+    // Fragmented frames would distort the airtime of the packed mode
+    if (symbolsPerFrame > 1 &&
+        wifiBroadcast.GetFrameSize(symbolsPerFrame) + frameOverhead >
+            fragmentationThreshold)
+    {
+        std::cerr << "Frames of " << symbolsPerFrame << " symbols exceed "
+                  << "the fragmentation threshold of "
+                  << fragmentationThreshold << " bytes" << std::endl;
+        return 1;
+    }
+    wifiBroadcast.SetSymbolsPerFrame(symbolsPerFrame);
     //! [12]
     // Transmitter socket connections. Set transmitter for broadcasting
     uint16_t port = 80;
@@ -253,19 +494,202 @@ int main(int argc, char* argv[])
             MakeCallback(&Broadcast::ReceivePacket, &wifiBroadcast));
     }
 
+    // In the overhearing modes, all nodes send and receive on the same
+    // broadcast socket
+    if (overhearing || compare)
+    {
+        source->Bind(local);
+        for (const auto sink : sinks)
+        {
+            sink->SetAllowBroadcast(true);
+            sink->Connect(remote);
+        }
+    }
+
     // Turn on global static routing so we can be routed across the network
     Ipv4GlobalRoutingHelper::PopulateRoutingTables();
     //! [13]
     // Pcap tracing
     // wifiPhy.EnablePcap ("kodo-wifi-broadcast", devices);
 
-    Simulator::ScheduleWithContext(source->GetNode()->GetId(), Seconds(1.0),
-                                   &Broadcast::SendPacket, &wifiBroadcast,
-                                   source, interPacketInterval);
+    // The airtime of the transmissions of all nodes
+    Time airtime;
+    Config::ConnectWithoutContext(
+        "/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/Phy/State/State",
+        MakeBoundCallback(&AddAirtime, &airtime));
+
+    trialStatistics.SetupDone();
+    TrialSetup setup = {std::max<uint32_t>(trials, 1),
+                        RngSeedManager::GetRun(),
+                        random,
+                        &wifi,
+                        devices,
+                        &airtime,
+                        trialStatistics,
+                        metrics,
+                        metricsFormat};
+    //! [14]
+
+    std::vector<ModeResult> results;
+    if (overhearing || compare)
+    {
+        // With compare, the source-only broadcast and the overhearing mode
+        // run for 1, 2, 4, ... users and for all users. The receivers that
+        // do not take part only drop their packets.
+        std::vector<uint32_t> userCounts = {users};
+        std::vector<bool> modes = {true};
+        if (compare)
+        {
+            userCounts.clear();
+            for (uint32_t u = 1; u < users; u *= 2)
+            {
+                userCounts.push_back(u);
+            }
+            userCounts.push_back(users);
+            modes = {false, true};
+        }
+
+        for (uint32_t u : userCounts)
+        {
+            for (bool mode : modes)
+            {
+                std::vector<Ptr<Socket>> sockets = {source};
+                sockets.insert(sockets.end(), sinks.begin(),
+                               sinks.begin() + u);
+
+                Opportunistic opportunistic(fieldMap[field],
+                                            std::stoul(generationSize),
+                                            packetSize, sockets);
+                opportunistic.SetOverhearing(mode);
+                opportunistic.SetBatchSize(batchSize);
+                for (uint32_t n = 0; n <= users; n++)
+                {
+                    Ptr<Socket> socket = n == 0 ? source : sinks[n - 1];
+                    if (n <= u)
+                    {
+                        socket->SetRecvCallback(MakeCallback(
+                            &Opportunistic::ReceivePacket, &opportunistic));
+                    }
+                    else
+                    {
+                        socket->SetRecvCallback(MakeCallback(&DropPacket));
+                    }
+                }
+
+                std::string name;
+                if (compare)
+                {
+                    name = (mode ? "overhearing-" : "source-") +
+                           std::to_string(u);
+                }
+                results.push_back(RunMode(
+                    name, opportunistic,
+                    [&]() {
+                        Simulator::ScheduleWithContext(
+                            source->GetNode()->GetId(), Seconds(1.0),
+                            &Opportunistic::Slot, &opportunistic,
+                            interPacketInterval);
+                    },
+                    setup));
+                results.back().users = u;
+            }
+        }
+    }
+    else
+    {
+        //! [15]
+        auto runBroadcast = [&](const std::string& name, Broadcast& broadcast) {
+            for (const auto sink : sinks)
+            {
+                sink->SetRecvCallback(
+                    MakeCallback(&Broadcast::ReceivePacket, &broadcast));
+            }
+            results.push_back(RunMode(
+                name, broadcast,
+                [&]() {
+                    Simulator::ScheduleWithContext(
+                        source->GetNode()->GetId(), Seconds(1.0),
+                        &Broadcast::SendPacket, &broadcast, source,
+                        interPacketInterval);
+                },
+                setup));
+            results.back().users = users;
+        };
+
+        // With comparePacking, one symbol per frame runs first with the same
+        // random streams as the packed frames
+        if (comparePacking)
+        {
+            Broadcast single(fieldMap[field], users,
+                             std::stoul(generationSize), packetSize, source,
+                             sinks);
+            single.SetLatencyBinWidth(interPacketInterval);
+            single.SetBatchSize(batchSize);
+            runBroadcast("frames-1", single);
+            runBroadcast("frames-" + std::to_string(symbolsPerFrame),
+                         wifiBroadcast);
+        }
+        else
+        {
+            runBroadcast("", wifiBroadcast);
+        }
+        //! [16]
+    }
+
+    if (compare)
+    {
+        std::cout << "users,source_airtime_ms,overhearing_airtime_ms,"
+                     "airtime_saved_pct,source_completion_s,"
+                     "overhearing_completion_s,completion_saved_pct"
+                  << std::endl;
+        for (uint32_t k = 0; k + 1 < results.size(); k += 2)
+        {
+            const ModeResult& a = results[k];
+            const ModeResult& b = results[k + 1];
+            std::cout << a.users << "," << 1e3 * a.airtime << ","
+                      << 1e3 * b.airtime << ","
+                      << 100.0 * (1.0 - b.airtime / a.airtime) << ","
+                      << a.completion << "," << b.completion << ","
+                      << 100.0 * (1.0 - b.completion / a.completion)
+                      << std::endl;
+        }
+    }
+
+    if (comparePacking && !(overhearing || compare))
+    {
+        // Goodput of the object over the completion time and over the
+        // airtime, which is only taken by the sender
+        double bits = 8.0 * wifiBroadcast.GetObjectSize();
+        std::vector<uint32_t> frames = {1, symbolsPerFrame};
+        for (uint32_t k = 0; k < results.size(); k++)
+        {
+            std::cout << frames[k] << " symbols per frame: goodput "
+                      << bits / results[k].completion / 1e6 << " Mbps ("
+                      << bits / results[k].airtime / 1e6
+                      << " Mbps of airtime)" << std::endl;
+        }
+        std::cout << "Airtime goodput gain of packing: "
+                  << 100.0 * (results[0].airtime / results[1].airtime - 1.0)
+                  << "%" << std::endl;
+    }
+
+    // Read by the kodo-benchmark suite
+    std::cout << "Simulator events: " << Simulator::GetEventCount()
+              << std::endl;
 
-    Simulator::Run();
     Simulator::Destroy();
 
+    // A block that does not match its digest fails the run
+    uint32_t corrupted = 0;
+    for (const auto& result : results)
+    {
+        corrupted += result.corrupted;
+    }
+    if (corrupted > 0)
+    {
+        std::cerr << corrupted << " decoded blocks failed the verification"
+                  << std::endl;
+        return 1;
+    }
     return 0;
-    //! [14]
 }
@@ -66,31 +66,144 @@
 //
 // The parameters that can be modified are: generationSize, packetSize, ns-3
 // simulation interval, errorRate in the devices and total number of users.
+//
+// With --channel=fast, the point-to-point star and the IP/UDP stack are
+// replaced by a direct erasure channel with the same error models (see
+// kodo-erasure-channel.h), which is much faster for large sweeps.
+//
+// With --topology=csma, the star is replaced by a shared bus and with
+// --topology=multicast by an IP multicast tree (see --fanout), so a coded
+// packet is sent once instead of once per receiver. Every receiver loses
+// the packets with errorRate on its path from the encoder in all
+// topologies, so the transmissions of the topologies can be compared. With
+// --topologyStats, the number of frames sent on all links and the wall
+// time are printed as well.
+//
+// With --input, the sender transmits a file, generation by generation,
+// and with --output, receiver n decodes into the file <output>-n. Both are
+// memory-mapped and coded in place, and the pages of every generation are
+// released once all receivers have decoded it, so objects larger than the
+// memory can be sent (see kodo-mapped-file.h). The network goodput and the
+// I/O throughput are printed:
+//
+// python waf --run kodo-wired-broadcast --command-template="%s
+// --channel=fast --interval=0.001 --input=object.bin --output=decoded"
+//
+// With --targetProbability, the source is open-loop: it sends a burst per
+// generation that all receivers decode with the target probability,
+// according to loss rates estimated from sparse receiver reports (see
+// kodo-redundancy.h), instead of sending until all receivers have decoded.
+// The achieved decoding probability and the channel overhead are printed:
+//
+// python waf --run kodo-wired-broadcast --command-template="%s
+// --channel=fast --trials=1000 --targetProbability=0.99"
+//
+// With --symbolsPerFrame, the sender packs several coded symbols of a
+// generation into one packet (see kodo-broadcast.h). The open-loop source
+// ends a frame with its burst, so the last frame of a burst can be shorter.
+
+#include <sys/resource.h>
 
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <ns3/config-store-module.h>
 #include <ns3/core-module.h>
+#include <ns3/csma-module.h>
 #include <ns3/internet-module.h>
 #include <ns3/network-module.h>
 #include <ns3/point-to-point-star.h>
 
+#include "kodo-analytic.h"
 #include "kodo-broadcast.h"
+#include "kodo-erasure-channel.h"
+#include "kodo-error-models.h"
+#include "kodo-mapped-file.h"
+#include "kodo-redundancy.h"
+#include "kodo-trials.h"
+#include "kodo-tuner.h"
 #include <kodo/finite_field.hpp>
 
 using namespace ns3;
 
+static void CountLinkTransmission(uint64_t* count, Ptr<const Packet> packet)
+{
+    (*count)++;
+}
+
+// Passes a packet to decoder n unless the error model of its path drops it
+static void ReceiveFromPath(Broadcast* broadcast, Ptr<ErrorModel> errorModel,
+                            uint32_t n, Ptr<Socket> socket)
+{
+    Ptr<Packet> packet = socket->Recv();
+    if (!errorModel->IsCorrupt(packet))
+    {
+        broadcast->Receive(n, packet);
+    }
+}
+
 int main(int argc, char* argv[])
 {
     // Default values
-    uint32_t packetSize = 1000;   // Application bytes per packet
-    double interval = 1.0;        // Time between events
-    uint32_t generationSize = 5;  // RLNC generation size
-    double errorRate = 0.3;       // Error rate for all the links
-    uint32_t users = 2;           // Number of users
-    std::string field = "binary"; // Finite field used
+    uint32_t packetSize = 1000;       // Application bytes per packet
+    double interval = 1.0;            // Time between events
+    std::string generationSize = "5"; // RLNC generation size
+    double errorRate = 0.3;           // Error rate for all the links
+    uint32_t users = 2;               // Number of users
+    std::string field = "binary";     // Finite field used
+    uint32_t trials = 1;              // Trials on the same topology
+
+    // Prefix and format (csv or omnet) of the metrics output files
+    std::string metrics = "";
+    std::string metricsFormat = "csv";
+
+    // Channel backend: the full IP/UDP stack of the point-to-point star
+    // (stack) or a direct erasure channel (fast) with the given delay (ms)
+    std::string channel = "stack";
+    double channelDelay = 1.0;
+
+    // Topology of the stack channel: point-to-point star (star), shared
+    // bus (csma) or multicast tree with the given fan-out (multicast)
+    std::string topology = "star";
+    uint32_t fanout = 2;
+    bool topologyStats = false;
+
+    // Loss model of the links: rate (i.i.d.), gilbert (bursts with the
+    // given mean length) or trace (replay of a recorded loss trace)
+    std::string lossModel = "rate";
+    double burstLength = 4.0;
+    std::string lossTrace = "";
+
+    // Coding CPU budget (microseconds per source symbol) of the tuner that
+    // chooses the field and the generation size set to auto
+    double cpuBudget = 100.0;
+
+    // Coded packets encoded ahead of the send events in one batch
+    uint32_t batchSize = 1;
+
+    // Reject the non-innovative packets before decoding their payload
+    bool innovationFilter = true;
+
+    // Decode binary generations of up to 64 symbols with the small decoder
+    bool smallDecoders = true;
+
+    // File to send (input) and prefix of the files that the receivers
+    // decode into (output), both memory-mapped
+    std::string input = "";
+    std::string output = "";
+
+    // Target decoding probability of the open-loop source (closed-loop if
+    // zero), generations between the reports of a receiver and the loss
+    // rate assumed before the first reports
+    double targetProbability = 0.0;
+    uint32_t reportInterval = 4;
+    double priorLoss = 0.2;
+
+    // Coded symbols packed into every packet
+    uint32_t symbolsPerFrame = 1;
 
     // Create a map for the field values
     std::map<std::string, kodo::finite_field> fieldMap;
@@ -99,20 +212,78 @@ int main(int argc, char* argv[])
     fieldMap["binary8"] = kodo::finite_field::binary8;
     fieldMap["binary16"] = kodo::finite_field::binary16;
 
-    Time interPacketInterval = Seconds(interval);
-
     CommandLine cmd;
 
     cmd.AddValue("packetSize", "Size of application packet sent", packetSize);
     cmd.AddValue("interval", "Interval (seconds) between packets", interval);
-    cmd.AddValue("generationSize", "Set the generation size to use",
+    cmd.AddValue("generationSize", "Set the generation size to use (or auto)",
                  generationSize);
     cmd.AddValue("errorRate", "Packet erasure rate for the links", errorRate);
     cmd.AddValue("users", "Number of receivers", users);
-    cmd.AddValue("field", "Finite field used", field);
+    cmd.AddValue("field", "Finite field used (or auto)", field);
+    cmd.AddValue("cpuBudget", "Coding CPU budget (us per symbol) for auto",
+                 cpuBudget);
+    cmd.AddValue("batchSize", "Coded packets encoded ahead in one batch",
+                 batchSize);
+    cmd.AddValue("innovationFilter",
+                 "Reject non-innovative packets before decoding",
+                 innovationFilter);
+    cmd.AddValue("smallDecoders", "Use the small decoder for small generations",
+                 smallDecoders);
+    cmd.AddValue("input", "File to send (zero-filled generation if empty)",
+                 input);
+    cmd.AddValue("output", "Prefix of the files decoded by the receivers",
+                 output);
+    cmd.AddValue("targetProbability",
+                 "Decoding probability of the open-loop source (0 = closed)",
+                 targetProbability);
+    cmd.AddValue("reportInterval", "Generations between receiver reports",
+                 reportInterval);
+    cmd.AddValue("priorLoss", "Loss rate assumed before the first reports",
+                 priorLoss);
+    cmd.AddValue("symbolsPerFrame", "Coded symbols packed into every packet",
+                 symbolsPerFrame);
+    cmd.AddValue("metrics", "Prefix of the metrics output (disabled if empty)",
+                 metrics);
+    cmd.AddValue("metricsFormat", "Metrics output format (csv or omnet)",
+                 metricsFormat);
+    cmd.AddValue("trials", "Number of trials on the same topology", trials);
+    cmd.AddValue("channel", "Channel backend (stack or fast)", channel);
+    cmd.AddValue("channelDelay", "Delay (ms) of the fast channel",
+                 channelDelay);
+    cmd.AddValue("topology", "Topology (star, csma or multicast)", topology);
+    cmd.AddValue("fanout", "Fan-out of the multicast tree", fanout);
+    cmd.AddValue("topologyStats", "Print the link transmissions and wall time",
+                 topologyStats);
+    cmd.AddValue("lossModel", "Loss model (rate, gilbert or trace)",
+                 lossModel);
+    cmd.AddValue("burstLength", "Mean burst length of the gilbert model",
+                 burstLength);
+    cmd.AddValue("lossTrace", "Loss trace file of the trace model", lossTrace);
 
     cmd.Parse(argc, argv);
 
+    NS_ABORT_MSG_IF(fanout == 0, "The fan-out of the multicast tree must be "
+                                 "positive");
+
+    // Convert to time object
+    Time interPacketInterval = Seconds(interval);
+
+    // The setup time is shared by all trials
+    TrialStatistics trialStatistics;
+
+    // Let the tuner choose the field and the generation size set to auto
+    if (!TuneConfiguration(
+            field, generationSize, users, packetSize,
+            [](kodo::finite_field, uint32_t) { return 2 * sizeof(uint32_t); },
+            cpuBudget, [&](kodo::finite_field f, uint32_t g) {
+                std::vector<double> erasures(users, errorRate);
+                return BroadcastModel::Mean(BroadcastModel(f, g).Cdf(erasures));
+            }))
+    {
+        return 1;
+    }
+
     // Use the binary field in case of errors
     if (fieldMap.find(field) == fieldMap.end())
     {
@@ -120,85 +291,390 @@ int main(int argc, char* argv[])
     }
 
     Time::SetResolution(Time::NS);
-    //! [2]
-    // Set the basic helper for a single link
-    PointToPointHelper pointToPoint;
 
-    // N receivers against a centralized hub.
-    PointToPointStarHelper star(users, pointToPoint);
-
-    // Set error model for the net devices
-    Config::SetDefault("ns3::RateErrorModel::ErrorUnit",
-                       StringValue("ERROR_UNIT_PACKET"));
+    //! [4]
+    // Set an independent error model for every link
+    std::shared_ptr<const LossTrace> trace;
+    if (lossModel == "trace")
+    {
+        trace = std::make_shared<LossTrace>(lossTrace);
+    }
 
-    std::vector<Ptr<RateErrorModel>> errorModel(users,
-                                                CreateObject<RateErrorModel>());
+    std::vector<Ptr<ErrorModel>> errorModel(users);
 
     for (uint32_t n = 0; n < users; n++)
     {
-        errorModel[n]->SetAttribute("ErrorRate", DoubleValue(errorRate));
-        star.GetSpokeNode(n)->GetDevice(0)->SetAttribute(
-            "ReceiveErrorModel", PointerValue(errorModel[n]));
+        errorModel[n] = CreateErrorModel(lossModel, errorRate, burstLength,
+                                         trace, n, users);
         errorModel[n]->Enable();
     }
+    //! [5]
 
-    // Setting IP protocol stack
-    InternetStackHelper internet;
-    star.InstallStack(internet);
-
-    // Set IP addresses
-    star.AssignIpv4Addresses(Ipv4AddressHelper("10.1.1.0", "255.255.255.0"));
-    //! [3]
-    // Setting up application socket parameters for transmitter and
-    // receiver sockets
-    TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
-
-    // Transmitter socket
-    Ptr<Socket> source = Socket::CreateSocket(star.GetHub(), tid);
-
-    // Transmitter socket connections. Set transmitter for broadcasting
-    uint16_t port = 80;
-    InetSocketAddress remote =
-        InetSocketAddress(Ipv4Address("255.255.255.255"), port);
-    source->SetAllowBroadcast(true);
-    source->Connect(remote);
-
-    // Receiver sockets
+    Ptr<Socket> source;
     std::vector<Ptr<Socket>> sinks(users);
+    uint32_t sourceContext = 0;
+    uint64_t linkTransmissions = 0;
+    ErasureChannel erasureChannel(MilliSeconds(channelDelay));
 
-    for (uint32_t n = 0; n < users; n++)
+    if (channel == "fast")
+    {
+        // The packets go directly from the encoder to the error models of
+        // the decoders, no nodes or sockets are needed
+        for (uint32_t n = 0; n < users; n++)
+        {
+            erasureChannel.AddReceiver(errorModel[n]);
+        }
+    }
+    else
     {
-        sinks[n] = Socket::CreateSocket(star.GetSpokeNode(n), tid);
+        // The encoder node and the decoder nodes of the topology, and the
+        // destination of the coded packets
+        Ptr<Node> hub;
+        NodeContainer receivers;
+        Ipv4Address destination("255.255.255.255");
+
+        if (topology == "csma")
+        {
+            // All nodes share a single bus, so a coded packet is sent once
+            NodeContainer bus;
+            bus.Create(users + 1);
+
+            CsmaHelper csma;
+            csma.SetChannelAttribute("DataRate", StringValue("5Mbps"));
+            csma.SetChannelAttribute("Delay", TimeValue(MilliSeconds(2)));
+            NetDeviceContainer devices = csma.Install(bus);
+
+            for (uint32_t n = 0; n < users; n++)
+            {
+                devices.Get(n + 1)->SetAttribute("ReceiveErrorModel",
+                                                 PointerValue(errorModel[n]));
+            }
+
+            InternetStackHelper internet;
+            internet.Install(bus);
+
+            Ipv4AddressHelper address("10.1.0.0", "255.255.0.0");
+            address.Assign(devices);
+
+            hub = bus.Get(0);
+            for (uint32_t n = 0; n < users; n++)
+            {
+                receivers.Add(bus.Get(n + 1));
+            }
+        }
+        else if (topology == "multicast")
+        {
+            // The encoder (node 0) sends to a router (node 1) at the root of
+            // a tree with the given fan-out, where decoder n is node n + 2.
+            // Every node of the tree delivers the packets of the multicast
+            // group locally and forwards them to its children, so a coded
+            // packet crosses every link once. The links are lossless and the
+            // error model of decoder n is applied to the packets delivered
+            // to it, since losses on the links would add up along the
+            // deeper paths.
+            NodeContainer tree;
+            tree.Create(users + 2);
+
+            InternetStackHelper internet;
+            internet.Install(tree);
+
+            PointToPointHelper pointToPoint;
+            Ipv4AddressHelper address("10.2.0.0", "255.255.255.252");
+
+            NetDeviceContainer sourceLink =
+                pointToPoint.Install(tree.Get(0), tree.Get(1));
+            Ipv4Address sourceAddress =
+                address.Assign(sourceLink).GetAddress(0);
+            address.NewNetwork();
+
+            std::vector<Ptr<NetDevice>> input(users + 2);
+            std::vector<NetDeviceContainer> output(users + 2);
+            input[1] = sourceLink.Get(1);
+
+            for (uint32_t n = 0; n < users; n++)
+            {
+                uint32_t parent = n < fanout ? 1 : n / fanout + 1;
+                NetDeviceContainer link =
+                    pointToPoint.Install(tree.Get(parent), tree.Get(n + 2));
+                address.Assign(link);
+                address.NewNetwork();
+
+                output[parent].Add(link.Get(0));
+                input[n + 2] = link.Get(1);
+            }
+
+            destination = Ipv4Address("225.1.2.4");
+            Ipv4StaticRoutingHelper multicast;
+            multicast.SetDefaultMulticastRoute(tree.Get(0), sourceLink.Get(0));
+
+            for (uint32_t node = 1; node < users + 2; node++)
+            {
+                if (output[node].GetN() > 0)
+                {
+                    multicast.AddMulticastRoute(tree.Get(node), sourceAddress,
+                                                destination, input[node],
+                                                output[node]);
+                }
+            }
+
+            hub = tree.Get(0);
+            for (uint32_t n = 0; n < users; n++)
+            {
+                receivers.Add(tree.Get(n + 2));
+            }
+        }
+        else
+        {
+            //! [2]
+            // Set the basic helper for a single link
+            PointToPointHelper pointToPoint;
+
+            // N receivers against a centralized hub.
+            PointToPointStarHelper star(users, pointToPoint);
+
+            for (uint32_t n = 0; n < users; n++)
+            {
+                star.GetSpokeNode(n)->GetDevice(0)->SetAttribute(
+                    "ReceiveErrorModel", PointerValue(errorModel[n]));
+            }
+
+            // Setting IP protocol stack
+            InternetStackHelper internet;
+            star.InstallStack(internet);
+
+            // Set IP addresses
+            star.AssignIpv4Addresses(
+                Ipv4AddressHelper("10.1.1.0", "255.255.255.0"));
+            //! [3]
+            hub = star.GetHub();
+            for (uint32_t n = 0; n < users; n++)
+            {
+                receivers.Add(star.GetSpokeNode(n));
+            }
+
+            // Turn on global static routing so we can be routed across the
+            // network
+            Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+
+            // Do pcap tracing on all point-to-point devices on all nodes
+            // pointToPoint.EnablePcapAll ("kodo-wired-broadcast");
+        }
+
+        // Setting up application socket parameters for transmitter and
+        // receiver sockets
+        TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
+
+        // Transmitter socket
+        source = Socket::CreateSocket(hub, tid);
+        sourceContext = hub->GetId();
+
+        // Transmitter socket connections. Set transmitter for broadcasting
+        uint16_t port = 80;
+        InetSocketAddress remote = InetSocketAddress(destination, port);
+        source->SetAllowBroadcast(true);
+        source->Connect(remote);
+
+        // Receiver sockets
+        InetSocketAddress local =
+            InetSocketAddress(Ipv4Address::GetAny(), port);
+
+        for (uint32_t n = 0; n < users; n++)
+        {
+            sinks[n] = Socket::CreateSocket(receivers.Get(n), tid);
+            sinks[n]->Bind(local);
+        }
+
+        // Count the frames sent on all links to compare the topologies
+        Config::ConnectWithoutContext(
+            "/NodeList/*/DeviceList/*/$ns3::PointToPointNetDevice/PhyTxBegin",
+            MakeBoundCallback(&CountLinkTransmission, &linkTransmissions));
+        Config::ConnectWithoutContext(
+            "/NodeList/*/DeviceList/*/$ns3::CsmaNetDevice/PhyTxBegin",
+            MakeBoundCallback(&CountLinkTransmission, &linkTransmissions));
     }
 
     // Check for finite field employed and
     // Creates the Broadcast helper for this broadcast topology
 
-    Broadcast wiredBroadcast(fieldMap[field], users, generationSize, packetSize,
-                             source, sinks);
+    Broadcast wiredBroadcast(fieldMap[field], users,
+                             std::stoul(generationSize), packetSize, source,
+                             sinks);
+    wiredBroadcast.SetLatencyBinWidth(interPacketInterval);
+    wiredBroadcast.SetBatchSize(batchSize);
+    wiredBroadcast.SetInnovationFilter(innovationFilter);
+    wiredBroadcast.SetSmallDecoders(smallDecoders);
+    wiredBroadcast.SetSymbolsPerFrame(symbolsPerFrame);
+
+    // The loss estimates of the open-loop source carry over the trials
+    std::unique_ptr<RedundancyController> controller;
+    if (targetProbability > 0.0)
+    {
+        controller.reset(new RedundancyController(
+            fieldMap[field], std::stoul(generationSize), users,
+            targetProbability, reportInterval, priorLoss));
+        wiredBroadcast.SetRedundancyController(controller.get());
+    }
+
+    // Encode from and decode into memory-mapped files
+    std::unique_ptr<MappedFile> inputFile;
+    std::vector<std::unique_ptr<MappedFile>> outputFiles;
+    if (!input.empty())
+    {
+        inputFile.reset(new MappedFile(input));
+        if (!inputFile->IsValid())
+        {
+            return 1;
+        }
+        inputFile->AdviseSequential();
+        wiredBroadcast.SetObject(inputFile->GetData(), inputFile->GetSize());
+    }
+    for (uint32_t n = 0; !output.empty() && n < users; n++)
+    {
+        outputFiles.emplace_back(
+            new MappedFile(output + "-" + std::to_string(n + 1),
+                           wiredBroadcast.GetObjectSize()));
+        if (!outputFiles.back()->IsValid())
+        {
+            return 1;
+        }
+        wiredBroadcast.SetOutput(n, outputFiles.back()->GetData());
+    }
+    wiredBroadcast.SetGenerationCallback(
+        [&](uint32_t generation, uint64_t offset, uint64_t size) {
+            if (inputFile)
+            {
+                inputFile->Release(offset, size);
+            }
+            for (const auto& file : outputFiles)
+            {
+                file->Release(offset, size);
+            }
+        });
+
+    // Connect the helper to the channel
+    if (channel == "fast")
+    {
+        wiredBroadcast.SetSendCallback([&erasureChannel](Ptr<Packet> packet) {
+            erasureChannel.Send(packet);
+        });
+        erasureChannel.SetReceiveCallback(
+            [&wiredBroadcast](uint32_t n, Ptr<Packet> packet) {
+                wiredBroadcast.Receive(n, packet);
+            });
+    }
+    else if (topology == "multicast")
+    {
+        for (uint32_t n = 0; n < users; n++)
+        {
+            sinks[n]->SetRecvCallback(MakeBoundCallback(
+                &ReceiveFromPath, &wiredBroadcast, errorModel[n], n));
+        }
+    }
+    else
+    {
+        for (const auto sink : sinks)
+        {
+            sink->SetRecvCallback(
+                MakeCallback(&Broadcast::ReceivePacket, &wiredBroadcast));
+        }
+    }
+
+    trialStatistics.SetupDone();
+    uint64_t firstRun = RngSeedManager::GetRun();
+    uint64_t codedTransmissions = 0;
+    Time networkTime = Seconds(0);
+    auto start = std::chrono::steady_clock::now();
 
-    // Receiver socket connections
-    InetSocketAddress local = InetSocketAddress(Ipv4Address::GetAny(), port);
+    for (uint32_t trial = 0; trial < trials; trial++)
+    {
+        // Only the coding state and the random streams are reset between
+        // the trials. Trial k uses the same streams as a separate run with
+        // --RngRun=firstRun+k.
+        if (trial > 0)
+        {
+            RngSeedManager::SetRun(firstRun + trial);
+            wiredBroadcast.Reset();
+        }
+        for (uint32_t n = 0; n < users; n++)
+        {
+            AssignErrorModelStreams(errorModel[n], n);
+        }
+        wiredBroadcast.AssignStreams(users);
+
+        trialStatistics.StartTrial();
+        Time trialStart = Simulator::Now() + Seconds(1.0);
+        Simulator::ScheduleWithContext(sourceContext, Seconds(1.0),
+                                       &Broadcast::SendPacket, &wiredBroadcast,
+                                       source, interPacketInterval);
+
+        {
+            KODO_NS3_PROFILE(wiredBroadcast.GetProfiler(), run);
+            Simulator::Run();
+        }
+        trialStatistics.EndTrial(wiredBroadcast.GetTransmissionCount());
+        codedTransmissions += wiredBroadcast.GetTransmissionCount();
+        networkTime += Simulator::Now() - trialStart;
+    }
 
-    for (const auto sink : sinks)
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (topologyStats)
     {
-        sink->Bind(local);
-        sink->SetRecvCallback(
-            MakeCallback(&Broadcast::ReceivePacket, &wiredBroadcast));
+        if (channel != "fast" && codedTransmissions > 0)
+        {
+            std::cout << "Link transmissions (" << topology
+                      << "): " << linkTransmissions << " ("
+                      << double(linkTransmissions) / codedTransmissions
+                      << " per coded packet)" << std::endl;
+        }
+        std::cout << "Simulation wall time: " << elapsed.count() << " s"
+                  << std::endl;
     }
 
-    // Turn on global static routing so we can be routed across the network
-    Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+    // The goodput is in simulated time and the I/O throughput in wall time
+    double objectBytes = double(wiredBroadcast.GetObjectSize()) * trials;
+    std::cout << "Object: " << wiredBroadcast.GetObjectSize() << " bytes in "
+              << wiredBroadcast.GetGenerationCount() << " generations"
+              << std::endl;
+    std::cout << "Network goodput: "
+              << objectBytes * 8 / networkTime.GetSeconds() / 1e6
+              << " Mbit/s per receiver" << std::endl;
+    if (inputFile || !outputFiles.empty())
+    {
+        uint32_t files = (inputFile ? 1 : 0) + outputFiles.size();
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        std::cout << "I/O throughput: "
+                  << objectBytes * files / elapsed.count() / 1e6 << " MB/s ("
+                  << files << " files), peak resident set "
+                  << usage.ru_maxrss / 1024 << " MB" << std::endl;
+    }
 
-    // Do pcap tracing on all point-to-point devices on all nodes
-    // pointToPoint.EnablePcapAll ("kodo-wired-broadcast");
+    wiredBroadcast.PrintSummary(std::cout);
+    if (trials > 1)
+    {
+        trialStatistics.Print(std::cout);
+    }
 
-    Simulator::ScheduleWithContext(source->GetNode()->GetId(), Seconds(1.0),
-                                   &Broadcast::SendPacket, &wiredBroadcast,
-                                   source, interPacketInterval);
+    if (!metrics.empty())
+    {
+        wiredBroadcast.GetMetrics().Write(metrics, metricsFormat,
+                                          "kodo-wired-broadcast");
+    }
+
+    // Read by the kodo-benchmark suite
+    std::cout << "Simulator events: " << Simulator::GetEventCount()
+              << std::endl;
 
-    Simulator::Run();
     Simulator::Destroy();
 
+    // A block that does not match its digest fails the run
+    uint32_t corrupted = wiredBroadcast.GetVerifier().GetCorruptedCount();
+    if (corrupted > 0)
+    {
+        std::cerr << corrupted << " decoded blocks failed the verification"
+                  << std::endl;
+        return 1;
+    }
     return 0;
 }